@@ -2,17 +2,20 @@
  *   brcut.c -- functions for branch cutting
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
+#include <malloc.h>
+#include "file.h"
+#include "util.h"
 #include "brcut.h"
 
-/* Place a branch cut in the bitflags array from pixel (a,b) */
-/* to pixel (c,d).  The bit for the branch cut pixels is     */
-/* given by the value of "code".                             */
-void PlaceCut(unsigned char *array, int a, int b, int c, int d,
-              int xsize, int ysize, int code)
+/* Place a branch cut in the cut plane from pixel (a,b) to */
+/* pixel (c,d).  The line is drawn by Bresenham's method,   */
+/* with the nearest pixel (rounding up) taken in each row   */
+/* or column.                                               */
+void PlaceCut(CutPlane *plane, int a, int b, int c, int d)
 {
-  int  i, j, k, ii, jj, m, n, istep, jstep;
-  double  r;
+  int  p, q, m, n, e, step, delta;
 
   /* residue location is upper-left corner of 4-square */
   if (c > a && a > 0) a++;
@@ -20,64 +23,238 @@ void PlaceCut(unsigned char *array, int a, int b, int c, int d,
   if (d > b && b > 0) b++;
   else if (d < b && d > 0) d++;
 
-  if (a==c && b==d) {
-    array[b*xsize + a] |= code;
-    return;
-  }
   m = (a < c) ? c - a : a - c;
   n = (b < d) ? d - b : b - d;
   if (m > n) {
-    istep = (a < c) ? +1 : -1;
-    r = ((double)(d - b))/((double)(c - a));
-    for (i=a; i!=c+istep; i+=istep) {
-      j = b + (i - a)*r + 0.5;
-      array[j*xsize + i] |= code;
+    /* one pixel per column: the row is b + (p*delta)/m rounded, */
+    /* i.e. b + q where e = 2*p*delta + m - 2*q*m is in [0,2m)   */
+    step = (a < c) ? +1 : -1;
+    delta = d - b;
+    for (p=0, q=0, e=m; p<=m; p++) {
+      SetCutPixel(plane, a + p*step, b + q);
+      e += 2*delta;
+      if (e >= 2*m) {
+        e -= 2*m;
+        ++q;
+      }
+      else if (e < 0) {
+        e += 2*m;
+        --q;
+      }
     }
   }
-  else {   /* n < m */
-    jstep = (b < d) ? +1 : -1;
-    r = ((double)(c - a))/((double)(d - b));
-    for (j=b; j!=d+jstep; j+=jstep) {
-      i = a + (j - b)*r + 0.5;
-      array[j*xsize + i] |= code;
+  else if (n > 0) {   /* one pixel per row */
+    step = (b < d) ? +1 : -1;
+    delta = c - a;
+    for (p=0, q=0, e=n; p<=n; p++) {
+      SetCutPixel(plane, a + q, b + p*step);
+      e += 2*delta;
+      if (e >= 2*n) {
+        e -= 2*n;
+        ++q;
+      }
+      else if (e < 0) {
+        e += 2*n;
+        --q;
+      }
     }
   }
+  else {
+    SetCutPixel(plane, a, b);
+  }
   return;
 }
 
+/* Allocate an empty batch of branch cuts */
+CutBatch *AllocateCutBatch(void)
+{
+  CutBatch  *batch;
+  batch = (CutBatch *) malloc(sizeof(CutBatch));
+  if (!batch)
+    ErrorHandler("Cannot allocate memory", "branch cuts",
+                 MEMORY_ALLOCATION_ERROR);
+  batch->num_cuts = 0;
+  batch->max_cuts = 256;
+  AllocateInt(&batch->cuts, 4*batch->max_cuts, "branch cuts");
+  return batch;
+}
+
+/* Free the batch of branch cuts */
+void FreeCutBatch(CutBatch *batch)
+{
+  free(batch->cuts);
+  free(batch);
+}
+
+/* Add the branch cut from pixel (a,b) to pixel (c,d) to the batch */
+void AddCut(CutBatch *batch, int a, int b, int c, int d)
+{
+  int  *cut;
+  if (batch->num_cuts >= batch->max_cuts) {
+    batch->max_cuts *= 2;
+    batch->cuts = (int *) realloc(batch->cuts,
+                                  4*batch->max_cuts*sizeof(int));
+    if (!batch->cuts)
+      ErrorHandler("Cannot allocate memory", "branch cuts",
+                   MEMORY_ALLOCATION_ERROR);
+  }
+  cut = batch->cuts + 4*batch->num_cuts++;
+  cut[0] = a;
+  cut[1] = b;
+  cut[2] = c;
+  cut[3] = d;
+}
+
+/* Draw the branch cuts of the batch in the cut plane (which   */
+/* ApplyCutPlane then writes to the bitflags array in one pass). */
+/* The batch is emptied.                                         */
+void PlaceCuts(CutBatch *batch, CutPlane *plane)
+{
+  int  n, *cut;
+  for (n=0, cut=batch->cuts; n<batch->num_cuts; n++, cut+=4)
+    PlaceCut(plane, cut[0], cut[1], cut[2], cut[3]);
+  batch->num_cuts = 0;
+}
+
+/* Allocate a cut plane with no cut pixels */
+CutPlane *AllocateCutPlane(int xsize, int ysize)
+{
+  CutPlane  *plane;
+  plane = (CutPlane *) malloc(sizeof(CutPlane));
+  if (!plane)
+    ErrorHandler("Cannot allocate memory", "cut plane",
+                 MEMORY_ALLOCATION_ERROR);
+  plane->xsize = xsize;
+  plane->ysize = ysize;
+  plane->words = (xsize + CUT_WORD_BITS - 1)/CUT_WORD_BITS;
+  plane->bits = (CutWord *) calloc(plane->words*ysize, sizeof(CutWord));
+  if (!plane->bits)
+    ErrorHandler("Cannot allocate memory", "cut plane",
+                 MEMORY_ALLOCATION_ERROR);
+  return plane;
+}
+
+/* Free the cut plane */
+void FreeCutPlane(CutPlane *plane)
+{
+  free(plane->bits);
+  free(plane);
+}
+
+/* Set the bits given by "code" in the bitflags array for the cut */
+/* pixels of the plane.  Words without cut pixels are skipped.    */
+void ApplyCutPlane(CutPlane *plane, unsigned char *bitflags, int code)
+{
+  int      i, j, w, xsize = plane->xsize;
+  CutWord  word, *row;
+  for (j=0; j<plane->ysize; j++) {
+    row = plane->bits + j*plane->words;
+    for (w=0; w<plane->words; w++) {
+      for (word=row[w], i=w*CUT_WORD_BITS; word; word>>=1, i++) {
+        if (word & 1) bitflags[j*xsize + i] |= code;
+      }
+    }
+  }
+}
+
+/* Return the number of cut pixels in the plane, counted a word */
+/* at a time                                                    */
+int CountCutPixels(CutPlane *plane)
+{
+  int      k, num = 0;
+  CutWord  word;
+  for (k=0; k<plane->words*plane->ysize; k++) {
+    for (word=plane->bits[k]; word; word &= word - 1)
+      ++num;
+  }
+  return num;
+}
+
 /* Return the squared distance between the pixel (a,b) and the */
-/* nearest border pixel.  The border pixels are encoded in the */
-/* bitflags array by the value of "border_code".               */
-int DistToBorder(unsigned char *bitflags, int border_code,
-               int a, int b, int *ra, int *rb, int xsize, int ysize)
+/* nearest border pixel, and its location (ra,rb).  nearest is */
+/* the array of nearest border pixels from BorderTransform.    */
+int DistToBorder(int *nearest, int a, int b, int *ra, int *rb,
+                 int xsize)
+{
+  int  k;
+  k = nearest[b*xsize + a];
+  *ra = k%xsize;
+  *rb = k/xsize;
+  return (*ra - a)*(*ra - a) + (*rb - b)*(*rb - b);
+}
+
+/* Euclidean distance transform of the border pixels (the pixels */
+/* on the edges of the image, and those whose bitflags contain   */
+/* "border_code"), by the linear time method of Meijster et al.  */
+/* Returns the index of the nearest border pixel of each pixel.  */
+/* Of equally near border pixels, the first in raster order is   */
+/* taken.                                                        */
+int *BorderTransform(unsigned char *bitflags, int border_code,
+                     int xsize, int ysize)
 {
-  int  besta, bestb, found, dist2, best_dist2;
-  int  i, j, k, bs;
-  *ra = *rb = 0;
-  for (bs=0; bs<xsize + ysize; bs++) {
-    found = 0;
-    best_dist2 = 1000000;  /* initialize to large value */
-    /* search boxes of increasing size until border pixel found */
-    for (j=b - bs; j<=b + bs; j++) {
-      for (i=a - bs; i<=a + bs; i++) {
-        k = j*xsize + i;
-        if (i<=0 || i>=xsize - 1 || j<=0 || j>=ysize - 1
-              || (bitflags[k] & border_code)) {
-          found = 1;
-          dist2 = (j - b)*(j - b) + (i - a)*(i - a);
-          if (dist2 < best_dist2) {
-            best_dist2 = dist2;
-            besta = i;
-            bestb = j;
-          }           
+  int  i, j, k, q, u, w, *nearest, *col, *site, *start;
+  AllocateInt(&nearest, xsize*ysize, "border distance transform");
+  AllocateInt(&col, ysize, "border distance transform");
+  AllocateInt(&site, ysize, "border distance transform");
+  AllocateInt(&start, ysize, "border distance transform");
+  /* nearest border pixel in each row (the edges are border) */
+  for (j=0; j<ysize; j++) {
+    k = j*xsize;
+    for (i=0, q=0; i<xsize; i++) {
+      if (i==0 || i==xsize-1 || j==0 || j==ysize-1
+            || (bitflags[k + i] & border_code)) q = i;
+      nearest[k + i] = q;
+    }
+    for (i=xsize - 2, q=xsize - 1; i>0; i--) {
+      if (nearest[k + i]==i) q = i;
+      else if (q - i < i - nearest[k + i]) nearest[k + i] = q;
+    }
+  }
+  /* lower envelope of the row distances along each column */
+  for (i=0; i<xsize; i++) {
+    for (j=0; j<ysize; j++) col[j] = nearest[j*xsize + i];
+    q = 0;
+    site[0] = start[0] = 0;
+    for (u=1; u<ysize; u++) {
+      while (q >= 0 && RowDist2(start[q], site[q], i, col)
+                          > RowDist2(start[q], u, i, col)) --q;
+      if (q < 0) {
+        q = 0;
+        site[0] = u;
+      }
+      else {
+        w = 1 + EnvelopeSep(site[q], u, i, col);
+        if (w < ysize) {
+          ++q;
+          site[q] = u;
+          start[q] = w;
         }
       }
     }
-    if (found) {
-      *ra = besta;
-      *rb = bestb;
-      break;
+    for (u=ysize - 1; u>=0; u--) {
+      nearest[u*xsize + i] = site[q]*xsize + col[site[q]];
+      if (u==start[q]) --q;
     }
   }
-  return best_dist2;
-} 
+  free(col);
+  free(site);
+  free(start);
+  return nearest;
+}
+
+/* Squared distance from pixel (i,u) to the border pixel nearest */
+/* to it in row j (at column col[j])                             */
+int RowDist2(int u, int j, int i, int *col)
+{
+  return (u - j)*(u - j) + (i - col[j])*(i - col[j]);
+}
+
+/* Last row at which the row j < u border pixel is no farther than */
+/* the row u one (rounded down)                                    */
+int EnvelopeSep(int j, int u, int i, int *col)
+{
+  int  num, den;
+  num = u*u - j*j + (i - col[u])*(i - col[u]) - (i - col[j])*(i - col[j]);
+  den = 2*(u - j);
+  return (num >= 0) ? num/den : -((-num + den - 1)/den);
+}
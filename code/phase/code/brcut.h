@@ -1,7 +1,39 @@
 #ifndef __BRCUT
 #define __BRCUT
-void PlaceCut(unsigned char *array, int a, int b, int c, int d,
-              int xsize, int ysize, int code);
-int DistToBorder(unsigned char *bitflags, int border_code,
-            int a, int b, int *ra, int *rb, int xsize, int ysize);
+/* Bit-packed plane of branch cut pixels: pixel (i,j) is bit      */
+/* i%CUT_WORD_BITS of bits[j*words + i/CUT_WORD_BITS], so a word  */
+/* tells whether any of CUT_WORD_BITS pixels of a row is cut.     */
+/* The branch cut routines draw into a plane owned by the caller, */
+/* who applies it to the bitflags array or queries it.            */
+typedef unsigned long CutWord;
+#define CUT_WORD_BITS   ((int)(8*sizeof(CutWord)))
+typedef struct {
+  int      xsize, ysize;
+  int      words;         /* words per row */
+  CutWord  *bits;
+} CutPlane;
+#define SetCutPixel(plane, i, j) \
+  ((plane)->bits[(j)*(plane)->words + (i)/CUT_WORD_BITS] \
+        |= ((CutWord) 1) << ((i)%CUT_WORD_BITS))
+/* Branch cuts to be drawn at once.  Cut n goes from pixel   */
+/* (cuts[4n],cuts[4n+1]) to pixel (cuts[4n+2],cuts[4n+3]).   */
+typedef struct {
+  int  num_cuts, max_cuts;
+  int  *cuts;
+} CutBatch;
+void PlaceCut(CutPlane *plane, int a, int b, int c, int d);
+CutBatch *AllocateCutBatch(void);
+void FreeCutBatch(CutBatch *batch);
+void AddCut(CutBatch *batch, int a, int b, int c, int d);
+void PlaceCuts(CutBatch *batch, CutPlane *plane);
+CutPlane *AllocateCutPlane(int xsize, int ysize);
+void FreeCutPlane(CutPlane *plane);
+void ApplyCutPlane(CutPlane *plane, unsigned char *bitflags, int code);
+int CountCutPixels(CutPlane *plane);
+int DistToBorder(int *nearest, int a, int b, int *ra, int *rb,
+                 int xsize);
+int *BorderTransform(unsigned char *bitflags, int border_code,
+                     int xsize, int ysize);
+int RowDist2(int u, int j, int i, int *col);
+int EnvelopeSep(int j, int u, int i, int *col);
 #endif
@@ -1,111 +1,203 @@
 #include <malloc.h>
 #include <stdio.h>
 #include <math.h>
+#include <unistd.h>
 #include "file.h"
+#include "util.h"
 #include "dct.h"
 
 /*
  * Two-dimensional cosine tranform of array.
  * Array must be dimensioned from 0 to xsize * ysize - 1.
- * (xsize & ysize each must be one more than a power of two)
- * For forward transform, sign = 1.  For inverse transform,
- * sign = -1.
+ * (xsize & ysize may be any size, but one more than a power of
+ * two, or one more than twice a product of 2's, 3's, 5's and 7's,
+ * is fastest; see DctSize.)  For forward transform, sign = 1.
+ * For inverse transform, sign = -1.  The plan holds the tables
+ * and scratch memory for this array size (see AllocateCosinePlan);
+ * if it is NULL, a temporary single-threaded plan is made.
  */
 void FastCosineTransform(float *array, int xsize, int ysize,
-                         int sign)
+                         int sign, CosinePlan *plan)
 {
-  int          i, j;
-  double       tmpr;
-  float        *vector, *buffer;
-  vector = (float*) malloc(ysize*sizeof(float));
-  if (!vector) {
-    fprintf(stderr, "Cannot allocate memory for cosine transf.\n");
-    exit(MEMORY_ALLOCATION_ERROR);
+  if (!plan) {
+    plan = AllocateCosinePlan(xsize, ysize, 1);
+    FastCosineTransform(array, xsize, ysize, sign, plan);
+    FreeCosinePlan(plan);
+    return;
   }
-  buffer = (float *) malloc(BLOCKSIZE*ysize*sizeof(float));
-  if (!buffer) {
-    fprintf(stderr, "Cannot allocate buffer for cosine transf.\n");
-    exit(MEMORY_ALLOCATION_ERROR);
-  }
-  RowDcts(array, xsize, ysize, sign);
-  ColDcts(array, xsize, ysize, sign, vector, buffer);
-  free(vector);
-  free(buffer);
+  RowDcts(array, xsize, ysize, sign, plan);
+  ColDcts(array, xsize, ysize, sign, plan);
 }
 
-/* Perform 1-dim fast DCT's on rows of array */
-void RowDcts(float *array, int xsize, int ysize, int sign)
+/* Perform 1-dim fast DCT's on rows of array.  The rows are split */
+/* into one contiguous chunk per thread.                          */
+void RowDcts(float *array, int xsize, int ysize, int sign,
+             CosinePlan *plan)
 {
-  int  i, j;
-  for (j=0; j<ysize; j++) {
-    FastDct(&array[j*xsize], xsize, sign);
-  }
+  DctTask  t;
+  t.array = array;   t.xsize = xsize;   t.ysize = ysize;
+  t.sign = sign;     t.plan = plan;
+  RunThreadPool(plan->pool, RowDctTask, &t, plan->num_threads);
 }
 
-/* Perform 1-dim fast DCT's on columns of array */
+/* Perform 1-dim fast DCT's on columns of array.  Each task does */
+/* a block of plan->block columns.                               */
 void ColDcts(float *array, int xsize, int ysize, int sign,
-             float *vector, float *buffer)
-{
-  int  i, j;
-  int  ii, istop, blocksize=BLOCKSIZE;
-  if (blocksize<=0) {
-    for (i=0; i<xsize; i++) {
-      for (j=0; j<ysize; j++) {
-        vector[j] = array[j*xsize + i];
-      }
-      FastDct(vector, ysize, sign);
-      for (j=0; j<ysize; j++) {
-        array[j*xsize + i] = vector[j];
-      } 
+             CosinePlan *plan)
+{
+  DctTask  t;
+  t.array = array;   t.xsize = xsize;   t.ysize = ysize;
+  t.sign = sign;     t.plan = plan;
+  RunThreadPool(plan->pool, ColDctTask, &t,
+                (xsize + plan->block - 1)/plan->block);
+}
+
+/* DCT's of the rows in chunk number "task".  If the batched DCT */
+/* can be used, blocks of rows are transposed into the thread's  */
+/* buffer and transformed together.                             */
+void RowDctTask(void *arg, int task, int worker)
+{
+  int         j, jj, jstart, jstop, nb, xsize, block;
+  float       *array, *buffer;
+  DctTask     *t = (DctTask *) arg;
+  DctPlan     *plan = t->plan->row[worker];
+  array = t->array;    xsize = t->xsize;
+  buffer = t->plan->buffer[worker];
+  block = t->plan->block;
+  jstart = (int)((long)task*t->ysize/t->plan->num_threads);
+  jstop = (int)((long)(task + 1)*t->ysize/t->plan->num_threads);
+  if (!BatchedDct(plan)) {
+    for (j=jstart; j<jstop; j++) {
+      FastDct(&array[j*xsize], xsize, t->sign, plan);
     }
+    return;
   }
-  else {
-    for (ii=0; ii<xsize; ii+=blocksize) {
-      istop = (ii + blocksize <= xsize) ? ii + blocksize : xsize;
-      for (j=0; j<ysize; j++) {
-        for (i=ii; i<istop; i++) {
-          buffer[(i - ii)*ysize + j] = array[j*xsize + i];
-        }
+  for (jj=jstart; jj<jstop; jj+=block) {
+    nb = (jj + block <= jstop) ? block : jstop - jj;
+    Transpose(&array[jj*xsize], xsize, buffer, nb, nb, xsize);
+    FastDcts(buffer, xsize, nb, t->sign, plan);
+    Transpose(buffer, nb, &array[jj*xsize], xsize, xsize, nb);
+  }
+}
+
+/* DCT's of the columns in block number "task".  The block is     */
+/* copied into the thread's buffer, where it is transformed by the */
+/* batched DCT if possible, or else transposed and transformed     */
+/* one column at a time.                                           */
+void ColDctTask(void *arg, int task, int worker)
+{
+  int         i, j, nb;
+  int         ii, xsize, ysize;
+  float       *array, *buffer;
+  DctTask     *t = (DctTask *) arg;
+  DctPlan     *plan = t->plan->col[worker];
+  array = t->array;    xsize = t->xsize;    ysize = t->ysize;
+  buffer = t->plan->buffer[worker];
+  ii = task*t->plan->block;
+  nb = (ii + t->plan->block <= xsize) ? t->plan->block : xsize - ii;
+  if (BatchedDct(plan)) {
+    for (j=0; j<ysize; j++) {
+      for (i=0; i<nb; i++) {
+        buffer[j*nb + i] = array[j*xsize + ii + i];
       }
-      for (i=ii; i<istop; i++) {        
-        FastDct(&buffer[(i - ii)*ysize], ysize, sign);
+    }
+    FastDcts(buffer, ysize, nb, t->sign, plan);
+    for (j=0; j<ysize; j++) {
+      for (i=0; i<nb; i++) {
+        array[j*xsize + ii + i] = buffer[j*nb + i];
       }
-      for (j=0; j<ysize; j++) {
-        for (i=ii; i<istop; i++) {
-          array[j*xsize + i] = buffer[(i - ii)*ysize + j];
-        }
+    }
+  }
+  else {
+    Transpose(&array[ii], xsize, buffer, ysize, ysize, nb);
+    for (i=0; i<nb; i++) {
+      FastDct(&buffer[i*ysize], ysize, t->sign, plan);
+    }
+    Transpose(buffer, ysize, &array[ii], xsize, nb, ysize);
+  }
+}
+
+/* Cache-oblivious transpose: out[c*ostride + r] = in[r*istride + c] */
+/* for r < rows and c < cols.  The larger dimension is halved until  */
+/* the tiles are small enough to stay in cache at any level.         */
+void Transpose(float *in, int istride, float *out, int ostride,
+               int rows, int cols)
+{
+  int  r, c, h;
+  if (rows <= TRANSPOSE_TILE && cols <= TRANSPOSE_TILE) {
+    for (r=0; r<rows; r++) {
+      for (c=0; c<cols; c++) {
+        out[c*ostride + r] = in[r*istride + c];
       }
     }
   }
+  else if (rows >= cols) {
+    h = rows/2;
+    Transpose(in, istride, out, ostride, h, cols);
+    Transpose(in + h*istride, istride, out + h, ostride,
+              rows - h, cols);
+  }
+  else {
+    h = cols/2;
+    Transpose(in, istride, out, ostride, rows, h);
+    Transpose(in + h, istride, out + h*ostride, ostride,
+              rows, cols - h);
+  }
 }
 
-/* Fast Discrete Cosine Transform 
- *   The array must be dimensioned from 0 to size-1 
- *   (size must be one more than a power of two).
+/* Number of rows or columns transformed together, chosen so that */
+/* a block of the longer of them fills about half of the L2 cache */
+int DctBlockSize(int xsize, int ysize)
+{
+  long  cache=0;
+  int   block;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  if (cache <= 0) cache = DCT_CACHE_SIZE;
+  block = (int)(cache/(2*sizeof(float)*((xsize > ysize) ? xsize : ysize)));
+  if (block > MAX_DCT_BLOCK) block = MAX_DCT_BLOCK;
+  block -= block%MIN_DCT_BLOCK;
+  if (block < MIN_DCT_BLOCK) block = MIN_DCT_BLOCK;
+  return block;
+}
+
+/* Fast Discrete Cosine Transform
+ *   The array must be dimensioned from 0 to size-1
+ *   (size may be any value greater than one).
  *   If sign = -1, the inverse transform is computed.
+ *   The plan must have been made for this size (if it is
+ *   NULL, a temporary plan is made).
  */
-void FastDct(float *array, int size, int sign)
+void FastDct(float *array, int size, int sign, DctPlan *plan)
 {
   int     j;
   double  rmult, sum, p1, p2;
-  double  angle, zr, zi, zpi, zpr, r;
+  double  zr, zi, *z;
+  if (size < 2) return;
+  if (!plan) {
+    plan = AllocateDctPlan(size);
+    FastDct(array, size, sign, plan);
+    FreeDctPlan(plan);
+    return;
+  }
+  if ((size - 1)%2) {   /* real FFT below requires even size */
+    DctByExtension(array, size, sign, plan);
+    return;
+  }
   --array;            --size;
-  angle = PI/size;    r = sin(0.5*angle);
-  zpr = -2.0*r*r;     zpi = sin(angle);
-  zr = 1.0;           zi = 0.0;
+  z = plan->dct_twiddles;
   sum =      0.5*(array[1] - array[size + 1]);
   array[1] = 0.5*(array[1] + array[size + 1]);
   for (j=2; j<=size/2; j++) {
-    r = zr;
-    zr =  r*zpr - zi*zpi + zr;
-    zi = zi*zpr +  r*zpi + zi;
+    zr = z[2*j];      zi = z[2*j + 1];
     p1 = 0.5*(array[j] + array[size + 2 - j]);
     p2 =     (array[j] - array[size + 2 - j]);
     array[j] = p1 - zi*p2;
     array[size + 2 - j] = p1 + zi*p2;
     sum += zr*p2;
   }
-  RealFft(array, size, 1);
+  RealFft(array, size, 1, plan);
   array[size + 1] = array[2];
   array[2] = sum;
   for (j=4; j<=size; j+=2) {
@@ -117,31 +209,49 @@ void FastDct(float *array, int size, int sign)
   for (j=1; j<=size+1; j++) array[j] *= rmult;
 }
 
-/* FFT of real function (size must be a power of two) */
-void RealFft(float *array, int size, int sign)
+/* DCT of array by means of the real FFT of its even extension, */
+/* whose size is 2*(size-1).  Used when size-1 is odd.  The      */
+/* scaling is the same as that of FastDct.                       */
+void DctByExtension(float *array, int size, int sign, DctPlan *plan)
+{
+  int     j, n;
+  double  rmult;
+  float   *ext;
+  n = 2*(size - 1);
+  ext = plan->ext;
+  for (j=0; j<size; j++) ext[j] = array[j];
+  for (j=size; j<n; j++) ext[j] = array[n - j];
+  RealFft(ext - 1, n, 1, plan);
+  rmult = (sign < 0) ? 1.0/n : 1.0;
+  array[0] = rmult*ext[0];
+  array[size - 1] = rmult*ext[1];
+  for (j=1; j<size-1; j++) array[j] = rmult*ext[2*j];
+}
+
+/* FFT of real function (size must be even, and equal to the */
+/* real_size of the plan)                                    */
+void RealFft(float *array, int size, int sign, DctPlan *plan)
 {
   int     i, i1, i2, i3, i4;
   double  s1, s2, qr, qi, rr, ri;
-  double  zr, zi, zpr, zpi, r, angle;
+  double  zr, zi, *z;
 
-  angle = PI/(size/2); 
+  z = plan->real_twiddles;
   s1 = 0.5;
   if (sign > 0) {
-    s2 = -0.5;        
-    Fft(array, size/2, 1);
+    s2 = -0.5;
+    Fft(array, size/2, 1, plan->fft);
   }
   else {
-    s2 = 0.5;         
-    angle = -angle;
+    s2 = 0.5;
   }
-  r = sin(0.5*angle);
-  zpr = -2.0*r*r;     zpi = sin(angle);
-  zr = 1.0 + zpr;     zi = zpi;
-  for (i=2; i<= size/4; i++) {
+  for (i=2; i<= (size + 2)/4; i++) {
     i1 = 2*i - 1;
     i2 = i1 + 1;
     i3 = size + 3 - i2;
     i4 = i3 + 1;
+    zr = z[2*i];
+    zi = (sign > 0) ? z[2*i + 1] : -z[2*i + 1];
     qr = s1*(array[i1] + array[i3]);
     qi = s1*(array[i2] - array[i4]);
     rr = -s2*(array[i2] + array[i4]);
@@ -150,9 +260,6 @@ void RealFft(float *array, int size, int sign)
     array[i2]  =  qi + zr*ri + zi*rr;
     array[i3]  =  qr - zr*rr + zi*ri;
     array[i4]  = -qi + zr*ri + zi*rr;
-    r = zr;
-    zr = r*zpr - zi*zpi + zr;
-    zi = zi*zpr + r*zpi + zi;
   }
   qr = array[1];
   if (sign > 0) {
@@ -162,22 +269,702 @@ void RealFft(float *array, int size, int sign)
   else {
     array[1] = s1*(qr + array[2]);
     array[2] = s1*(qr - array[2]);
-    Fft(array, size/2, -1);
+    Fft(array, size/2, -1, plan->fft);
   }
 }
 
-/* FFT (size must be a power of two) */
-void Fft(float *array, int size, int sign)
+/* FFT (sizes other than powers of two are passed to MixedRadixFft) */
+void Fft(float *array, int size, int sign, FftPlan *plan)
 {
-  int           n, nmax, m, j, istep, i;
-  double        r, zr, zpr, zpi, zi, angle;
+  int           n, nmax, m, j, istep, i, k;
+  double        zr, zi, *z;
   double        tmp, tmpr, tmpi;
-  j = 1;   n = 2*size;
+  if (plan->kind != radix2_fft) {
+    MixedRadixFft(array, size, sign, plan);
+    return;
+  }
+  n = 2*size;
+  for (k=0; k<plan->num_swaps; k++) {
+    i = plan->swaps[2*k];    j = plan->swaps[2*k + 1];
+    tmp = array[j]; array[j] = array[i]; array[i] = tmp;
+    tmp = array[j+1]; array[j+1] = array[i+1]; array[i+1] = tmp;
+  }
+  z = plan->twiddles;
+  nmax = 2;
+  while (n > nmax) {
+    istep = 2*nmax;
+    for (m=1; m<nmax; m+=2) {
+      zr = z[0];
+      zi = (sign < 0) ? -z[1] : z[1];
+      z += 2;
+      for (i=m; i<=n; i+=istep) {
+        j = i + nmax;
+        tmpr = zr*array[j] - zi*array[j+1];
+        tmpi = zr*array[j+1] + zi*array[j];
+        array[j]   = array[i]   - tmpr;
+        array[j+1] = array[i+1] - tmpi;
+        array[i]   += tmpr;
+        array[i+1] += tmpi;
+      }
+    }
+    nmax = istep;
+  }
+}
+
+/* Batched DCT's, for the row and column passes of the 2-dim   */
+/* transform.  The nb transforms are interleaved point by point */
+/* (point j of transform b is array[j*nb + b]), so every step   */
+/* of the algorithm is a loop over b that the compiler turns    */
+/* into SIMD instructions.  The arithmetic is that of FastDct, */
+/* except that the FFT butterflies are done in single precision */
+/* (see Ffts).  Only plans with BatchedDct(plan) true may be    */
+/* used, and nb <= MAX_DCT_BLOCK.                               */
+SIMD_CLONES
+void FastDcts(float *array, int size, int nb, int sign, DctPlan *plan)
+{
+  int     j, b;
+  double  rmult, p1, p2, zr, zi, *z, *sum;
+  float   *a, *x, *y;
+  a = array - nb;     /* a[j*nb + b] is point j (1-based) */
+  --size;
+  z = plan->dct_twiddles;
+  sum = plan->sums;
+  x = a + nb;    y = a + (size + 1)*nb;
+  for (b=0; b<nb; b++) {
+    sum[b] = 0.5*(x[b] - y[b]);
+    x[b]   = 0.5*(x[b] + y[b]);
+  }
+  for (j=2; j<=size/2; j++) {
+    zr = z[2*j];      zi = z[2*j + 1];
+    x = a + j*nb;     y = a + (size + 2 - j)*nb;
+    for (b=0; b<nb; b++) {
+      p1 = 0.5*(x[b] + y[b]);
+      p2 =     (x[b] - y[b]);
+      x[b] = p1 - zi*p2;
+      y[b] = p1 + zi*p2;
+      sum[b] += zr*p2;
+    }
+  }
+  RealFfts(array, size, nb, 1, plan);
+  x = a + 2*nb;    y = a + (size + 1)*nb;
+  for (b=0; b<nb; b++) {
+    y[b] = x[b];
+    x[b] = sum[b];
+  }
+  for (j=4; j<=size; j+=2) {
+    x = a + j*nb;
+    for (b=0; b<nb; b++) {
+      sum[b] += x[b];
+      x[b] = sum[b];
+    }
+  }
+  if (sign < 0) rmult = 1.0/size;
+  else rmult = 2.0;
+  for (j=0; j<(size + 1)*nb; j++) array[j] *= rmult;
+}
+
+/* Batched real FFT's (see FastDcts and RealFft) */
+SIMD_CLONES
+void RealFfts(float *array, int size, int nb, int sign, DctPlan *plan)
+{
+  int     i, b;
+  double  s1, s2, qr, qi, rr, ri;
+  double  zr, zi, *z;
+  float   *a, *x1, *x2, *x3, *x4;
+  a = array - nb;
+  z = plan->real_twiddles;
+  s1 = 0.5;
+  if (sign > 0) {
+    s2 = -0.5;
+    Ffts(array, size/2, nb, 1, plan->fft);
+  }
+  else {
+    s2 = 0.5;
+  }
+  for (i=2; i<= (size + 2)/4; i++) {
+    x1 = a + (2*i - 1)*nb;       x2 = x1 + nb;
+    x3 = a + (size + 3 - 2*i)*nb;   x4 = x3 + nb;
+    zr = z[2*i];
+    zi = (sign > 0) ? z[2*i + 1] : -z[2*i + 1];
+    for (b=0; b<nb; b++) {
+      qr = s1*(x1[b] + x3[b]);
+      qi = s1*(x2[b] - x4[b]);
+      rr = -s2*(x2[b] + x4[b]);
+      ri =  s2*(x1[b] - x3[b]);
+      x1[b]  =  qr + zr*rr - zi*ri;
+      x2[b]  =  qi + zr*ri + zi*rr;
+      x3[b]  =  qr - zr*rr + zi*ri;
+      x4[b]  = -qi + zr*ri + zi*rr;
+    }
+  }
+  x1 = array;    x2 = array + nb;
+  for (b=0; b<nb; b++) {
+    qr = x1[b];
+    if (sign > 0) {
+      x1[b] = qr + x2[b];
+      x2[b] = qr - x2[b];
+    }
+    else {
+      x1[b] = s1*(qr + x2[b]);
+      x2[b] = s1*(qr - x2[b]);
+    }
+  }
+  if (sign < 0) Ffts(array, size/2, nb, -1, plan->fft);
+}
+
+/* Batched radix-2 FFT's (see FastDcts and Fft).  The real and  */
+/* imaginary parts of point k of transform b are array[2*k*nb + */
+/* b] and array[(2*k + 1)*nb + b].  Pairs of radix-2 stages are */
+/* done together as radix-4 passes, which halves the number of  */
+/* passes through the data.  The butterflies are computed in    */
+/* single precision, which doubles the number of SIMD lanes;    */
+/* the results differ from those of Fft by float roundoff.      */
+/* Other sizes are passed to MixedRadixFfts.                    */
+SIMD_CLONES
+void Ffts(float *array, int size, int nb, int sign, FftPlan *plan)
+{
+  int     k, b, h, g, m;
+  float   tmp, *x, *y, *x0, *x1, *x2, *x3;
+  float   b0r, b0i, b1r, b1i, b2r, b2i, b3r, b3i;
+  float   tmpr, tmpi, w1r, w1i, w2r, w2i, w3r, w3i;
+  double  *z;
+  double  s = (sign < 0) ? -1.0 : 1.0;
+  if (plan->kind != radix2_fft) {
+    MixedRadixFfts(array, size, nb, sign, plan);
+    return;
+  }
+  /* bit reversal (the swaps are 1-based float indices, as in Fft) */
+  for (k=0; k<plan->num_swaps; k++) {
+    x = array + (plan->swaps[2*k] - 1)*nb;
+    y = array + (plan->swaps[2*k + 1] - 1)*nb;
+    for (b=0; b<2*nb; b++) {
+      tmp = x[b];    x[b] = y[b];    y[b] = tmp;
+    }
+  }
+  z = plan->twiddles;
+  for (h=1; h<size; ) {
+    if (4*h <= size) {    /* stages of span 2h and 4h */
+      for (m=0; m<h; m++) {
+        w1r = z[2*m];                w1i = s*z[2*m + 1];
+        w2r = z[2*(h + m)];          w2i = s*z[2*(h + m) + 1];
+        w3r = z[2*(2*h + m)];        w3i = s*z[2*(2*h + m) + 1];
+        for (g=m; g<size; g+=4*h) {
+          x0 = array + 2*g*nb;           x1 = x0 + 2*h*nb;
+          x2 = x1 + 2*h*nb;              x3 = x2 + 2*h*nb;
+          for (b=0; b<nb; b++) {
+            tmpr = w1r*x1[b] - w1i*x1[nb + b];
+            tmpi = w1r*x1[nb + b] + w1i*x1[b];
+            b1r = x0[b] - tmpr;         b1i = x0[nb + b] - tmpi;
+            b0r = x0[b] + tmpr;         b0i = x0[nb + b] + tmpi;
+            tmpr = w1r*x3[b] - w1i*x3[nb + b];
+            tmpi = w1r*x3[nb + b] + w1i*x3[b];
+            b3r = x2[b] - tmpr;         b3i = x2[nb + b] - tmpi;
+            b2r = x2[b] + tmpr;         b2i = x2[nb + b] + tmpi;
+            tmpr = w2r*b2r - w2i*b2i;
+            tmpi = w2r*b2i + w2i*b2r;
+            x2[b] = b0r - tmpr;         x2[nb + b] = b0i - tmpi;
+            x0[b] = b0r + tmpr;         x0[nb + b] = b0i + tmpi;
+            tmpr = w3r*b3r - w3i*b3i;
+            tmpi = w3r*b3i + w3i*b3r;
+            x3[b] = b1r - tmpr;         x3[nb + b] = b1i - tmpi;
+            x1[b] = b1r + tmpr;         x1[nb + b] = b1i + tmpi;
+          }
+        }
+      }
+      z += 2*(h + 2*h);
+      h *= 4;
+    }
+    else {                /* last stage, of span 2h */
+      for (m=0; m<h; m++) {
+        w1r = z[2*m];                w1i = s*z[2*m + 1];
+        for (g=m; g<size; g+=2*h) {
+          x0 = array + 2*g*nb;           x1 = x0 + 2*h*nb;
+          for (b=0; b<nb; b++) {
+            tmpr = w1r*x1[b] - w1i*x1[nb + b];
+            tmpi = w1r*x1[nb + b] + w1i*x1[b];
+            x1[b] = x0[b] - tmpr;       x1[nb + b] = x0[nb + b] - tmpi;
+            x0[b] += tmpr;              x0[nb + b] += tmpi;
+          }
+        }
+      }
+      z += 2*h;
+      h *= 2;
+    }
+  }
+}
+
+/* Batched mixed-radix FFT's (see Ffts), for sizes that factor  */
+/* into 2's, 3's, 5's and 7's.  Each pass of the Stockham        */
+/* algorithm does the radix-p butterflies of one factor, reading */
+/* one of array and plan->batch and writing the other, so the    */
+/* output comes out in natural order without digit reversal.     */
+SIMD_CLONES
+void MixedRadixFfts(float *array, int size, int nb, int sign,
+                    FftPlan *plan)
+{
+  int     f, p, m, s, j, q, r, t, b, n2;
+  float   *in, *out, *tmp, *a0, *a1, *a2, *a3, *y;
+  float   wr[MAX_FFT_RADIX], wi[MAX_FFT_RADIX];
+  float   er, ei, ar, ai, br, bi, cr, ci, dr, di;
+  double  *z;
+  z = (sign < 0) ? plan->itwiddles : plan->twiddles;
+  n2 = 2*nb;
+  in = array;    out = plan->batch;
+  for (f=0, s=1; s<size; f++, s*=p) {
+    p = plan->factors[f];
+    m = size/(s*p);
+    for (j=0; j<m; j++) {
+      /* twiddle factors w^(j*t) of this pass, w = z[s] */
+      for (t=0; t<p; t++) {
+        wr[t] = z[2*j*t*s];    wi[t] = z[2*j*t*s + 1];
+      }
+      for (q=0; q<s; q++) {
+        a0 = in + (q + s*j)*n2;
+        y = out + (q + s*p*j)*n2;
+        if (p==2) {
+          a1 = a0 + s*m*n2;
+          for (b=0; b<nb; b++) {
+            ar = a0[b] - a1[b];        ai = a0[nb + b] - a1[nb + b];
+            y[b] = a0[b] + a1[b];      y[nb + b] = a0[nb + b] + a1[nb + b];
+            y[s*n2 + b]      = wr[1]*ar - wi[1]*ai;
+            y[s*n2 + nb + b] = wr[1]*ai + wi[1]*ar;
+          }
+        }
+        else if (p==4) {
+          a1 = a0 + s*m*n2;    a2 = a1 + s*m*n2;    a3 = a2 + s*m*n2;
+          er = (sign < 0) ? -1.0 : 1.0;   /* fourth root of 1 is er*i */
+          for (b=0; b<nb; b++) {
+            ar = a0[b] + a2[b];        ai = a0[nb + b] + a2[nb + b];
+            br = a0[b] - a2[b];        bi = a0[nb + b] - a2[nb + b];
+            cr = a1[b] + a3[b];        ci = a1[nb + b] + a3[nb + b];
+            dr = -er*(a1[nb + b] - a3[nb + b]);
+            di =  er*(a1[b] - a3[b]);
+            y[b] = ar + cr;            y[nb + b] = ai + ci;
+            ar -= cr;                  ai -= ci;
+            cr = br + dr;              ci = bi + di;
+            br -= dr;                  bi -= di;
+            y[s*n2 + b]        = wr[1]*cr - wi[1]*ci;
+            y[s*n2 + nb + b]   = wr[1]*ci + wi[1]*cr;
+            y[2*s*n2 + b]      = wr[2]*ar - wi[2]*ai;
+            y[2*s*n2 + nb + b] = wr[2]*ai + wi[2]*ar;
+            y[3*s*n2 + b]      = wr[3]*br - wi[3]*bi;
+            y[3*s*n2 + nb + b] = wr[3]*bi + wi[3]*br;
+          }
+        }
+        else {   /* generic odd radix */
+          for (t=0; t<p; t++) {
+            for (b=0; b<nb; b++) {
+              y[t*s*n2 + b] = a0[b];
+              y[t*s*n2 + nb + b] = a0[nb + b];
+            }
+            for (r=1; r<p; r++) {
+              a1 = a0 + r*s*m*n2;
+              er = z[2*((r*t)%p)*s*m];    ei = z[2*((r*t)%p)*s*m + 1];
+              for (b=0; b<nb; b++) {
+                y[t*s*n2 + b]      += er*a1[b] - ei*a1[nb + b];
+                y[t*s*n2 + nb + b] += er*a1[nb + b] + ei*a1[b];
+              }
+            }
+            if (t > 0) {
+              for (b=0; b<nb; b++) {
+                ar = y[t*s*n2 + b];    ai = y[t*s*n2 + nb + b];
+                y[t*s*n2 + b]      = wr[t]*ar - wi[t]*ai;
+                y[t*s*n2 + nb + b] = wr[t]*ai + wi[t]*ar;
+              }
+            }
+          }
+        }
+      }
+    }
+    tmp = in;    in = out;    out = tmp;
+  }
+  if (in != array) {
+    for (b=0; b<size*n2; b++) array[b] = in[b];
+  }
+}
+
+/* True if FastDcts can be used with this plan (the DCT size-1 */
+/* must be twice a product of 2's, 3's, 5's and 7's)           */
+int BatchedDct(DctPlan *plan)
+{
+  return (plan->dct_twiddles && plan->fft
+             && plan->fft->kind!=bluestein_fft);
+}
+
+/* FFT of any size.  The array is dimensioned from 1 to 2*size, as */
+/* in Fft.  Sizes that factor into 2's, 3's, 5's and 7's are done  */
+/* by the mixed-radix algorithm; all others by Bluestein's method. */
+void MixedRadixFft(float *array, int size, int sign, FftPlan *plan)
+{
+  int     k;
+  double  *data;
+  if (size < 2) return;
+  if (plan->kind == bluestein_fft) {
+    BluesteinFft(array, size, sign, plan);
+    return;
+  }
+  data = plan->work;
+  for (k=0; k<2*size; k++) data[k] = array[k + 1];
+  DoubleFft(data, size, sign, plan);
+  for (k=0; k<2*size; k++) array[k + 1] = data[k];
+}
+
+/* Factor size into radices 4, 2, 3, 5 and 7, stored in "factors". */
+/* Returns the number of factors, or -1 if size has a prime factor */
+/* greater than 7.                                                  */
+int FftFactors(int size, int *factors)
+{
+  int  n=0, p;
+  while (size%4==0) {
+    factors[n++] = 4;    size /= 4;
+  }
+  for (p=2; p<=7; p++) {
+    while (size%p==0) {
+      factors[n++] = p;  size /= p;
+    }
+  }
+  return (size==1) ? n : -1;
+}
+
+/* Smallest DCT size not less than "size" that needs neither the  */
+/* even extension nor Bluestein's method, i.e., whose size-1 is   */
+/* twice a product of 2's, 3's, 5's and 7's.  Powers of two plus  */
+/* one are returned unchanged.                                    */
+int DctSize(int size)
+{
+  int  m, factors[MAX_FFT_FACTORS];
+  if (size < 3) return 3;
+  for (m=size; (m - 1)%2 || FftFactors((m - 1)/2, factors) < 0; m++)
+    ;
+  return m;
+}
+
+/* In-place complex FFT of double-precision data dimensioned from */
+/* 0 to 2*size - 1 (real and imaginary parts interleaved), using  */
+/* a mixed-radix plan for this size.                              */
+void DoubleFft(double *data, int size, int sign, FftPlan *plan)
+{
+  int     k;
+  double  *out;
+  if (size < 2) return;
+  out = plan->work + 2*size;
+  MixedRadixPass(out, data, size, 1, plan->factors,
+                 (sign < 0) ? plan->itwiddles : plan->twiddles, size);
+  for (k=0; k<2*size; k++) data[k] = out[k];
+}
+
+/* Decimation-in-time pass of the mixed-radix FFT (called     */
+/* recursively).  Transforms the len points of "in" spaced by */
+/* stride into "out".  nfft is the size of the whole FFT.     */
+void MixedRadixPass(double *out, double *in, int len, int stride,
+                    int *factors, double *twiddles, int nfft)
+{
+  int  k, p, m;
+  p = factors[0];
+  m = len/p;
+  if (m==1) {
+    for (k=0; k<p; k++) {
+      out[2*k] = in[2*k*stride];
+      out[2*k + 1] = in[2*k*stride + 1];
+    }
+  }
+  else {
+    for (k=0; k<p; k++) {
+      MixedRadixPass(&out[2*k*m], &in[2*k*stride], m, stride*p,
+                     factors + 1, twiddles, nfft);
+    }
+  }
+  Butterflies(out, m, p, stride, twiddles, nfft);
+}
+
+/* Combine p transforms of length m (stored consecutively in out) */
+/* into one transform of length p*m.                              */
+void Butterflies(double *out, int m, int p, int stride,
+                 double *twiddles, int nfft)
+{
+  int     k, q, r, t;
+  double  yr[8], yi[8], wr, wi, sr, si, quarter;
+  double  ar, ai, br, bi, cr, ci, dr, di;
+  quarter = twiddles[2*m*stride + 1];  /* imag. part of p-th root */
+  for (k=0; k<m; k++) {
+    /* apply twiddle factors */
+    for (q=0; q<p; q++) {
+      t = 2*q*k*stride;
+      wr = twiddles[t];     wi = twiddles[t + 1];
+      sr = out[2*(k + q*m)];     si = out[2*(k + q*m) + 1];
+      yr[q] = wr*sr - wi*si;     yi[q] = wr*si + wi*sr;
+    }
+    if (p==2) {
+      out[2*k]     = yr[0] + yr[1];
+      out[2*k + 1] = yi[0] + yi[1];
+      out[2*(k + m)]     = yr[0] - yr[1];
+      out[2*(k + m) + 1] = yi[0] - yi[1];
+    }
+    else if (p==4) {
+      ar = yr[0] + yr[2];     ai = yi[0] + yi[2];
+      br = yr[0] - yr[2];     bi = yi[0] - yi[2];
+      cr = yr[1] + yr[3];     ci = yi[1] + yi[3];
+      dr = -quarter*(yi[1] - yi[3]);
+      di =  quarter*(yr[1] - yr[3]);
+      out[2*k]             = ar + cr;
+      out[2*k + 1]         = ai + ci;
+      out[2*(k + m)]       = br + dr;
+      out[2*(k + m) + 1]   = bi + di;
+      out[2*(k + 2*m)]     = ar - cr;
+      out[2*(k + 2*m) + 1] = ai - ci;
+      out[2*(k + 3*m)]     = br - dr;
+      out[2*(k + 3*m) + 1] = bi - di;
+    }
+    else {   /* generic odd radix */
+      for (r=0; r<p; r++) {
+        sr = si = 0.0;
+        for (q=0; q<p; q++) {
+          t = 2*((q*r*m*stride)%nfft);
+          wr = twiddles[t];     wi = twiddles[t + 1];
+          sr += wr*yr[q] - wi*yi[q];
+          si += wr*yi[q] + wi*yr[q];
+        }
+        out[2*(k + r*m)] = sr;
+        out[2*(k + r*m) + 1] = si;
+      }
+    }
+  }
+}
+
+/* FFT of any size by Bluestein's method, which computes the    */
+/* transform as a convolution with a chirp.  The convolution is */
+/* done with power-of-two FFTs; the transform of the chirp is   */
+/* kept in the plan.  The array is dimensioned from 1 to        */
+/* 2*size, as in Fft.                                           */
+void BluesteinFft(float *array, int size, int sign, FftPlan *plan)
+{
+  int     k, m;
+  double  *a, *b, *chirp, cr, ci, re, im;
+  m = plan->conv->size;
+  a = plan->work;
+  b = (sign < 0) ? plan->ichirp_fft : plan->chirp_fft;
+  chirp = plan->chirp;
+  for (k=0; k<size; k++) {
+    cr = chirp[2*k];
+    ci = (sign < 0) ? -chirp[2*k + 1] : chirp[2*k + 1];
+    re = array[2*k + 1];    im = array[2*k + 2];
+    a[2*k]     = re*cr - im*ci;
+    a[2*k + 1] = im*cr + re*ci;
+  }
+  for (k=2*size; k<2*m; k++) a[k] = 0.0;
+  /* convolve a and b */
+  DoubleFft(a, m, 1, plan->conv);
+  for (k=0; k<m; k++) {
+    re = a[2*k]*b[2*k] - a[2*k + 1]*b[2*k + 1];
+    im = a[2*k]*b[2*k + 1] + a[2*k + 1]*b[2*k];
+    a[2*k] = re/m;    a[2*k + 1] = im/m;
+  }
+  DoubleFft(a, m, -1, plan->conv);
+  for (k=0; k<size; k++) {
+    cr = chirp[2*k];
+    ci = (sign < 0) ? -chirp[2*k + 1] : chirp[2*k + 1];
+    re = a[2*k];    im = a[2*k + 1];
+    array[2*k + 1] = re*cr - im*ci;
+    array[2*k + 2] = im*cr + re*ci;
+  }
+}
+
+/* Allocate the plan for 2-dim DCT's of xsize x ysize arrays and */
+/* for the Poisson solution by DCT's (DirectSolnByCosineTransform). */
+/* The plan can be reused for any number of transforms.  The row  */
+/* and column DCT's are split among num_threads threads.          */
+CosinePlan *AllocateCosinePlan(int xsize, int ysize, int num_threads)
+{
+  int         i, j, t;
+  CosinePlan  *plan;
+  if (num_threads < 1) num_threads = 1;
+  plan = (CosinePlan *) malloc(sizeof(CosinePlan));
+  if (plan) {
+    plan->row = (DctPlan **) malloc(num_threads*sizeof(DctPlan *));
+    plan->col = (DctPlan **) malloc(num_threads*sizeof(DctPlan *));
+    plan->buffer = (float **) malloc(num_threads*sizeof(float *));
+  }
+  if (!plan || !plan->row || !plan->col || !plan->buffer)
+    ErrorHandler("Cannot allocate memory", "cosine plan",
+                 MEMORY_ALLOCATION_ERROR);
+  plan->xsize = xsize;
+  plan->ysize = ysize;
+  plan->num_threads = num_threads;
+  plan->block = DctBlockSize(xsize, ysize);
+  plan->pool = (num_threads > 1) ? AllocateThreadPool(num_threads)
+                                 : NULL;
+  for (t=0; t<num_threads; t++) {
+    plan->row[t] = AllocateDctPlan(xsize);
+    plan->col[t] = (ysize==xsize) ? plan->row[t]
+                                  : AllocateDctPlan(ysize);
+    AllocateFloat(&plan->buffer[t],
+                  plan->block*((xsize > ysize) ? xsize : ysize),
+                  "cosine transf. buffer");
+  }
+  /* Poisson denominators 4 - 2cos(i*pi/(xsize-1)) - 2cos(j*pi/(ysize-1)) */
+  AllocateDouble(&plan->xdenom, xsize, "cosine terms");
+  AllocateDouble(&plan->ydenom, ysize, "cosine terms");
+  for (i=0; i<xsize; i++) {
+    plan->xdenom[i] = 4.0 - 2.0*cos(i*PI/(xsize - 1.0));
+  }
+  for (j=0; j<ysize; j++) {
+    plan->ydenom[j] = 2.0*cos(j*PI/(ysize - 1.0));
+  }
+  return plan;
+}
+
+/* Free the plan made by AllocateCosinePlan */
+void FreeCosinePlan(CosinePlan *plan)
+{
+  int  t;
+  if (!plan) return;
+  FreeThreadPool(plan->pool);
+  for (t=0; t<plan->num_threads; t++) {
+    if (plan->col[t] != plan->row[t]) FreeDctPlan(plan->col[t]);
+    FreeDctPlan(plan->row[t]);
+    free(plan->buffer[t]);
+  }
+  free(plan->row);
+  free(plan->col);
+  free(plan->buffer);
+  free(plan->xdenom);
+  free(plan->ydenom);
+  free(plan);
+}
+
+/* Allocate the plan for 1-dim DCT's of the given size.  The     */
+/* twiddle factors are generated by the same recurrences as the  */
+/* transforms themselves used, so the results are unchanged.     */
+DctPlan *AllocateDctPlan(int size)
+{
+  int      i, j, n;
+  double   angle, zr, zi, zpr, zpi, r;
+  DctPlan  *plan;
+  plan = (DctPlan *) malloc(sizeof(DctPlan));
+  if (!plan)
+    ErrorHandler("Cannot allocate memory", "DCT plan",
+                 MEMORY_ALLOCATION_ERROR);
+  plan->size = size;
+  plan->real_size = 0;
+  plan->dct_twiddles = plan->real_twiddles = NULL;
+  plan->ext = NULL;
+  plan->sums = NULL;
+  plan->fft = NULL;
+  if (size < 2) return plan;
+  n = size - 1;
+  if (n%2) {   /* even extension */
+    n *= 2;
+    AllocateFloat(&plan->ext, n, "DCT extension");
+  }
+  else {
+    AllocateDouble(&plan->dct_twiddles, 2*(n/2 + 1), "DCT twiddles");
+    AllocateDouble(&plan->sums, MAX_DCT_BLOCK, "DCT sums");
+    angle = PI/n;       r = sin(0.5*angle);
+    zpr = -2.0*r*r;     zpi = sin(angle);
+    zr = 1.0;           zi = 0.0;
+    for (j=2; j<=n/2; j++) {
+      r = zr;
+      zr =  r*zpr - zi*zpi + zr;
+      zi = zi*zpr +  r*zpi + zi;
+      plan->dct_twiddles[2*j] = zr;
+      plan->dct_twiddles[2*j + 1] = zi;
+    }
+  }
+  plan->real_size = n;
+  AllocateDouble(&plan->real_twiddles, 2*((n + 2)/4 + 1),
+                 "real FFT twiddles");
+  angle = PI/(n/2);
+  r = sin(0.5*angle);
+  zpr = -2.0*r*r;     zpi = sin(angle);
+  zr = 1.0 + zpr;     zi = zpi;
+  for (i=2; i<=(n + 2)/4; i++) {
+    plan->real_twiddles[2*i] = zr;
+    plan->real_twiddles[2*i + 1] = zi;
+    r = zr;
+    zr = r*zpr - zi*zpi + zr;
+    zi = zi*zpr + r*zpi + zi;
+  }
+  plan->fft = AllocateFftPlan(n/2);
+  return plan;
+}
+
+/* Free the plan made by AllocateDctPlan */
+void FreeDctPlan(DctPlan *plan)
+{
+  if (!plan) return;
+  if (plan->dct_twiddles) free(plan->dct_twiddles);
+  if (plan->real_twiddles) free(plan->real_twiddles);
+  if (plan->ext) free(plan->ext);
+  if (plan->sums) free(plan->sums);
+  FreeFftPlan(plan->fft);
+  free(plan);
+}
+
+/* Allocate the plan for complex FFT's of the given size: radix 2 */
+/* for powers of two, mixed radix for products of 2's, 3's, 5's   */
+/* and 7's, and Bluestein's method otherwise.                     */
+FftPlan *AllocateFftPlan(int size)
+{
+  FftPlan  *plan;
+  plan = (FftPlan *) malloc(sizeof(FftPlan));
+  if (!plan)
+    ErrorHandler("Cannot allocate memory", "FFT plan",
+                 MEMORY_ALLOCATION_ERROR);
+  plan->size = size;
+  plan->num_swaps = 0;
+  plan->swaps = NULL;
+  plan->twiddles = plan->itwiddles = NULL;
+  plan->chirp = plan->chirp_fft = plan->ichirp_fft = NULL;
+  plan->conv = NULL;
+  plan->work = NULL;
+  plan->batch = NULL;
+  if (!(size & (size - 1))) {
+    plan->kind = radix2_fft;
+    InitRadix2Plan(plan);
+  }
+  else if (FftFactors(size, plan->factors) >= 0) {
+    plan->kind = mixed_radix_fft;
+    InitMixedRadixPlan(plan);
+    AllocateFloat(&plan->batch, 2*size*MAX_DCT_BLOCK, "FFT work space");
+  }
+  else {
+    plan->kind = bluestein_fft;
+    InitBluesteinPlan(plan);
+  }
+  return plan;
+}
+
+/* Free the plan made by AllocateFftPlan */
+void FreeFftPlan(FftPlan *plan)
+{
+  if (!plan) return;
+  if (plan->swaps) free(plan->swaps);
+  if (plan->twiddles) free(plan->twiddles);
+  if (plan->itwiddles) free(plan->itwiddles);
+  if (plan->chirp) free(plan->chirp);
+  if (plan->chirp_fft) free(plan->chirp_fft);
+  if (plan->ichirp_fft) free(plan->ichirp_fft);
+  if (plan->work) free(plan->work);
+  if (plan->batch) free(plan->batch);
+  FreeFftPlan(plan->conv);
+  free(plan);
+}
+
+/* Bit-reversal swaps and stage twiddle factors (for sign = 1) */
+/* of the radix-2 FFT                                          */
+void InitRadix2Plan(FftPlan *plan)
+{
+  int     n, nmax, m, i, j, k;
+  double  r, zr, zpr, zpi, zi, angle;
+  n = 2*plan->size;
+  if (plan->size < 2) return;
+  AllocateInt(&plan->swaps, n, "FFT swaps");
+  j = 1;
   for (i=1; i<n; i+=2) {
     if (j > i) {
-      /* perform swaps */
-      tmp = array[j]; array[j] = array[i]; array[i] = tmp;
-      tmp = array[j+1]; array[j+1] = array[i+1]; array[i+1] = tmp;
+      plan->swaps[2*plan->num_swaps] = i;
+      plan->swaps[2*plan->num_swaps + 1] = j;
+      ++plan->num_swaps;
     }
     m = n/2;
     while (j > m && m > 1) {
@@ -185,28 +972,85 @@ void Fft(float *array, int size, int sign)
     }
     j += m;
   }
+  AllocateDouble(&plan->twiddles, 2*plan->size, "FFT twiddles");
+  k = 0;
   nmax = 2;
   while (n > nmax) {
-    istep = 2*nmax;
     angle = TWOPI/nmax;
-    if (sign < 0) angle = -angle;
     r = sin(0.5*angle);
     zpr = -2.0*r*r;    zpi = sin(angle);
     zr = 1.0;          zi = 0.0;
     for (m=1; m<nmax; m+=2) {
-      for (i=m; i<=n; i+=istep) {
-        j = i + nmax;
-        tmpr = zr*array[j] - zi*array[j+1];
-        tmpi = zr*array[j+1] + zi*array[j];
-        array[j]   = array[i]   - tmpr;
-        array[j+1] = array[i+1] - tmpi;
-        array[i]   += tmpr;
-        array[i+1] += tmpi;
-      }
+      plan->twiddles[k++] = zr;
+      plan->twiddles[k++] = zi;
       r = zr;
       zr = r*zpr - zi*zpi + zr;
       zi = zi*zpr + r*zpi + zi;
     }
-    nmax = istep;
+    nmax *= 2;
+  }
+}
+
+/* Twiddle factors and work space of the mixed-radix FFT */
+void InitMixedRadixPlan(FftPlan *plan)
+{
+  int     k, size;
+  double  angle;
+  size = plan->size;
+  AllocateDouble(&plan->twiddles, 2*size, "FFT twiddles");
+  AllocateDouble(&plan->itwiddles, 2*size, "FFT twiddles");
+  AllocateDouble(&plan->work, 4*size, "FFT work space");
+  for (k=0; k<size; k++) {
+    angle = TWOPI*k/size;
+    plan->twiddles[2*k] = plan->itwiddles[2*k] = cos(angle);
+    plan->twiddles[2*k + 1] = sin(angle);
+    plan->itwiddles[2*k + 1] = sin(-angle);
+  }
+}
+
+/* Chirp, transforms of the chirp and work space of Bluestein's */
+/* method.  The convolution uses a mixed-radix plan of size m,  */
+/* the smallest power of two not less than 2*size - 1.          */
+void InitBluesteinPlan(FftPlan *plan)
+{
+  int      k, m, size, s;
+  double   angle, *b;
+  FftPlan  *conv;
+  size = plan->size;
+  for (m=1; m < 2*size - 1; m*=2)
+    ;
+  conv = (FftPlan *) malloc(sizeof(FftPlan));
+  if (!conv)
+    ErrorHandler("Cannot allocate memory", "FFT plan",
+                 MEMORY_ALLOCATION_ERROR);
+  conv->size = m;
+  conv->kind = mixed_radix_fft;
+  conv->num_swaps = 0;
+  conv->swaps = NULL;
+  conv->chirp = conv->chirp_fft = conv->ichirp_fft = NULL;
+  conv->conv = NULL;
+  conv->batch = NULL;
+  FftFactors(m, conv->factors);
+  InitMixedRadixPlan(conv);
+  plan->conv = conv;
+  AllocateDouble(&plan->work, 2*m, "FFT work space");
+  /* chirp = exp(i*pi*k*k/size) (k*k reduced mod 2*size) */
+  AllocateDouble(&plan->chirp, 2*size, "FFT chirp");
+  for (k=0; k<size; k++) {
+    angle = PI*(double)(((long)k*k)%(2*size))/size;
+    plan->chirp[2*k] = cos(angle);
+    plan->chirp[2*k + 1] = sin(angle);
+  }
+  /* transforms of the conjugate chirp, for sign = 1 and -1 */
+  AllocateDouble(&plan->chirp_fft, 2*m, "FFT chirp");
+  AllocateDouble(&plan->ichirp_fft, 2*m, "FFT chirp");
+  for (s=1; s>=-1; s-=2) {
+    b = (s > 0) ? plan->chirp_fft : plan->ichirp_fft;
+    b[0] = plan->chirp[0];    b[1] = -s*plan->chirp[1];
+    for (k=1; k<size; k++) {
+      b[2*k] = b[2*(m - k)] = plan->chirp[2*k];
+      b[2*k + 1] = b[2*(m - k) + 1] = -s*plan->chirp[2*k + 1];
+    }
+    DoubleFft(b, m, 1, conv);
   }
 }
@@ -1,14 +1,103 @@
 #ifndef __DCT
 #define __DCT
 #include "pi.h"
-#define BLOCKSIZE     50
-#define MAX_NUM_ROWS  2050
+#include "pool.h"
+#include "simd.h"
+/* The rows and columns are transformed in blocks sized to the */
+/* L2 cache (DCT_CACHE_SIZE if its size cannot be found)        */
+#define DCT_CACHE_SIZE   (256*1024)
+#define MIN_DCT_BLOCK    8
+#define MAX_DCT_BLOCK    64
+#define TRANSPOSE_TILE   16
+#define MAX_FFT_FACTORS  32
+#define MAX_FFT_RADIX    7
+typedef enum {
+  radix2_fft, mixed_radix_fft, bluestein_fft
+} FftKind;
+/* tables and scratch memory for complex FFT's of one size */
+typedef struct FftPlanStruct {
+  int     size;          /* number of complex points */
+  FftKind kind;
+  int     num_swaps;     /* radix 2: bit-reversal swaps */
+  int     *swaps;
+  int     factors[MAX_FFT_FACTORS];  /* mixed radix */
+  double  *twiddles;     /* radix 2 (by stage) or mixed radix */
+  double  *itwiddles;    /* mixed radix, inverse transform */
+  double  *chirp;        /* Bluestein */
+  double  *chirp_fft;
+  double  *ichirp_fft;
+  struct FftPlanStruct *conv;   /* Bluestein convolution FFT's */
+  double  *work;
+  float   *batch;        /* mixed radix: scratch of MixedRadixFfts */
+} FftPlan;
+/* tables and scratch memory for 1-dim DCT's of one size */
+typedef struct {
+  int     size;          /* number of points */
+  int     real_size;     /* size of the real FFT */
+  double  *dct_twiddles;
+  double  *real_twiddles;
+  float   *ext;          /* even extension (if size-1 is odd) */
+  double  *sums;         /* FastDcts: one per transform */
+  FftPlan *fft;
+} DctPlan;
+/* tables and scratch memory for 2-dim DCT's of xsize x ysize */
+/* arrays, and for solving Poisson's equation by them.  Each  */
+/* thread has its own 1-dim plans and buffers.                */
+typedef struct {
+  int        xsize, ysize;
+  int        num_threads;
+  int        block;       /* rows or columns per block */
+  ThreadPool *pool;
+  DctPlan    **row, **col;
+  float      **buffer;
+  double     *xdenom, *ydenom;
+} CosinePlan;
+/* arguments of the row and column DCT tasks */
+typedef struct {
+  float      *array;
+  int        xsize, ysize, sign;
+  CosinePlan *plan;
+} DctTask;
 void FastCosineTransform(float *array, int xsize, int ysize,
-                         int sign);
-void RowDcts(float *array, int xsize, int ysize, int sign);
+                         int sign, CosinePlan *plan);
+void RowDcts(float *array, int xsize, int ysize, int sign,
+             CosinePlan *plan);
 void ColDcts(float *array, int xsize, int ysize, int sign,
-             float *vector, float *buffer);
-void FastDct(float *array, int size, int sign);
-void RealFft(float *array, int size, int sign);
-void Fft(float *array, int size, int sign);
+             CosinePlan *plan);
+void RowDctTask(void *arg, int task, int worker);
+void ColDctTask(void *arg, int task, int worker);
+void Transpose(float *in, int istride, float *out, int ostride,
+               int rows, int cols);
+int DctBlockSize(int xsize, int ysize);
+void FastDct(float *array, int size, int sign, DctPlan *plan);
+void DctByExtension(float *array, int size, int sign,
+                    DctPlan *plan);
+void RealFft(float *array, int size, int sign, DctPlan *plan);
+void Fft(float *array, int size, int sign, FftPlan *plan);
+void FastDcts(float *array, int size, int nb, int sign,
+              DctPlan *plan);
+void RealFfts(float *array, int size, int nb, int sign,
+              DctPlan *plan);
+void Ffts(float *array, int size, int nb, int sign, FftPlan *plan);
+void MixedRadixFfts(float *array, int size, int nb, int sign,
+                    FftPlan *plan);
+int BatchedDct(DctPlan *plan);
+void MixedRadixFft(float *array, int size, int sign, FftPlan *plan);
+int FftFactors(int size, int *factors);
+int DctSize(int size);
+void DoubleFft(double *data, int size, int sign, FftPlan *plan);
+void MixedRadixPass(double *out, double *in, int len, int stride,
+                    int *factors, double *twiddles, int nfft);
+void Butterflies(double *out, int m, int p, int stride,
+                 double *twiddles, int nfft);
+void BluesteinFft(float *array, int size, int sign, FftPlan *plan);
+CosinePlan *AllocateCosinePlan(int xsize, int ysize, int num_threads);
+void FreeCosinePlan(CosinePlan *plan);
+DctPlan *AllocateDctPlan(int size);
+void FreeDctPlan(DctPlan *plan);
+FftPlan *AllocateFftPlan(int size);
+void FreeFftPlan(FftPlan *plan);
+void InitRadix2Plan(FftPlan *plan);
+void InitMixedRadixPlan(FftPlan *plan);
+void InitBluesteinPlan(FftPlan *plan);
 #endif
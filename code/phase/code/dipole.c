@@ -11,12 +11,14 @@
 /* the bitflags array, remove them, and place branch cut.      */
 /* The bits for the positive and negative residues are defined */
 /* by POS_RES and NEG_RES (defined in brcut.h), while the      */
-/* branch cut bits are defined by "branchcut_code".            */
+/* branch cuts are drawn in the cut plane.                     */
 void Dipole(unsigned char *bitflags, int xsize, int ysize,
-            int branchcut_code)
+            CutPlane *plane)
 {
-  int  i, j, k, kk;
+  int       i, j, k, kk;
+  CutBatch  *cuts;
   printf("Dipoles...\n");
+  cuts = AllocateCutBatch();
   for (j=0; j<ysize; j++) {
     for (i=0; i<xsize; i++) {
       k = j*xsize + i;
@@ -36,11 +38,12 @@ void Dipole(unsigned char *bitflags, int xsize, int ysize,
       if (kk) {
         printf("Connecting dipoles %d,%d - %d,%d\n", i, j, kk%xsize,
                kk/xsize);
-        PlaceCut(bitflags, i, j, kk%xsize, kk/xsize,
-                 xsize, ysize, branchcut_code);
+        AddCut(cuts, i, j, kk%xsize, kk/xsize);
         bitflags[k] &= (~(RESIDUE)); 
         bitflags[kk] &= (~(RESIDUE)); 
       }
     }
   }
+  PlaceCuts(cuts, plane);
+  FreeCutBatch(cuts);
 }
@@ -1,5 +1,6 @@
 #ifndef __DIPOLE
 #define __DIPOLE
+#include "brcut.h"
 void Dipole(unsigned char *bitflags, int xsize, int ysize,
-            int cut_code);
+            CutPlane *plane);
 #endif
@@ -2,7 +2,10 @@
  *  flynn.c -- functions for Flynn's min. discontinuity algorithm
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
+#include <time.h>
+#include "util.h"
 #include "flynn.h"
 #include "trees.h"
 /* define large value-increase */
@@ -11,16 +14,17 @@
 /* Main iteration (and initialization steps) for Flynn's minimum
  * discontinuity phase-unwrapping algorithm.  The quality values
  * (weights) are stored in the qual_map array.  This array and the
- * phase array are xsize x ysize pixels in size.  The bitflags array,
- * which stores the change and direction info, and the other arrays
- * (value, vjump and hjump) are working arrays for managing the data.
- * The dimensions of these arrays are (xsize + 1) x (ysize + 1).
+ * phase array are xsize x ysize pixels in size.  The nodes array,
+ * which stores the change and direction info, the values and the
+ * jump counts of each node, is the working array for managing the
+ * data (see AllocateFlynnNodes).  Its dimensions are (xsize + 1) x
+ * (ysize + 1).
  * If there are masked (border) pixels, they should be coded as
- * zero weights in qual_map.
+ * zero weights in qual_map.  If progress is nonzero, the progress
+ * of each iteration is printed.
  */
-void FlynnMinDisc(float *phase, int *value, unsigned char *bitflags,
-                  float *qual_map, short *vjump, short *hjump,
-                  int xsize, int ysize)
+void FlynnMinDisc(float *phase, FlynnNode *nodes, float *qual_map,
+                  int xsize, int ysize, int progress)
 {
   double          eps = 1.0e-06, phd;
   short           jmpold;
@@ -30,6 +34,11 @@ void FlynnMinDisc(float *phase, int *value, unsigned char *bitflags,
   int             val, value_incr;
   int             loop_found;
   int             value_change;
+  int             *stack;
+  int             k, n, r, w = xsize + 1, iter;
+  DirtyWord       word;
+  DirtyMap        *dirty;
+  clock_t         start_time;
 
   /* Compute phase jump counts.
    * If dx(i,j) and dy(i,j) represent the wrapped derivatives
@@ -40,67 +49,80 @@ void FlynnMinDisc(float *phase, int *value, unsigned char *bitflags,
   for (j=1; j <= ysize-1; j++) {
     for (i=1; i <= xsize; i++) {
       phd = phase[j*xsize + i-1] - phase[(j-1)*xsize + i-1] + eps;
-      hjump[j*(xsize+1) + i] = (short) nint(phd);
+      nodes[j*(xsize+1) + i].hjump = (short) nint(phd);
     }
   }
   for (j=1; j <= ysize; j++) {
     for (i=1; i <= xsize-1; i++) {
       phd = phase[(j-1)*xsize + i] - phase[(j-1)*xsize + i-1] + eps;
-      vjump[j*(xsize+1) + i] = (short) nint(phd);
+      nodes[j*(xsize+1) + i].vjump = (short) nint(phd);
     }
   }
-  /* Make add nodes bitflags initially */
+  /* stack for the tree walks, and map of the nodes to test */
+  start_time = clock();
+  AllocateInt(&stack, TreeStackSize(xsize, ysize), "tree stack");
+  dirty = AllocateDirtyMap((xsize + 1)*(ysize + 1));
+  /* Make add nodes testable initially */
   for (j=0; j <= ysize; j++) {
     for (i=0; i <= xsize; i++) {
-      bitflags[j*(xsize+1) + i] |= THIS_TIME;
+      nodes[j*(xsize+1) + i].flags |= THIS_TIME;
+      MarkDirty(dirty, j*(xsize+1) + i);
     }
   }
   /* Main iteration */
+  iter = 0;
   do {
+    ++iter;
     new_loops = 0;
     new_edges = 0;
     /* Add left-to-right edges to tree */
     for (j=0; j <= ysize-1; j++) {
       for (i=0; i <= xsize; i++) {
+        k = j*w + i;
+        if ((i==0 || !(k & DIRTY_MASK))
+              && (n = CleanAhead(dirty, k, j*w + xsize, w)) > 0) {
+          i += n - 1;
+          continue;
+        }
         jnext = j+1;
         inext = i;
-        if ((bitflags[j*(xsize+1) + i] & THIS_TIME)
-              || (bitflags[jnext*(xsize+1) + inext] & THIS_TIME)) {
+        if ((nodes[j*(xsize+1) + i].flags & THIS_TIME)
+              || (nodes[jnext*(xsize+1) + inext].flags & THIS_TIME)) {
           if (jnext <= 1 || jnext >= ysize 
                || inext <= 0 || inext >= xsize) {
-            value_incr = -isign(1, -vjump[jnext*(xsize+1) + inext]);
+            value_incr = -isign(1, -nodes[jnext*(xsize+1) + inext].vjump);
           }
           else {
             /* quality map values must be between 0 and 1 */
             val = (int)(1.0 + BIG*qual_map[jnext*xsize + inext]);
             value_incr  
-               = -isign(val, -vjump[jnext*(xsize+1) + inext]);
+               = -isign(val, -nodes[jnext*(xsize+1) + inext].vjump);
           }
-          value_change = value[j*(xsize+1) + i] + (int)value_incr
-                                   - value[jnext*(xsize+1) + inext];
+          value_change = nodes[j*(xsize+1) + i].value + (int)value_incr
+                                   - nodes[jnext*(xsize+1) + inext].value;
           if (value_change > 0) {
             new_edges++;
             /* revise values in subtree of [jnext][inext] */
             /* and check for loop */
             ilast = i;  jlast = j;  loop_found = 0;
             ChangeExten(inext, jnext, ilast, jlast, &loop_found,
-                        value_change, value, bitflags, xsize, ysize);
+                        value_change, nodes, stack, dirty, xsize);
             if (loop_found) {
-              RemoveLoop(inext, jnext, i, j, value, bitflags,
-                         vjump, hjump, xsize, ysize);
-              ChangeOrphan(inext, jnext, -value_change, value,
-                           bitflags, xsize, ysize);
+              RemoveLoop(inext, jnext, i, j, nodes, stack, dirty,
+                         xsize, ysize);
+              ChangeOrphan(inext, jnext, -value_change, nodes,
+                           stack, dirty, xsize, ysize);
               new_loops++;
             }
             else {
               /* add edge and remove edges to [jnext][inext] */
-              bitflags[j*(xsize+1) + i] |= RIGHT;
+              nodes[j*(xsize+1) + i].flags |= RIGHT;
               if (jnext<ysize) 
-                bitflags[(jnext+1)*(xsize+1) + inext] &= ~LEFT;
+                nodes[(jnext+1)*(xsize+1) + inext].flags &= ~LEFT;
               if (inext<xsize) 
-                bitflags[jnext*(xsize+1) + inext+1] &= ~UP;
+                nodes[jnext*(xsize+1) + inext+1].flags &= ~UP;
               if (inext > 0)
-                bitflags[jnext*(xsize+1) + inext-1] &= ~DOWN;
+                nodes[jnext*(xsize+1) + inext-1].flags &= ~DOWN;
             }
           }
         }
@@ -109,42 +131,48 @@ void FlynnMinDisc(float *phase, int *value, unsigned char *bitflags,
     /* Add top-to-bottom edges to tree */
     for (j=0; j <= ysize; j++) {
       for (i=0; i <= xsize-1; i++) {
+        k = j*w + i;
+        if ((i==0 || !(k & DIRTY_MASK))
+              && (n = CleanAhead(dirty, k, j*w + xsize-1, 1)) > 0) {
+          i += n - 1;
+          continue;
+        }
         jnext = j;
         inext = i+1;
-        if ((bitflags[j*(xsize+1) + i] & THIS_TIME)
-             || (bitflags[jnext*(xsize+1) + inext] & THIS_TIME)){
+        if ((nodes[j*(xsize+1) + i].flags & THIS_TIME)
+             || (nodes[jnext*(xsize+1) + inext].flags & THIS_TIME)){
           if (jnext <= 0 || jnext >= ysize 
                || inext <= 1 || inext >= xsize) {
-            value_incr = -isign(1, hjump[jnext*(xsize+1) + inext]);
+            value_incr = -isign(1, nodes[jnext*(xsize+1) + inext].hjump);
           }
           else {
             /* quality map values must be between 0 and 1 */
             val = (int)(1.0 + BIG*qual_map[jnext*xsize + inext]);
             value_incr 
-                = -isign(val, hjump[jnext*(xsize+1) + inext]);
+                = -isign(val, nodes[jnext*(xsize+1) + inext].hjump);
           }
-          value_change = value[j*(xsize+1) + i] + (int)value_incr
-                                 - value[jnext*(xsize+1) + inext];
+          value_change = nodes[j*(xsize+1) + i].value + (int)value_incr
+                                 - nodes[jnext*(xsize+1) + inext].value;
           if (value_change > 0) {
             new_edges++;
             ilast = i; jlast = j; loop_found = 0;
             ChangeExten(inext, jnext, ilast, jlast, &loop_found,
-                        value_change, value, bitflags, xsize, ysize);
+                        value_change, nodes, stack, dirty, xsize);
             if (loop_found){
-              RemoveLoop(inext, jnext, i, j, value, bitflags,
-                         vjump, hjump, xsize, ysize);
-              ChangeOrphan(inext, jnext, -value_change, value,
-                           bitflags, xsize, ysize);
+              RemoveLoop(inext, jnext, i, j, nodes, stack, dirty,
+                         xsize, ysize);
+              ChangeOrphan(inext, jnext, -value_change, nodes,
+                           stack, dirty, xsize, ysize);
               new_loops++;
             }
             else {
-              bitflags[j*(xsize+1) + i] |= DOWN;
+              nodes[j*(xsize+1) + i].flags |= DOWN;
               if (jnext<ysize) 
-                bitflags[(jnext+1)*(xsize+1) + inext] &= ~LEFT;
+                nodes[(jnext+1)*(xsize+1) + inext].flags &= ~LEFT;
               if (jnext > 0) 
-                bitflags[(jnext-1)*(xsize+1) + inext] &= ~RIGHT;
+                nodes[(jnext-1)*(xsize+1) + inext].flags &= ~RIGHT;
               if (inext<xsize) 
-                bitflags[jnext*(xsize+1) + inext+1] &= ~UP;
+                nodes[jnext*(xsize+1) + inext+1].flags &= ~UP;
             }
           }
         }
@@ -153,40 +181,46 @@ void FlynnMinDisc(float *phase, int *value, unsigned char *bitflags,
     /* Add right-to-left edges to tree */
     for (j=ysize; j >=1 ; j--) {
       for (i=xsize; i >=0; i--) {
+        k = j*w + i;
+        if ((i==xsize || (k & DIRTY_MASK)==DIRTY_MASK)
+              && (n = CleanBehind(dirty, k, j*w, -w)) > 0) {
+          i -= n - 1;
+          continue;
+        }
         jnext = j-1;
         inext = i;
-        if ((bitflags[j*(xsize+1) + i] & THIS_TIME)
-               || (bitflags[jnext*(xsize+1) + inext] & THIS_TIME)){
+        if ((nodes[j*(xsize+1) + i].flags & THIS_TIME)
+               || (nodes[jnext*(xsize+1) + inext].flags & THIS_TIME)){
           if (j <= 1 || j >= ysize || i <= 0 || i >= xsize) {
-            value_incr = -isign(1, vjump[j*(xsize+1) + i]);
+            value_incr = -isign(1, nodes[j*(xsize+1) + i].vjump);
           }
           else {
             /* quality map values must be between 0 and 1 */
             val = (int)(1.0 + BIG*qual_map[j*xsize + i]);
-            value_incr = -isign(val, vjump[j*(xsize+1) + i]);
+            value_incr = -isign(val, nodes[j*(xsize+1) + i].vjump);
           }
-          value_change = value[j*(xsize+1) + i] + (int)value_incr
-                                 - value[jnext*(xsize+1) + inext];
+          value_change = nodes[j*(xsize+1) + i].value + (int)value_incr
+                                 - nodes[jnext*(xsize+1) + inext].value;
           if (value_change > 0) {
             new_edges++;
             ilast = i; jlast = j; loop_found = 0;
             ChangeExten(inext, jnext, ilast, jlast, &loop_found,
-                        value_change, value, bitflags, xsize, ysize);
+                        value_change, nodes, stack, dirty, xsize);
             if (loop_found){
-              RemoveLoop(inext, jnext, i, j, value, bitflags, 
-                         vjump, hjump, xsize, ysize);
-              ChangeOrphan(inext, jnext, -value_change, value,
-                           bitflags, xsize, ysize);
+              RemoveLoop(inext, jnext, i, j, nodes, stack, dirty,
+                         xsize, ysize);
+              ChangeOrphan(inext, jnext, -value_change, nodes,
+                           stack, dirty, xsize, ysize);
               new_loops++;
             }
             else {
-              bitflags[j*(xsize+1) + i] |= LEFT;
+              nodes[j*(xsize+1) + i].flags |= LEFT;
               if (jnext > 0)
-                bitflags[(jnext-1)*(xsize+1) + inext] &= ~RIGHT;
+                nodes[(jnext-1)*(xsize+1) + inext].flags &= ~RIGHT;
               if (inext < xsize)
-                bitflags[jnext*(xsize+1) + inext+1] &= ~UP;
+                nodes[jnext*(xsize+1) + inext+1].flags &= ~UP;
               if (inext > 0) 
-                bitflags[jnext*(xsize+1) + inext-1] &= ~DOWN;
+                nodes[jnext*(xsize+1) + inext-1].flags &= ~DOWN;
             }
           }
         }
@@ -195,67 +229,88 @@ void FlynnMinDisc(float *phase, int *value, unsigned char *bitflags,
     /* Add bottom-to-top edges to tree */
     for (j=ysize; j >=0; j--) {
       for (i=xsize; i >= 1; i--) {
+        k = j*w + i;
+        if ((i==xsize || (k & DIRTY_MASK)==DIRTY_MASK)
+              && (n = CleanBehind(dirty, k, j*w + 1, -1)) > 0) {
+          i -= n - 1;
+          continue;
+        }
         jnext = j;
         inext = i-1;
-        if ((bitflags[j*(xsize+1) + i] & THIS_TIME)
-               || (bitflags[jnext*(xsize+1) + inext] & THIS_TIME)){
+        if ((nodes[j*(xsize+1) + i].flags & THIS_TIME)
+               || (nodes[jnext*(xsize+1) + inext].flags & THIS_TIME)){
           if (j <= 0 || j >= ysize || i <= 1 || i >= xsize) {
-            value_incr = -isign(1, -hjump[j*(xsize+1) + i]);
+            value_incr = -isign(1, -nodes[j*(xsize+1) + i].hjump);
           }
           else {
             /* quality map values must be between 0 and 1 */
             val = (int)(1.0 + BIG*qual_map[j*xsize + i]);
-            value_incr = -isign(val, -hjump[j*(xsize+1) + i]);
+            value_incr = -isign(val, -nodes[j*(xsize+1) + i].hjump);
           }
-          value_change = value[j*(xsize+1) + i] + (int)value_incr
-                                 - value[jnext*(xsize+1) + inext];
+          value_change = nodes[j*(xsize+1) + i].value + (int)value_incr
+                                 - nodes[jnext*(xsize+1) + inext].value;
           if (value_change > 0) {
             new_edges++;
             ilast = i; jlast = j; loop_found = 0;
             ChangeExten(inext, jnext, ilast, jlast, &loop_found,
-                        value_change, value, bitflags, xsize, ysize);
+                        value_change, nodes, stack, dirty, xsize);
             if (loop_found){
-              RemoveLoop(inext, jnext, i, j, value, bitflags,
-                         vjump, hjump, xsize, ysize);
-              ChangeOrphan(inext, jnext, -value_change, value,
-                           bitflags, xsize, ysize);
+              RemoveLoop(inext, jnext, i, j, nodes, stack, dirty,
+                         xsize, ysize);
+              ChangeOrphan(inext, jnext, -value_change, nodes,
+                           stack, dirty, xsize, ysize);
               new_loops++;
             }
             else {
-              bitflags[j*(xsize+1) + i] |= UP;
+              nodes[j*(xsize+1) + i].flags |= UP;
               if (jnext < ysize) 
-                bitflags[(jnext+1)*(xsize+1) + inext] &= ~LEFT;
+                nodes[(jnext+1)*(xsize+1) + inext].flags &= ~LEFT;
               if (jnext > 0) 
-                bitflags[(jnext-1)*(xsize+1) + inext] &= ~RIGHT;
+                nodes[(jnext-1)*(xsize+1) + inext].flags &= ~RIGHT;
               if (inext > 0) 
-                bitflags[jnext*(xsize+1) + inext-1] &= ~DOWN;
+                nodes[jnext*(xsize+1) + inext-1].flags &= ~DOWN;
             }
           }
         }
       }
     }
-    printf("New edges: %d  New loops: %d\n",new_edges,new_loops);
-    /* Update testability matrix */
-    for (j=0; j <= ysize; j++) {
-      for (i=0; i <= xsize; i++) {
-        if (bitflags[j*(xsize+1) + i] & NEXT_TIME) {
-          bitflags[j*(xsize+1) + i] |= THIS_TIME;
-        }
-        else {
-          bitflags[j*(xsize+1) + i] &= ~NEXT_TIME;
-          bitflags[j*(xsize+1) + i] &= ~THIS_TIME;
+    if (progress)
+      printf("New edges: %d  New loops: %d\n",new_edges,new_loops);
+    /* Update testability matrix: the nodes changed in this  */
+    /* iteration are tested in the next one.  Flagged nodes   */
+    /* can only be in dirty runs.                             */
+    for (n=0; n < dirty->num_words; n++) {
+      word = dirty->bits[n];
+      dirty->bits[n] = 0;
+      for (r=n*DIRTY_WORD_BITS; word; r++, word >>= 1) {
+        if (!(word & 1)) continue;
+        for (k=r << DIRTY_SHIFT; k < (r + 1) << DIRTY_SHIFT
+                                     && k < w*(ysize + 1); k++) {
+          if (nodes[k].flags & NEXT_TIME) {
+            nodes[k].flags |= THIS_TIME;
+            nodes[k].flags &= ~NEXT_TIME;
+            MarkDirty(dirty, k);
+          }
+          else {
+            nodes[k].flags &= ~THIS_TIME;
+          }
         }
       }
     }
   } while (new_edges > 0);
+  if (progress)
+    printf("%d iterations in %.2f seconds\n", iter,
+           (double)(clock() - start_time)/CLOCKS_PER_SEC);
+  FreeDirtyMap(dirty);
+  free(stack);
 
   /* Compute new unwrapped phase and exit */
-  printf("Computing revised unwrapped phase...\n");
+  if (progress) printf("Computing revised unwrapped phase...\n");
   for (i = 0; i < xsize - 1; i++) {
     phd = phase[0*xsize + (i + 1)] - phase[0*xsize + i] + eps;
     jmpold = (short) nint(phd);
     phase[0*xsize + (i + 1)] 
-        += (float)(vjump[1*(xsize + 1) + (i + 1)] - jmpold);
+        += (float)(nodes[1*(xsize + 1) + (i + 1)].vjump - jmpold);
   }
   for (j = 0; j < ysize - 1; j++) {
     for (i = 0; i < xsize; i++) {
@@ -263,7 +318,24 @@ void FlynnMinDisc(float *phase, int *value, unsigned char *bitflags,
                     - phase[j*xsize + i] + eps;
       jmpold = (short) nint(phd);
       phase[(j + 1)*xsize + i] 
-        += (float)(hjump[(j + 1)*(xsize + 1) + (i + 1)] - jmpold);
+        += (float)(nodes[(j + 1)*(xsize + 1) + (i + 1)].hjump - jmpold);
+    }
+  }
+}
+
+/* Number of discontinuities (differences of more than half a   */
+/* cycle between neighboring pixels) of the unwrapped phase soln */
+/* (in cycles)                                                   */
+int Discontinuities(float *soln, int xsize, int ysize)
+{
+  int  i, j, k, num;
+  for (j=0, num=0; j<ysize; j++) {
+    for (i=0; i<xsize; i++) {
+      k = j*xsize + i;
+      if (i < xsize - 1 && fabs(soln[k + 1] - soln[k]) > 0.5) ++num;
+      if (j < ysize - 1 && fabs(soln[k + xsize] - soln[k]) > 0.5)
+        ++num;
     }
   }
+  return num;
 }
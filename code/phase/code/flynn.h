@@ -1,8 +1,9 @@
 #ifndef __FLYNN
 #define __FLYNN
+#include "trees.h"
 #define isign(A,B) ((B) >= 0 ? (A) : (-(A)))
 #define nint(A) ((A)>0. ? (int)((A)+0.5) : (int)((A)-0.5))
-void FlynnMinDisc(float *phase, int *value, unsigned char *bitflags,
-                  float *qual_map, short *vjump, short *hjump,
-                  int xsize, int ysize);
+void FlynnMinDisc(float *phase, FlynnNode *nodes, float *qual_map,
+                  int xsize, int ysize, int progress);
+int Discontinuities(float *soln, int xsize, int ysize);
 #endif
@@ -0,0 +1,173 @@
+/*
+ *  flyntile.c -- functions for running Flynn's minimum discontinuity
+ *                algorithm on overlapping tiles in parallel, and
+ *                for merging the tiles along their seams
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <malloc.h>
+#include "file.h"
+#include "util.h"
+#include "grad.h"
+#include "flynn.h"
+#include "flyntile.h"
+
+/* Replace the phase (in cycles) by an unwrapped solution built   */
+/* from tiles of tile_size x tile_size pixels that overlap their  */
+/* neighbors by "overlap" pixels on each side.  Each tile is      */
+/* unwrapped by Flynn's algorithm on the threads of the pool, and */
+/* the tiles are then shifted by integer numbers of cycles so     */
+/* that they agree across the seams between their cores, merging  */
+/* along the seams of highest quality first.  The result is       */
+/* congruent to the phase, and is meant as the starting point of  */
+/* Flynn's algorithm on the whole image, which then only has to   */
+/* remove the discontinuities along the seams.                    */
+void TiledFlynnGuess(float *phase, float *qual_map, int xsize,
+                     int ysize, int tile_size, int overlap,
+                     ThreadPool *pool)
+{
+  int            i, j, t, x, y, nx, ny, num_tiles;
+  int            oa, *parent, *offset;
+  FlynnTile      *tiles, *tile;
+  FlynnTileTask  task;
+  SeamGraph      *graph;
+  if (tile_size < 1) tile_size = (xsize > ysize) ? xsize : ysize;
+  if (overlap < 1) overlap = 1;
+  nx = (xsize + tile_size - 1)/tile_size;
+  ny = (ysize + tile_size - 1)/tile_size;
+  num_tiles = nx*ny;
+  tiles = (FlynnTile *) malloc(num_tiles*sizeof(FlynnTile));
+  if (!tiles)
+    ErrorHandler("Cannot allocate memory", "tiles",
+                 MEMORY_ALLOCATION_ERROR);
+  for (j=0; j<ny; j++) {
+    for (i=0; i<nx; i++) {
+      tile = &tiles[j*nx + i];
+      tile->cx0 = i*tile_size;
+      tile->cy0 = j*tile_size;
+      tile->cx1 = (i < nx - 1) ? tile->cx0 + tile_size : xsize;
+      tile->cy1 = (j < ny - 1) ? tile->cy0 + tile_size : ysize;
+      tile->x0 = (tile->cx0 > overlap) ? tile->cx0 - overlap : 0;
+      tile->y0 = (tile->cy0 > overlap) ? tile->cy0 - overlap : 0;
+      tile->w = ((tile->cx1 + overlap < xsize) ? tile->cx1 + overlap
+                                               : xsize) - tile->x0;
+      tile->h = ((tile->cy1 + overlap < ysize) ? tile->cy1 + overlap
+                                               : ysize) - tile->y0;
+    }
+  }
+
+  /* unwrap the tiles */
+  printf("Unwrapping %d tiles of %dx%d pixels on %d threads\n",
+         num_tiles, tile_size, tile_size, PoolThreads(pool));
+  task.phase = phase;
+  task.qual_map = qual_map;
+  task.xsize = xsize;
+  task.ysize = ysize;
+  task.tiles = tiles;
+  RunThreadPool(pool, UnwrapFlynnTile, &task, num_tiles);
+
+  /* find the offsets across the seams and merge the tiles */
+  graph = AllocateSeamGraph();
+  for (j=0; j<ny; j++) {
+    for (i=0; i<nx; i++) {
+      t = j*nx + i;
+      if (i < nx - 1)
+        FlynnSeamVotes(&tiles[t], &tiles[t + 1], t, t + 1, phase,
+                       qual_map, xsize, graph);
+      if (j < ny - 1)
+        FlynnSeamVotes(&tiles[t], &tiles[t + nx], t, t + nx, phase,
+                       qual_map, xsize, graph);
+    }
+  }
+  AllocateInt(&parent, num_tiles, "seam graph");
+  AllocateInt(&offset, num_tiles, "seam graph");
+  MergeSeams(graph->edges, graph->num_edges, parent, offset,
+             num_tiles);
+
+  /* copy the cores of the tiles, shifted, to the phase array */
+  for (y=0; y<ysize; y++) {
+    for (x=0; x<xsize; x++) {
+      t = (y/tile_size)*nx + x/tile_size;
+      tile = &tiles[t];
+      FindPiece(parent, offset, t, &oa);
+      phase[y*xsize + x]
+            = tile->soln[(y - tile->y0)*tile->w + x - tile->x0] + oa;
+    }
+  }
+  for (t=0; t<num_tiles; t++) free(tiles[t].soln);
+  free(parent);
+  free(offset);
+  FreeSeamGraph(graph);
+  free(tiles);
+}
+
+/* Unwrap tile number "task" by Flynn's algorithm on its own */
+/* copies of the arrays                                      */
+void UnwrapFlynnTile(void *arg, int task, int worker)
+{
+  int            x, y, n;
+  float          *qual_map;
+  FlynnNode      *nodes;
+  FlynnTileTask  *ft = (FlynnTileTask *) arg;
+  FlynnTile      *tile = &ft->tiles[task];
+  (void)worker;   /* the tile owns its arrays */
+  n = tile->w*tile->h;
+  AllocateFloat(&tile->soln, n, "tile unwrapped data");
+  AllocateFloat(&qual_map, n, "tile quality map");
+  nodes = AllocateFlynnNodes(tile->w, tile->h);
+  for (y=0; y<tile->h; y++) {
+    for (x=0; x<tile->w; x++) {
+      tile->soln[y*tile->w + x]
+         = ft->phase[(tile->y0 + y)*ft->xsize + tile->x0 + x];
+      qual_map[y*tile->w + x]
+         = ft->qual_map[(tile->y0 + y)*ft->xsize + tile->x0 + x];
+    }
+  }
+  FlynnMinDisc(tile->soln, nodes, qual_map, tile->w, tile->h, 0);
+  free(qual_map);
+  free(nodes);
+}
+
+/* Add the seam graph edge between the neighboring tiles ta and */
+/* tb (nodes na and nb, ta left of or above tb) to the graph.   */
+/* Each pair of pixels that face each other across the edge of  */
+/* the cores votes, with the lower of their qualities, for the  */
+/* offset that makes the unwrapped values of tb continue those  */
+/* of ta.  Returns the number of edges added.                   */
+int FlynnSeamVotes(FlynnTile *ta, FlynnTile *tb, int na, int nb,
+                   float *phase, float *qual_map, int xsize,
+                   SeamGraph *graph)
+{
+  int     x, y, x0, x1, y0, y1, dx, dy, i, j, d;
+  double  w;
+  StartSeam(graph);
+  if (tb->cx0==ta->cx1) {   /* side by side */
+    x0 = x1 = ta->cx1 - 1;
+    y0 = (ta->cy0 > tb->cy0) ? ta->cy0 : tb->cy0;
+    y1 = ((ta->cy1 < tb->cy1) ? ta->cy1 : tb->cy1) - 1;
+    dx = 1;
+    dy = 0;
+  }
+  else {                    /* one above the other */
+    y0 = y1 = ta->cy1 - 1;
+    x0 = (ta->cx0 > tb->cx0) ? ta->cx0 : tb->cx0;
+    x1 = ((ta->cx1 < tb->cx1) ? ta->cx1 : tb->cx1) - 1;
+    dx = 0;
+    dy = 1;
+  }
+  for (y=y0; y<=y1; y++) {
+    for (x=x0; x<=x1; x++) {
+      i = y*xsize + x;
+      j = (y + dy)*xsize + x + dx;
+      d = floor(ta->soln[(y - ta->y0)*ta->w + x - ta->x0]
+                  + Gradient(phase[j], phase[i])
+                  - tb->soln[(y + dy - tb->y0)*tb->w + x + dx - tb->x0]
+                  + 0.5);
+      w = ((qual_map[i] < qual_map[j]) ? qual_map[i] : qual_map[j])
+            + 1.0E-6;
+      AddSeamVote(graph, na, nb, d, w);
+    }
+  }
+  return BestSeams(graph);
+}
@@ -0,0 +1,28 @@
+#ifndef __FLYNTILE
+#define __FLYNTILE
+#include "pool.h"
+#include "seams.h"
+/* default overlap of neighboring tiles (pixels on each side) */
+#define FLYNN_OVERLAP  32
+/* One tile of a tiled run of Flynn's algorithm.  The cores of   */
+/* the tiles partition the image, and each tile is unwrapped on  */
+/* its core widened by the overlap on each side (its extent).    */
+typedef struct {
+  int    x0, y0, w, h;           /* extent */
+  int    cx0, cy0, cx1, cy1;     /* core: [cx0,cx1) x [cy0,cy1) */
+  float  *soln;
+} FlynnTile;
+/* arguments of the tile unwrapping tasks */
+typedef struct {
+  float      *phase, *qual_map;
+  int        xsize, ysize;
+  FlynnTile  *tiles;
+} FlynnTileTask;
+void TiledFlynnGuess(float *phase, float *qual_map, int xsize,
+                     int ysize, int tile_size, int overlap,
+                     ThreadPool *pool);
+void UnwrapFlynnTile(void *arg, int task, int worker);
+int FlynnSeamVotes(FlynnTile *ta, FlynnTile *tb, int na, int nb,
+                   float *phase, float *qual_map, int xsize,
+                   SeamGraph *graph);
+#endif
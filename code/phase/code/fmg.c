@@ -3,27 +3,67 @@
  *           least-squares phase-unwrapping problem
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "fmg.h"
 #include "grid.h"
+#include "relax.h"
 #include "dxdygrad.h"
+#include "util.h"
 
 /*  Call the functions for performing the multigrid phase-  */
 /*  unwrapping algorithm.  If dywts is a null pointer, then */
-/*  dxwts are copied into an array for dywts.               */
-void MultigridUnwrap(float *soln, float *dx, float *dy, float *dxwts,
-  float *dywts, int xsize, int ysize, int num_cycles, int num_iter)
+/*  dxwts are copied into an array for dywts.  The cycles   */
+/*  stop early when the relative change of soln in a cycle  */
+/*  (see RelaxChange) is at most tol (0 to always run       */
+/*  num_cycles).  If history is not a null pointer, the     */
+/*  relative weighted residual (see RelaxResidual) after    */
+/*  each cycle is stored in it (num_cycles values at most). */
+/*  Returns the number of cycles run.                       */
+/*  The coarse grids are taken from arena, which may be     */
+/*  kept for further solves of the same size (see           */
+/*  AllocateGridArena); if it is a null pointer or does not */
+/*  fit, a temporary one is allocated.                      */
+int MultigridUnwrap(float *soln, float *dx, float *dy, float *dxwts,
+  float *dywts, int xsize, int ysize, int num_cycles, int num_iter,
+  double tol, double *history, GridArena *arena)
 {
-  int  n, dywts_was_null=0, coarsest_dim=3;
+  int        n, dywts_was_null=0, coarsest_dim=COARSEST_DIM;
+  double     resid, change;
+  float      *prev=NULL;
+  GridArena  *own_arena=NULL;
+  if (!GridArenaFits(arena, xsize, ysize, coarsest_dim, 1))
+    arena = own_arena = AllocateGridArena(xsize, ysize, coarsest_dim,
+                                          1, 1);
+  else
+    ResetGridArena(arena);
   if (dywts==NULL) {
     dywts_was_null = 1;
     AllocateDouble(&dywts, xsize*ysize, "dy wts");
     for (n=0; n<xsize*ysize; n++) dywts[n] = dxwts[n];
   }
-  for (n=0; n<num_cycles; n++) {
+  if (tol > 0.0) {
+    AllocateFloat(&prev, xsize*ysize, "previous solution");
+    for (n=0; n<xsize*ysize; n++) prev[n] = soln[n];
+  }
+  for (n=0; n<num_cycles; ) {
     printf("\nFMG CYCLE %d\n", n+1);
     FullMultigridVcycle(soln, dx, dy, dxwts, dywts,
-                        xsize, ysize, num_iter, coarsest_dim);
+                        xsize, ysize, num_iter, coarsest_dim, arena, 0);
+    ++n;
+    if (history) {
+      resid = RelaxResidual(soln, dx, dy, dxwts, dywts, xsize, ysize);
+      printf("FMG CYCLE %d: residual = %lf\n", n, resid);
+      history[n - 1] = resid;
+    }
+    if (prev) {
+      change = RelaxChange(soln, prev, xsize*ysize);
+      printf("FMG CYCLE %d: change = %lf\n", n, change);
+      if (change <= tol) break;
+    }
   }
+  if (prev) free(prev);
   if (dywts_was_null) free(dywts);
+  FreeGridArena(own_arena);
+  return n;
 }
@@ -2,112 +2,298 @@
  * gold.c -- generate branch cuts by Goldstein's algorithm
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
+#include <malloc.h>
+#include "file.h"
 #include "util.h"
 #include "brcut.h"
 #include "list.h"
+#include "gold.h"
 
 /* Goldstein's phase-unwrapping algorithm.  The bitflags store */
 /* the masked pixels (to be ignored) and the residues and      */
-/* accumulates other info such as the branch cut pixels.       */
+/* accumulates other info, and the branch cuts are drawn in    */
+/* the cut plane.                                              */
 void GoldsteinBranchCuts(unsigned char *bitflags, int MaxCutLen,
-               int NumRes, int xsize, int ysize, int branchcut_code)
+               int NumRes, int xsize, int ysize, CutPlane *plane)
 {
-  int            i, j, k, ii, jj, kk, m, n, ri, rj;
-  int            charge, boxctr_i, boxctr_j, boxsize, bs2;
+  int            j, k, n, ii, jj, ri, rj, row;
+  int            charge, boxsize, bs2, start;
   int            dist, min_dist, rim_i, rim_j, near_i, near_j;
   int            ka, num_active, max_active, *active_list;
   int            bench; 
-  int            draw_cut_line;
-  double         r;
+  ResidueGrid    *grid;
+  CutBatch       *cuts;
   bench = ysize/100;
   if (bench < 1) bench = 1;
   if (MaxCutLen < 2) MaxCutLen = 2;
   max_active = NumRes + 10;
   AllocateInt(&active_list, max_active + 1, "book keeping data");
+  grid = AllocateResidueGrid(bitflags, BORDER, xsize, ysize);
+  cuts = AllocateCutBatch();
   /* branch cuts */
   printf("Computing branch cuts\n");
-  for (j=0; j<ysize; j++) {
-    if (j%bench==0) {
-      printf("%d ", j/bench);
-      fflush(stdout);
+  for (n=0, row=0; n<grid->num_res; n++) {
+    k = grid->res[n];
+    j = k/xsize;
+    for ( ; row<=j; row++) {
+      if (row%bench==0) {
+        printf("%d ", row/bench);
+        fflush(stdout);
+      }
     }
-    for (i=0; i<xsize; i++) {
-      k = j*xsize + i;
-      if ((bitflags[k] & (POS_RES | NEG_RES))
-               && !(bitflags[k] & VISITED)) {
-        bitflags[k] |= VISITED;  /* turn on visited flag */
-        bitflags[k] |= ACTIVE;   /* turn on active flag */
-        charge = (bitflags[k] & POS_RES) ? 1 : -1;
-        num_active = 0;
-        active_list[num_active++] = k;
-        if (num_active > max_active) num_active = max_active;
-        for (boxsize = 3; boxsize<=2*MaxCutLen; boxsize += 2) {
-          bs2 = boxsize/2;
-          for (ka=0; ka<num_active; ka++) {
-            boxctr_i = active_list[ka]%xsize;
-            boxctr_j = active_list[ka]/xsize;
-            for (jj=boxctr_j - bs2; jj<=boxctr_j + bs2; jj++) {
-              for (ii=boxctr_i - bs2; ii<=boxctr_i + bs2; ii++) {
-                kk = jj*xsize + ii;
-                if (ii<0 || ii>=xsize || jj<0 || jj>=ysize) { 
-                  continue;
-                }
-                else { 
-                  if (ii==0 || ii==xsize-1 || jj==0 || jj==ysize-1
-                        || (bitflags[kk] & BORDER)) {
-                    charge = 0;
-                    DistToBorder(bitflags, BORDER, boxctr_i,
-                             boxctr_j, &ri, &rj, xsize, ysize);
-                    PlaceCut(bitflags, ri, rj, boxctr_i, boxctr_j,
-                             xsize, ysize, branchcut_code);
-                  }
-                  else if ((bitflags[kk] & (POS_RES | NEG_RES))
-                                   && !(bitflags[kk] & ACTIVE)) {
-                    if (!(bitflags[kk] & VISITED)) {
-                      charge += (bitflags[kk] & POS_RES) ? 1 : -1;
-                      bitflags[kk] |= VISITED;   /* set flag */
-                    }
-                    active_list[num_active++] = kk;
-                    if (num_active > max_active) 
-                           num_active = max_active;
-                    bitflags[kk] |= ACTIVE;  /* set active flag */
-                    PlaceCut(bitflags, ii, jj, boxctr_i, boxctr_j,
-                             xsize, ysize, branchcut_code);
-                  }
-                  if (charge==0)
-                    goto continue_scan;
-                }  /* else */
-              }   /* for (ii ... */
-            }   /* for (jj ... */
-          }  /* for (ka ... */  
-        }   /* for (boxsize ... */  
+    if (bitflags[k] & VISITED) continue;
+    bitflags[k] |= VISITED;  /* turn on visited flag */
+    bitflags[k] |= ACTIVE;   /* turn on active flag */
+    charge = (bitflags[k] & POS_RES) ? 1 : -1;
+    num_active = 0;
+    active_list[num_active++] = k;
+    if (num_active > max_active) num_active = max_active;
+    /* Residues found in a box become active, so when the box   */
+    /* grows, only its outer ring needs to be searched.  Those  */
+    /* that became active in the last box are searched in full. */
+    for (boxsize = 3; boxsize<=2*MaxCutLen; boxsize += 2) {
+      bs2 = boxsize/2;
+      start = (boxsize==3) ? 0 : num_active;
+      for (ka=0; ka<num_active; ka++) {
+        if (GoldsteinBox(grid, bitflags, active_list[ka]%xsize,
+                         active_list[ka]/xsize, bs2, ka >= start,
+                         &charge, active_list, &num_active,
+                         max_active, cuts))
+          goto continue_scan;
+      }
+    }   /* for (boxsize ... */  
 
-        if (charge != 0) {   /* connect branch cuts to rim */
-          min_dist = xsize + ysize;  /* large value */
-          for (ka=0; ka<num_active; ka++) {
-            ii = active_list[ka]%xsize;
-            jj = active_list[ka]/xsize;
-            if ((dist = DistToBorder(bitflags, BORDER,
-                        ii, jj, &ri, &rj, xsize, ysize))<min_dist) {
-              min_dist = dist;
-              near_i = ii;
-              near_j = jj;
-              rim_i = ri;
-              rim_j = rj;
-            }
-          } 
-          PlaceCut(bitflags, near_i, near_j, rim_i, rim_j,
-                   xsize, ysize, branchcut_code);
-        } 
-        continue_scan :
-        /* mark all active pixels inactive */
-        for (ka=0; ka<num_active; ka++) 
-          bitflags[active_list[ka]] &= ~ACTIVE;  /* turn flag off */
-      }  /* if (bitflags ... */
-    }  /* for (i ... */
-  }  /* for (j ... */
+    if (charge != 0) {   /* connect branch cuts to rim */
+      min_dist = xsize + ysize;  /* large value */
+      for (ka=0; ka<num_active; ka++) {
+        ii = active_list[ka]%xsize;
+        jj = active_list[ka]/xsize;
+        if ((dist = DistToBorder(grid->nearest, ii, jj, &ri, &rj,
+                                 xsize))<min_dist) {
+          min_dist = dist;
+          near_i = ii;
+          near_j = jj;
+          rim_i = ri;
+          rim_j = rj;
+        }
+      } 
+      AddCut(cuts, near_i, near_j, rim_i, rim_j);
+    } 
+    continue_scan :
+    /* mark all active pixels inactive */
+    for (ka=0; ka<num_active; ka++) 
+      bitflags[active_list[ka]] &= ~ACTIVE;  /* turn flag off */
+  }  /* for (n ... */
+  for ( ; row<ysize; row++) {
+    if (row%bench==0) {
+      printf("%d ", row/bench);
+      fflush(stdout);
+    }
+  }
   printf("\n");
+  PlaceCuts(cuts, plane);
+  FreeCutBatch(cuts);
+  FreeResidueGrid(grid);
   free(active_list);
   return;
 } 
+
+/* Search the box of half-size bs2 around the active residue    */
+/* (ci,cj) (or if full is 0, just its outer ring) in raster     */
+/* order.  Each residue that is not active is made active, and  */
+/* a branch cut to it is added to the batch.  If the box reaches */
+/* the border, a cut to the border is added instead.  Returns 1  */
+/* if the charge has been balanced (or connected to the border). */
+int GoldsteinBox(ResidueGrid *grid, unsigned char *bitflags,
+                 int ci, int cj, int bs2, int full, int *charge,
+                 int *active_list, int *num_active, int max_active,
+                 CutBatch *cuts)
+{
+  int  x0, y0, x1, y1, ym0, ym1, k, kb, kk, n, ri, rj;
+  int  xsize = grid->xsize, ysize = grid->ysize;
+  x0 = (ci - bs2 > 0) ? ci - bs2 : 0;
+  y0 = (cj - bs2 > 0) ? cj - bs2 : 0;
+  x1 = (ci + bs2 < xsize - 1) ? ci + bs2 : xsize - 1;
+  y1 = (cj + bs2 < ysize - 1) ? cj + bs2 : ysize - 1;
+  grid->num_found = 0;
+  if (full) {
+    kb = FirstBorder(grid, x0, y0, x1, y1);
+    FindResidues(grid, x0, y0, x1, y1);
+  }
+  else {
+    /* top row, the two sides, and the bottom row of the ring */
+    kb = -1;
+    if (cj - bs2 >= 0) {
+      kb = FirstBorder(grid, x0, y0, x1, y0);
+      FindResidues(grid, x0, y0, x1, y0);
+    }
+    ym0 = (cj - bs2 + 1 > 0) ? cj - bs2 + 1 : 0;
+    ym1 = (cj + bs2 - 1 < ysize - 1) ? cj + bs2 - 1 : ysize - 1;
+    if (ci - bs2 >= 0) {
+      k = (kb < 0) ? FirstBorder(grid, x0, ym0, x0, ym1) : -1;
+      if (k >= 0) kb = k;
+      FindResidues(grid, x0, ym0, x0, ym1);
+    }
+    if (ci + bs2 <= xsize - 1) {
+      k = (kb < 0 || kb >= ym0*xsize)
+                  ? FirstBorder(grid, x1, ym0, x1, ym1) : -1;
+      if (k >= 0 && (kb < 0 || k < kb)) kb = k;
+      FindResidues(grid, x1, ym0, x1, ym1);
+    }
+    if (cj + bs2 <= ysize - 1) {
+      k = (kb < 0) ? FirstBorder(grid, x0, y1, x1, y1) : -1;
+      if (k >= 0) kb = k;
+      FindResidues(grid, x0, y1, x1, y1);
+    }
+  }
+  if (grid->num_found > 1)
+    qsort(grid->found, grid->num_found, sizeof(int),
+          CompareResidues);
+  for (n=0; n<grid->num_found; n++) {
+    kk = grid->found[n];
+    if (kb >= 0 && kk > kb) break;
+    if (!(bitflags[kk] & ACTIVE)) {
+      if (!(bitflags[kk] & VISITED)) {
+        *charge += (bitflags[kk] & POS_RES) ? 1 : -1;
+        bitflags[kk] |= VISITED;   /* set flag */
+      }
+      active_list[(*num_active)++] = kk;
+      if (*num_active > max_active) 
+        *num_active = max_active;
+      bitflags[kk] |= ACTIVE;  /* set active flag */
+      AddCut(cuts, kk%xsize, kk/xsize, ci, cj);
+    }
+    if (*charge==0) return 1;
+  }
+  if (kb >= 0) {
+    *charge = 0;
+    DistToBorder(grid->nearest, ci, cj, &ri, &rj, xsize);
+    AddCut(cuts, ri, rj, ci, cj);
+    return 1;
+  }
+  return 0;
+}
+
+/* Extract the residues of the bitflags array and sort them */
+/* into a grid of cells, and sum up the border pixels       */
+ResidueGrid *AllocateResidueGrid(unsigned char *bitflags,
+                                 int border_code, int xsize, int ysize)
+{
+  int          i, j, k, c, n, w, border;
+  ResidueGrid  *grid;
+  grid = (ResidueGrid *) malloc(sizeof(ResidueGrid));
+  if (!grid)
+    ErrorHandler("Cannot allocate memory", "residue grid",
+                 MEMORY_ALLOCATION_ERROR);
+  grid->xsize = xsize;
+  grid->ysize = ysize;
+  for (k=0, n=0; k<xsize*ysize; k++)
+    if (bitflags[k] & RESIDUE) ++n;
+  grid->num_res = n;
+  AllocateInt(&grid->res, n + 1, "residue grid");
+  AllocateInt(&grid->found, n + 1, "residue grid");
+  /* cells of about one residue each, within bounds */
+  grid->cell = (n > 0) ? sqrt((double)xsize*ysize/n) : MAX_RES_CELL;
+  if (grid->cell < MIN_RES_CELL) grid->cell = MIN_RES_CELL;
+  if (grid->cell > MAX_RES_CELL) grid->cell = MAX_RES_CELL;
+  grid->cols = (xsize + grid->cell - 1)/grid->cell;
+  grid->rows = (ysize + grid->cell - 1)/grid->cell;
+  AllocateInt(&grid->cell_start, grid->cols*grid->rows + 2,
+              "residue grid");
+  AllocateInt(&grid->cell_res, n + 1, "residue grid");
+  w = xsize + 1;
+  AllocateInt(&grid->border_sums, w*(ysize + 1), "residue grid");
+  for (j=0, n=0; j<ysize; j++) {
+    for (i=0, border=0; i<xsize; i++) {
+      k = j*xsize + i;
+      if (i==0 || i==xsize-1 || j==0 || j==ysize-1
+            || (bitflags[k] & border_code)) {
+        ++border;
+      }
+      else if (bitflags[k] & RESIDUE) {
+        /* count the residues of each cell */
+        ++grid->cell_start[(j/grid->cell)*grid->cols + i/grid->cell + 2];
+      }
+      if (bitflags[k] & RESIDUE) grid->res[n++] = k;
+      grid->border_sums[(j + 1)*w + i + 1]
+                        = grid->border_sums[j*w + i + 1] + border;
+    }
+  }
+  grid->nearest = BorderTransform(bitflags, border_code, xsize, ysize);
+  /* list the residues of each cell (cell c starts at cell_start[c]) */
+  for (c=2; c<grid->cols*grid->rows + 2; c++)
+    grid->cell_start[c] += grid->cell_start[c - 1];
+  for (n=0; n<grid->num_res; n++) {
+    k = grid->res[n];
+    i = k%xsize;
+    j = k/xsize;
+    if (BorderCount(grid, i, j, i, j)) continue;
+    c = (j/grid->cell)*grid->cols + i/grid->cell;
+    grid->cell_res[grid->cell_start[c + 1]++] = k;
+  }
+  return grid;
+}
+
+/* Free the residue grid */
+void FreeResidueGrid(ResidueGrid *grid)
+{
+  free(grid->res);
+  free(grid->found);
+  free(grid->cell_start);
+  free(grid->cell_res);
+  free(grid->border_sums);
+  free(grid->nearest);
+  free(grid);
+}
+
+/* Number of border pixels in [x0,x1] x [y0,y1] */
+int BorderCount(ResidueGrid *grid, int x0, int y0, int x1, int y1)
+{
+  int  w = grid->xsize + 1, *s = grid->border_sums;
+  return s[(y1 + 1)*w + x1 + 1] - s[y0*w + x1 + 1]
+           - s[(y1 + 1)*w + x0] + s[y0*w + x0];
+}
+
+/* Index of the first border pixel in [x0,x1] x [y0,y1] in */
+/* raster order, or -1 if there is none                    */
+int FirstBorder(ResidueGrid *grid, int x0, int y0, int x1, int y1)
+{
+  int  y, lo, hi, mid;
+  if (x0 > x1 || y0 > y1 || !BorderCount(grid, x0, y0, x1, y1))
+    return -1;
+  for (y=y0; !BorderCount(grid, x0, y, x1, y); y++)
+    ;
+  for (lo=x0, hi=x1; lo < hi; ) {
+    mid = (lo + hi)/2;
+    if (BorderCount(grid, x0, y, mid, y)) hi = mid;
+    else lo = mid + 1;
+  }
+  return y*grid->xsize + lo;
+}
+
+/* Add the residues in [x0,x1] x [y0,y1] to the found list */
+void FindResidues(ResidueGrid *grid, int x0, int y0, int x1, int y1)
+{
+  int  cx, cy, c, n, k, i, j;
+  if (x0 > x1 || y0 > y1) return;
+  for (cy=y0/grid->cell; cy<=y1/grid->cell; cy++) {
+    for (cx=x0/grid->cell; cx<=x1/grid->cell; cx++) {
+      c = cy*grid->cols + cx;
+      for (n=grid->cell_start[c]; n<grid->cell_start[c + 1]; n++) {
+        k = grid->cell_res[n];
+        i = k%grid->xsize;
+        j = k/grid->xsize;
+        if (i >= x0 && i <= x1 && j >= y0 && j <= y1)
+          grid->found[grid->num_found++] = k;
+      }
+    }
+  }
+}
+
+/* Compare pixel indices (for qsort) */
+int CompareResidues(const void *p, const void *q)
+{
+  return *((int *) p) - *((int *) q);
+}
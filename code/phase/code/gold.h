@@ -1,5 +1,38 @@
 #ifndef __GOLD
 #define __GOLD
+#include "brcut.h"
+/* bounds on the side of the cells of the residue grid */
+#define MIN_RES_CELL   4
+#define MAX_RES_CELL  64
+/* The residues of the bitflags array in raster order, and a   */
+/* uniform grid over the image that lists the residues in each */
+/* cell (also in raster order).  Residues on the border (masked */
+/* or on the edge of the image) are listed in res only, since   */
+/* the box search treats them as border.  border_sums is the    */
+/* summed area table of the border pixels: border_sums[j*(xsize */
+/* +1) + i] is the number of them in [0,i) x [0,j).  nearest   */
+/* is the nearest border pixel of each pixel (BorderTransform). */
+typedef struct {
+  int  xsize, ysize;
+  int  num_res, *res;
+  int  cell, cols, rows;      /* cell size and grid size */
+  int  *cell_start;           /* cell c: cell_res[cell_start[c]] */
+  int  *cell_res;             /*   to cell_res[cell_start[c+1]-1] */
+  int  *border_sums;
+  int  *nearest;
+  int  num_found, *found;     /* residues found in a box */
+} ResidueGrid;
 void GoldsteinBranchCuts(unsigned char *bitflags, int MaxCutLen,
-                  int NumRes, int xsize, int ysize, int mask_code);
+                  int NumRes, int xsize, int ysize, CutPlane *plane);
+int GoldsteinBox(ResidueGrid *grid, unsigned char *bitflags,
+                 int ci, int cj, int bs2, int full, int *charge,
+                 int *active_list, int *num_active, int max_active,
+                 CutBatch *cuts);
+ResidueGrid *AllocateResidueGrid(unsigned char *bitflags,
+                                 int border_code, int xsize, int ysize);
+void FreeResidueGrid(ResidueGrid *grid);
+int BorderCount(ResidueGrid *grid, int x0, int y0, int x1, int y1);
+int FirstBorder(ResidueGrid *grid, int x0, int y0, int x1, int y1);
+void FindResidues(ResidueGrid *grid, int x0, int y0, int x1, int y1);
+int CompareResidues(const void *p, const void *q);
 #endif
@@ -10,53 +10,60 @@
 
 /* Main function for weighted multigrid (called recursively) */
 void FullMultigridVcycle(float *soln, float *dx, float *dy,
-   float *dxwts, float *dywts, int w, int h, int numit, int mindim)
+   float *dxwts, float *dywts, int w, int h, int numit, int mindim,
+   GridArena *arena, int level)
 {
   float  *dx2=NULL, *dy2=NULL, *soln2=NULL;
   float  *dxwts2=NULL, *dywts2=NULL;
   int    w2 = w/2, h2 = h/2;
   if (!Coarsest(w, h, mindim)) {
-    dxwts2 = Allocate(w2, h2, dxwts_type);
-    dywts2 = Allocate(w2, h2, dywts_type);
-    dx2 = Allocate(w2, h2, dx_type);
-    dy2 = Allocate(w2, h2, dy_type);
-    soln2 = Allocate(w2, h2, soln_type);
+    dxwts2 = GridArray(arena, level + 1, dxwts_type);
+    dywts2 = GridArray(arena, level + 1, dywts_type);
+    dx2 = GridArray(arena, level + 1, dx_type);
+    dy2 = GridArray(arena, level + 1, dy_type);
+    soln2 = GridArray(arena, level + 1, soln_type);
     RestrictDxwts(dxwts2, w2, h2, dxwts, w, h);
     RestrictDywts(dywts2, w2, h2, dywts, w, h);
     Restrict(dx2, dy2, w2, h2, dx, dy, dxwts, dywts, soln, w, h); 
     Zero(soln2, w2, h2);
     FullMultigridVcycle(soln2, dx2, dy2, dxwts2, dywts2, w2, h2,
-                        numit, mindim);
+                        numit, mindim, arena, level + 1);
     ProlongAndAccumulate(soln, w, h, soln2, w2, h2, dxwts2, dywts2);
   }
   /* perform V-cycle multigrid on fine grid */
-  Vcycle(soln, dx, dy, dxwts, dywts, w, h, numit, mindim);
+  Vcycle(soln, dx, dy, dxwts, dywts, w, h, numit, mindim,
+         arena, level);
 }
 
 /* V-cycle multigrid algorithm (called recursively) */
 void Vcycle(float *soln, float *dx, float *dy, float *dxwts,
-            float *dywts, int w, int h, int numit, int mindim)
+            float *dywts, int w, int h, int numit, int mindim,
+            GridArena *arena, int level)
 {
   float *dx2=NULL, *dy2=NULL, *soln2=NULL;
   float *dxwts2=NULL, *dywts2=NULL;
   int    w2 = w/2, h2 = h/2;
   if (!Coarsest(w, h, mindim)) {
-    Relax(soln, dx, dy, dxwts, dywts, w, h, numit);
-    dxwts2 = Allocate(w2, h2, dxwts_type);
-    dywts2 = Allocate(w2, h2, dywts_type);
-    dx2 = Allocate(w2, h2, dx_type);
-    dy2 = Allocate(w2, h2, dy_type);
-    soln2 = Allocate(w2, h2, soln_type);
+    Relax(soln, dx, dy, dxwts, dywts, w, h, numit,
+          arena->relax[level]);
+    dxwts2 = GridArray(arena, level + 1, dxwts_type);
+    dywts2 = GridArray(arena, level + 1, dywts_type);
+    dx2 = GridArray(arena, level + 1, dx_type);
+    dy2 = GridArray(arena, level + 1, dy_type);
+    soln2 = GridArray(arena, level + 1, soln_type);
     RestrictDxwts(dxwts2, w2, h2, dxwts, w, h);
     RestrictDywts(dywts2, w2, h2, dywts, w, h);
     Restrict(dx2, dy2, w2, h2, dx, dy, dxwts, dywts, soln, w, h); 
     Zero(soln2, w2, h2);
-    Vcycle(soln2, dx2, dy2, dxwts2, dywts2, w2, h2, numit, mindim); 
+    Vcycle(soln2, dx2, dy2, dxwts2, dywts2, w2, h2, numit, mindim,
+           arena, level + 1);
     ProlongAndAccumulate(soln, w, h, soln2, w2, h2, dxwts2, dywts2);
-    Relax(soln, dx, dy, dxwts, dywts, w, h, numit);
+    Relax(soln, dx, dy, dxwts, dywts, w, h, numit,
+          arena->relax[level]);
   }
   else { /* coarsest */
-    Relax(soln, dx, dy, dxwts, dywts, w, h, 2*w*h); 
+    Relax(soln, dx, dy, dxwts, dywts, w, h, 2*w*h,
+          arena->relax[level]);
   }
 }
 
@@ -1,10 +1,13 @@
 #ifndef __GRID
 #define __GRID
+#include "gridmem.h"
 void FullMultigridVcycle(float *soln, float *dx, float *dy,
                          float *dxwts, float *dywts, int w, int h,
-                         int numit, int coarsest_dim);
+                         int numit, int coarsest_dim,
+                         GridArena *arena, int level);
 void Vcycle(float *soln, float *dx, float *dy, float *dxwts,
-            float *dywts, int w, int h, int numit, int coarsest_dim);
+            float *dywts, int w, int h, int numit, int coarsest_dim,
+            GridArena *arena, int level);
 void RestrictDxwts(float *coarse, int wc, int hc, float *fine,
                    int wf, int hf);
 void RestrictDywts(float *coarse, int wc, int hc, float *fine,
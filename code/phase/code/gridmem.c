@@ -4,37 +4,132 @@
  */
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
+#include <malloc.h>
+#include "file.h"
+#include "util.h"
+#include "gridops.h"
 #include "gridmem.h"
 
-static int sizes[NUM_TYPES][MAX_ARRAYS];
-static int num[NUM_TYPES];
-static float *arrays[NUM_TYPES][MAX_ARRAYS];
-
-/* allocate array: if already allocated, return pointer to it */
-float *Allocate(int w, int h, ArrayType type)
+/* Allocate the arrays of all the coarse grids of an xsize x ysize */
+/* multigrid solve in one block.  The levels are those visited by  */
+/* FullMultigridVcycle and Ufmg (see Coarsest).  The arena can be  */
+/* reused by any number of solves of the same size, one at a time; */
+/* concurrent solves each need their own arena.  The relaxation    */
+/* sweeps are split among num_threads threads.                     */
+GridArena *AllocateGridArena(int xsize, int ysize, int coarsest_dim,
+                             int weighted, int num_threads)
 {
-  int size = w*h, i, j, k;
-  k = (int) type;
-  for (i=0; i<num[k]; i++) {
-    if (sizes[k][i]==size) 
-      return arrays[k][i];
+  int        n, t, w, h, num_levels, num_types;
+  size_t     size, offset, bytes;
+  char       *base;
+  GridArena  *arena;
+  arena = (GridArena *) malloc(sizeof(GridArena));
+  if (!arena) 
+    ErrorHandler("Cannot allocate memory", "multigrid arena",
+                 MEMORY_ALLOCATION_ERROR);
+  arena->xsize = xsize;
+  arena->ysize = ysize;
+  arena->coarsest_dim = coarsest_dim;
+  arena->weighted = weighted;
+  w = xsize;
+  h = ysize;
+  for (num_levels=1; !Coarsest(w, h, coarsest_dim); num_levels++) {
+    w /= 2;
+    h /= 2;
   }
-  sizes[k][num[k]] = size;
-  arrays[k][num[k]] = (float *) malloc(size*sizeof(float));
-  if (!arrays[k][num[k]]) {
-    printf("Error: cannot allocate memory (%d bytes)\n", size*4);
-    return 0;  /* error */
+  arena->num_levels = num_levels;
+  arena->w = (int *) malloc(num_levels*sizeof(int));
+  arena->h = (int *) malloc(num_levels*sizeof(int));
+  for (t=0; t<NUM_TYPES; t++) 
+    arena->arrays[t] = (float **) calloc(num_levels, sizeof(float *));
+  arena->relax = (RelaxPlan **) calloc(num_levels, sizeof(RelaxPlan *));
+  if (!arena->w || !arena->h || !arena->arrays[NUM_TYPES - 1]
+                || !arena->relax)
+    ErrorHandler("Cannot allocate memory", "multigrid arena",
+                 MEMORY_ALLOCATION_ERROR);
+  num_types = (weighted) ? NUM_TYPES : dxwts_type;
+  arena->w[0] = xsize;
+  arena->h[0] = ysize;
+  bytes = 0;
+  for (n=1; n<num_levels; n++) {
+    arena->w[n] = arena->w[n - 1]/2;
+    arena->h[n] = arena->h[n - 1]/2;
+    size = arena->w[n]*arena->h[n]*sizeof(float);
+    size = (size + GRID_ALIGN - 1)/GRID_ALIGN*GRID_ALIGN;
+    bytes += num_types*size;
   }
-  return arrays[k][num[k]++];
-}
-
-/* free all allocated arrays */
-void FreeAll()
-{ 
-  int i, j;
-  for (j=0; j<NUM_TYPES; j++) {
-    for (i=0; i<num[j]; i++) {
-      free(arrays[j][i]);
+  arena->bytes = bytes;
+  arena->block = (char *) malloc(bytes + GRID_ALIGN);
+  if (!arena->block)
+    ErrorHandler("Cannot allocate memory", "multigrid arena",
+                 MEMORY_ALLOCATION_ERROR);
+  base = arena->block 
+           + (GRID_ALIGN - (size_t) arena->block % GRID_ALIGN) % GRID_ALIGN;
+  arena->base = base;
+  offset = 0;
+  for (n=1; n<num_levels; n++) {
+    size = arena->w[n]*arena->h[n]*sizeof(float);
+    size = (size + GRID_ALIGN - 1)/GRID_ALIGN*GRID_ALIGN;
+    for (t=0; t<num_types; t++) {
+      arena->arrays[t][n] = (float *) (base + offset);
+      offset += size;
     }
   }
+  arena->pool = (num_threads > 1) ? AllocateThreadPool(num_threads)
+                                  : NULL;
+  for (n=0; n<num_levels; n++) {
+    arena->relax[n] = AllocateRelaxPlan(arena->w[n], arena->h[n],
+                                        weighted, arena->pool);
+  }
+  ResetGridArena(arena);
+  return arena;
+}
+
+/* Zero all the arrays of the arena.  Restrict does not set   */
+/* every coarse grid value, so this is done before each solve */
+/* to make the result independent of earlier solves.  The     */
+/* relaxation weights are recomputed for the new weights.     */
+void ResetGridArena(GridArena *arena)
+{
+  int  n;
+  memset(arena->base, 0, arena->bytes);
+  for (n=0; n<arena->num_levels; n++) arena->relax[n]->wts_ready = 0;
+}
+
+/* Free the arena and its arrays */
+void FreeGridArena(GridArena *arena)
+{
+  int  n, t;
+  if (!arena) return;
+  for (n=0; n<arena->num_levels; n++) FreeRelaxPlan(arena->relax[n]);
+  FreeThreadPool(arena->pool);
+  for (t=0; t<NUM_TYPES; t++) free(arena->arrays[t]);
+  free(arena->relax);
+  free(arena->w);
+  free(arena->h);
+  free(arena->block);
+  free(arena);
+}
+
+/* Return 1 if the arena can be used for a multigrid solve */
+/* of the given size, and 0 if not.                        */
+int GridArenaFits(GridArena *arena, int xsize, int ysize,
+                  int coarsest_dim, int weighted)
+{
+  return (arena && arena->xsize==xsize && arena->ysize==ysize
+            && arena->coarsest_dim==coarsest_dim
+            && (arena->weighted || !weighted));
+}
+
+/* Return the array of the given type at the given level */
+float *GridArray(GridArena *arena, int level, ArrayType type)
+{
+  float  *ptr = NULL;
+  if (level > 0 && level < arena->num_levels) 
+    ptr = arena->arrays[(int) type][level];
+  if (!ptr) 
+    ErrorHandler("No such array in multigrid arena", "GridArray",
+                 MEMORY_ALLOCATION_ERROR);
+  return ptr;
 }
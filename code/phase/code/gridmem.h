@@ -1,10 +1,36 @@
 #ifndef __GRIDMEM
 #define __GRIDMEM
-#define MAX_ARRAYS   100
+#include "pool.h"
+#include "relax.h"
 #define NUM_TYPES      5
+/* smallest coarse grid dimension of MultigridUnwrap, etc. */
+#define COARSEST_DIM   3
+/* each coarse grid array starts on a GRID_ALIGN-byte boundary */
+#define GRID_ALIGN    64
 typedef enum {
   dx_type, dy_type, soln_type, dxwts_type, dywts_type
 } ArrayType;
-float *Allocate(int w, int h, ArrayType type);
-void FreeAll();
+/* Arrays of the coarse grids of one multigrid solve, carved out */
+/* of a single allocation.  Level 0 is the caller's full grid    */
+/* and has no arrays here; level n is (w/2^n)x(h/2^n).  The      */
+/* weight arrays are only allocated if weighted is nonzero.      */
+/* Each level (including 0) also has the work arrays of Relax,   */
+/* whose sweeps are split among the threads of pool.             */
+typedef struct {
+  int         xsize, ysize, coarsest_dim, weighted;
+  int         num_levels;
+  int         *w, *h;
+  float       **arrays[NUM_TYPES];   /* [type][level] */
+  char        *block, *base;         /* allocated and aligned */
+  size_t      bytes;
+  RelaxPlan   **relax;               /* [level] */
+  ThreadPool  *pool;
+} GridArena;
+GridArena *AllocateGridArena(int xsize, int ysize, int coarsest_dim,
+                             int weighted, int num_threads);
+void FreeGridArena(GridArena *arena);
+void ResetGridArena(GridArena *arena);
+int GridArenaFits(GridArena *arena, int xsize, int ysize,
+                  int coarsest_dim, int weighted);
+float *GridArray(GridArena *arena, int level, ArrayType type);
 #endif
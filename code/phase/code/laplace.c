@@ -3,6 +3,9 @@
  */
 #include <stdio.h>
 #include <math.h>
+#include <malloc.h>
+#include "file.h"
+#include "util.h"
 #include "grad.h"
 #include "laplace.h"
 #define SIMIN(x,y) (((x)*(x) < (y)*(y)) ? (x)*(x) : (y)*(y))
@@ -12,48 +15,216 @@
 void ComputeLaplacian(float *input, float *laplacian, float *dxwts,
                     float *dywts, int xsize, int ysize, int laptype)
 {
-  double w1, w2, w3, w4;
-  int    i, j, k1, k2, k3, k4, k;
+  Stencil  *stencil;
+  stencil = AllocateStencil(dxwts, dywts, xsize, ysize);
+  StencilLaplacian(stencil, input, laplacian, laptype);
+  FreeStencil(stencil);
+}
+
+/* Allocate the stencil of the weighted (or unweighted) Laplacian */
+/* and compute its edge weights from dxwts and dywts (see         */
+/* SetStencilWeights).  If both are null, the stencil is          */
+/* unweighted and has no weight arrays.                           */
+Stencil *AllocateStencil(float *dxwts, float *dywts, int xsize,
+                         int ysize)
+{
+  Stencil  *stencil;
+  stencil = (Stencil *) malloc(sizeof(Stencil));
+  if (!stencil)
+    ErrorHandler("Cannot allocate memory", "stencil",
+                 MEMORY_ALLOCATION_ERROR);
+  stencil->xsize = xsize;
+  stencil->ysize = ysize;
+  stencil->w1 = stencil->w2 = stencil->w3 = stencil->w4 = NULL;
+  if (dxwts || dywts) {
+    AllocateFloat(&stencil->w1, xsize*ysize, "stencil weights");
+    AllocateFloat(&stencil->w2, xsize*ysize, "stencil weights");
+    AllocateFloat(&stencil->w3, xsize*ysize, "stencil weights");
+    AllocateFloat(&stencil->w4, xsize*ysize, "stencil weights");
+    SetStencilWeights(stencil, dxwts, dywts);
+  }
+  return stencil;
+}
+
+/* Free the stencil made by AllocateStencil */
+void FreeStencil(Stencil *stencil)
+{
+  if (!stencil) return;
+  if (stencil->w1) {
+    free(stencil->w1);
+    free(stencil->w2);
+    free(stencil->w3);
+    free(stencil->w4);
+  }
+  free(stencil);
+}
+
+/* Compute the edge weights of a weighted stencil.  If dywts is  */
+/* null (or dxwts is null), the weights are calculated from the  */
+/* other set as in the PCG algorithm: the weight of an edge is   */
+/* the smaller of the squared weights of its two pixels.  The    */
+/* boundary conditions are built into the weights.               */
+void SetStencilWeights(Stencil *stencil, float *dxwts, float *dywts)
+{
+  int    i, j, k, k1, k2, k3, k4;
+  int    xsize = stencil->xsize, ysize = stencil->ysize;
   float  *wts;
   for (j=0; j<ysize; j++) {
     for (i=0; i<xsize; i++) {
       k = j*xsize + i;
-      k1 = (i<xsize-1) ? k + 1 : k - 1;
-      k2 = (i>0) ? k - 1 : k + 1;
-      k3 = (j<ysize-1) ? k + xsize : k - xsize;
-      k4 = (j>0) ? k - xsize : k + xsize;
-      if (dxwts==NULL && dywts==NULL) {  /* unweighted */
-        w1 = w2 = w3 = w4 = 1.0;
-      }
-      else if (dxwts==NULL || dywts==NULL) {  /* one set of wts */ 
+      if (dxwts==NULL || dywts==NULL) {  /* one set of wts */
         wts = (dxwts) ? dxwts : dywts;
-        w1 = SIMIN(wts[k], wts[k1]);
-        w2 = SIMIN(wts[k], wts[k2]);
-        w3 = SIMIN(wts[k], wts[k3]);
-        w4 = SIMIN(wts[k], wts[k4]);
+        k1 = (i<xsize-1) ? k + 1 : k - 1;
+        k2 = (i>0) ? k - 1 : k + 1;
+        k3 = (j<ysize-1) ? k + xsize : k - xsize;
+        k4 = (j>0) ? k - xsize : k + xsize;
+        stencil->w1[k] = SIMIN(wts[k], wts[k1]);
+        stencil->w2[k] = SIMIN(wts[k], wts[k2]);
+        stencil->w3[k] = SIMIN(wts[k], wts[k3]);
+        stencil->w4[k] = SIMIN(wts[k], wts[k4]);
       }
       else {    /* dxwts and dywts are both supplied */
-        w1 = dxwts[k];
-        w2 = (i>0) ? dxwts[k-1] : dxwts[k];     /* boundary condition */
-        w3 = dywts[k];
-        w4 = (j>0) ? dywts[k-xsize] : dywts[k];    /* boundary condition */
+        stencil->w1[k] = dxwts[k];
+        stencil->w2[k] = (i>0) ? dxwts[k-1] : dxwts[k];
+        stencil->w3[k] = dywts[k];
+        stencil->w4[k] = (j>0) ? dywts[k-xsize] : dywts[k];
       }
-      if (laptype) {   /* compute wrapped phase Laplacian */
-        float *phase = input;
-        laplacian[k]  = w1*Gradient(phase[k], phase[k1])
-                          + w2*Gradient(phase[k], phase[k2])
-                             + w3*Gradient(phase[k], phase[k3])
-                                + w4*Gradient(phase[k], phase[k4]);
+    }
+  }
+}
+
+/* Weighted Laplacian (wrapped if laptype=1) of input at pixel   */
+/* (i,j) of the array, with the reflecting boundary conditions.  */
+float StencilPixel(Stencil *stencil, float *input, int i, int j,
+                   int laptype)
+{
+  double  w1, w2, w3, w4;
+  int     k, k1, k2, k3, k4, xsize = stencil->xsize;
+  k = j*xsize + i;
+  k1 = (i<xsize-1) ? k + 1 : k - 1;
+  k2 = (i>0) ? k - 1 : k + 1;
+  k3 = (j<stencil->ysize-1) ? k + xsize : k - xsize;
+  k4 = (j>0) ? k - xsize : k + xsize;
+  if (stencil->w1) {
+    w1 = stencil->w1[k];    w2 = stencil->w2[k];
+    w3 = stencil->w3[k];    w4 = stencil->w4[k];
+  }
+  else {
+    w1 = w2 = w3 = w4 = 1.0;
+  }
+  if (laptype) {   /* wrapped phase Laplacian */
+    return w1*Gradient(input[k], input[k1])
+             + w2*Gradient(input[k], input[k2])
+                + w3*Gradient(input[k], input[k3])
+                   + w4*Gradient(input[k], input[k4]);
+  }
+  else {   /* usual (not wrapped) Laplacian */
+    return w1*(input[k] - input[k1])
+             + w2*(input[k] - input[k2])
+                + w3*(input[k] - input[k3])
+                   + w4*(input[k] - input[k4]);
+  }
+}
+
+/* Compute the Laplacian (wrapped if laptype=1) of input by means */
+/* of the stencil.  The interior pixels need no boundary tests.   */
+void StencilLaplacian(Stencil *stencil, float *input,
+                      float *laplacian, int laptype)
+{
+  int     i, j, k, xsize = stencil->xsize, ysize = stencil->ysize;
+  float   *w1 = stencil->w1, *w2 = stencil->w2;
+  float   *w3 = stencil->w3, *w4 = stencil->w4;
+  double  d1, d2, d3, d4;
+  for (j=0; j<ysize; j++) {
+    if (j==0 || j==ysize-1 || xsize < 3) {
+      for (i=0; i<xsize; i++) {
+        laplacian[j*xsize + i]
+                     = StencilPixel(stencil, input, i, j, laptype);
+      }
+      continue;
+    }
+    k = j*xsize;
+    laplacian[k] = StencilPixel(stencil, input, 0, j, laptype);
+    for (i=1, k=j*xsize+1; i<xsize-1; i++, k++) {
+      if (laptype) {
+        d1 = Gradient(input[k], input[k + 1]);
+        d2 = Gradient(input[k], input[k - 1]);
+        d3 = Gradient(input[k], input[k + xsize]);
+        d4 = Gradient(input[k], input[k - xsize]);
+      }
+      else {
+        d1 = input[k] - input[k + 1];
+        d2 = input[k] - input[k - 1];
+        d3 = input[k] - input[k + xsize];
+        d4 = input[k] - input[k - xsize];
       }
-      else {   /* compute usual (not wrapped) Laplacian */
-        float *surface = input;
-        laplacian[k]  = w1*(surface[k] - surface[k1])
-                          + w2*(surface[k] - surface[k2])
-                             + w3*(surface[k] - surface[k3])
-                                + w4*(surface[k] - surface[k4]);
+      if (w1) {
+        laplacian[k] = (double)w1[k]*d1 + (double)w2[k]*d2
+                         + (double)w3[k]*d3 + (double)w4[k]*d4;
       }
+      else {
+        laplacian[k] = d1 + d2 + d3 + d4;
+      }
+    }
+    laplacian[k] = StencilPixel(stencil, input, xsize-1, j, laptype);
+  }
+}
+
+/* Apply the weighted Laplacian operator Q to p at pixel (i,j):  */
+/* (w1 + w2 + w3 + w4)*p - (w1*p1 + w2*p2 + w3*p3 + w4*p4), as in */
+/* the PCG algorithm, with the reflecting boundary conditions.    */
+float StencilOperatorPixel(Stencil *stencil, float *p, int i, int j)
+{
+  double  w1, w2, w3, w4;
+  int     k, k1, k2, k3, k4, xsize = stencil->xsize;
+  k = j*xsize + i;
+  k1 = (i<xsize-1) ? k + 1 : k - 1;
+  k2 = (i>0) ? k - 1 : k + 1;
+  k3 = (j<stencil->ysize-1) ? k + xsize : k - xsize;
+  k4 = (j>0) ? k - xsize : k + xsize;
+  if (stencil->w1) {
+    w1 = stencil->w1[k];    w2 = stencil->w2[k];
+    w3 = stencil->w3[k];    w4 = stencil->w4[k];
+  }
+  else {
+    w1 = w2 = w3 = w4 = 1.0;
+  }
+  return (w1 + w2 + w3 + w4)*p[k]
+           - (w1*p[k1] + w2*p[k2] + w3*p[k3] + w4*p[k4]);
+}
+
+/* Apply the operator Q to row j of p, storing the result in out. */
+/* Separate loops do the weighted and unweighted interior pixels, */
+/* without boundary tests.                                        */
+void StencilOperatorRow(Stencil *stencil, float *p, float *out, int j)
+{
+  int     i, k, xsize = stencil->xsize, ysize = stencil->ysize;
+  float   *w1 = stencil->w1, *w2 = stencil->w2;
+  float   *w3 = stencil->w3, *w4 = stencil->w4;
+  double  v1, v2, v3, v4;
+  if (j==0 || j==ysize-1 || xsize < 3) {
+    for (i=0; i<xsize; i++) {
+      out[j*xsize + i] = StencilOperatorPixel(stencil, p, i, j);
+    }
+    return;
+  }
+  k = j*xsize;
+  out[k] = StencilOperatorPixel(stencil, p, 0, j);
+  if (w1) {
+    for (i=1, k=j*xsize+1; i<xsize-1; i++, k++) {
+      v1 = w1[k];    v2 = w2[k];    v3 = w3[k];    v4 = w4[k];
+      out[k] = (v1 + v2 + v3 + v4)*p[k]
+                 - (v1*p[k + 1] + v2*p[k - 1]
+                      + v3*p[k + xsize] + v4*p[k - xsize]);
+    }
+  }
+  else {
+    for (i=1, k=j*xsize+1; i<xsize-1; i++, k++) {
+      out[k] = 4.0*p[k] - ((double)p[k + 1] + (double)p[k - 1]
+                     + (double)p[k + xsize] + (double)p[k - xsize]);
     }
   }
+  out[k] = StencilOperatorPixel(stencil, p, xsize-1, j);
 }
 
 /* Compute the dx and dy weighted laplacian.  The parameter */
@@ -1,8 +1,26 @@
 #ifndef __LAPLACE
 #define __LAPLACE
+/* Edge weights of the weighted Laplacian at each pixel: w1, w2, */
+/* w3 and w4 are the weights of the +x, -x, +y and -y neighbors  */
+/* (with the boundary conditions built in).  They are null if    */
+/* the Laplacian is unweighted.                                  */
+typedef struct {
+  int    xsize, ysize;
+  float  *w1, *w2, *w3, *w4;
+} Stencil;
 void ComputeLaplacian(float *phase, float *laplacian, float *dxwts,
                    float *dywts, int xsize, int ysize, int laptype);
 void ComputeDerivWts(float *phase, float *soln, float *dxwts,
                      float *dywts, float *qual_map, double e0,
                      int xsize, int ysize);
+Stencil *AllocateStencil(float *dxwts, float *dywts, int xsize,
+                         int ysize);
+void FreeStencil(Stencil *stencil);
+void SetStencilWeights(Stencil *stencil, float *dxwts, float *dywts);
+float StencilPixel(Stencil *stencil, float *input, int i, int j,
+                   int laptype);
+void StencilLaplacian(Stencil *stencil, float *input,
+                      float *laplacian, int laptype);
+float StencilOperatorPixel(Stencil *stencil, float *p, int i, int j);
+void StencilOperatorRow(Stencil *stencil, float *p, float *out, int j);
 #endif
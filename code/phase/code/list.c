@@ -1,35 +1,377 @@
 /*
- *   list.c -- functions for managing list of pixels to unwrap
+ *   list.c -- functions for managing the queue of pixels to unwrap
  */
 #include <stdio.h>
 #include <math.h>
+#include <malloc.h>
 #include "file.h"
 #include "pi.h"
+#include "util.h"
 #include "list.h"
 #include "grad.h"
 
+/* Allocate a queue of the given kind for an xsize x ysize image. */
+/* qmin and qmax are the range of qualities of a bucket queue     */
+/* (see QualityRange); qualities outside it go to the lowest or   */
+/* highest bucket.                                                */
+PixelQueue *AllocatePixelQueue(QueueKind kind, int xsize, int ysize,
+                               double qmin, double qmax)
+{
+  int         k;
+  PixelQueue  *queue;
+  queue = (PixelQueue *) malloc(sizeof(PixelQueue));
+  if (!queue)
+    ErrorHandler("Cannot allocate memory", "pixel queue",
+                 MEMORY_ALLOCATION_ERROR);
+  queue->kind = kind;
+  queue->size = queue->count = 0;
+  queue->capacity = xsize + ysize;
+  if (queue->capacity < 64) queue->capacity = 64;
+  queue->stack = queue->head = queue->tail = queue->next = NULL;
+  queue->heap = NULL;
+  queue->num_buckets = queue->top = 0;
+  queue->max_size = 0;
+  queue->postponed = NULL;
+  queue->num_postponed = queue->postponed_capacity = 0;
+  queue->reactivations = queue->num_reactivated = 0;
+  queue->qmin = qmin;
+  queue->qscale = 0.0;
+  if (kind==stack_queue) {
+    AllocateInt(&queue->stack, queue->capacity, "pixel queue");
+  }
+  else if (kind==heap_queue) {
+    queue->heap = (QueueEntry *) malloc(queue->capacity
+                                        *sizeof(QueueEntry));
+    if (!queue->heap)
+      ErrorHandler("Cannot allocate memory", "pixel queue",
+                   MEMORY_ALLOCATION_ERROR);
+  }
+  else {
+    queue->num_buckets = QUEUE_BUCKETS;
+    if (qmax > qmin)
+      queue->qscale = (queue->num_buckets - 1)/(qmax - qmin);
+    AllocateInt(&queue->head, queue->num_buckets, "pixel queue");
+    AllocateInt(&queue->tail, queue->num_buckets, "pixel queue");
+    AllocateInt(&queue->next, xsize*ysize, "pixel queue");
+    for (k=0; k<queue->num_buckets; k++)
+      queue->head[k] = queue->tail[k] = -1;
+    queue->top = -1;
+  }
+  return queue;
+}
+
+/* Free the queue and its arrays */
+void FreePixelQueue(PixelQueue *queue)
+{
+  if (!queue) return;
+  if (queue->stack) free(queue->stack);
+  if (queue->heap) free(queue->heap);
+  if (queue->head) free(queue->head);
+  if (queue->tail) free(queue->tail);
+  if (queue->next) free(queue->next);
+  if (queue->postponed) free(queue->postponed);
+  free(queue);
+}
+
+/* Remove all pixels from the queue and the postponed list */
+void ClearPixelQueue(PixelQueue *queue)
+{
+  int  k;
+  if (queue->kind==bucket_queue) {
+    for (k=0; k<=queue->top; k++)
+      queue->head[k] = queue->tail[k] = -1;
+    queue->top = -1;
+  }
+  queue->size = queue->count = 0;
+  queue->num_postponed = 0;
+}
+
+/* Double the number of stack or heap entries */
+void GrowPixelQueue(PixelQueue *queue)
+{
+  queue->capacity *= 2;
+  if (queue->kind==stack_queue) {
+    queue->stack = (int *) realloc(queue->stack,
+                                   queue->capacity*sizeof(int));
+    if (!queue->stack)
+      ErrorHandler("Cannot allocate memory", "pixel queue",
+                   MEMORY_ALLOCATION_ERROR);
+  }
+  else {
+    queue->heap = (QueueEntry *) realloc(queue->heap,
+                              queue->capacity*sizeof(QueueEntry));
+    if (!queue->heap)
+      ErrorHandler("Cannot allocate memory", "pixel queue",
+                   MEMORY_ALLOCATION_ERROR);
+  }
+}
+
+/* Add pixel "index" of the given quality to the queue */
+void PushPixel(PixelQueue *queue, int index, float quality)
+{
+  int         b;
+  QueueEntry  entry;
+  if (queue->kind==bucket_queue) {
+    b = (quality - queue->qmin)*queue->qscale;
+    if (!(b > 0)) b = 0;
+    if (b >= queue->num_buckets) b = queue->num_buckets - 1;
+    queue->next[index] = -1;
+    if (queue->tail[b] < 0) queue->head[b] = index;
+    else queue->next[queue->tail[b]] = index;
+    queue->tail[b] = index;
+    if (b > queue->top) queue->top = b;
+  }
+  else {
+    if (queue->size >= queue->capacity) GrowPixelQueue(queue);
+    if (queue->kind==stack_queue) {
+      queue->stack[queue->size] = index;
+    }
+    else {
+      entry.quality = quality;
+      entry.order = queue->count;
+      entry.index = index;
+      SiftUp(queue->heap, queue->size, entry);
+    }
+  }
+  ++queue->size;
+  ++queue->count;
+}
+
+/* Remove the next pixel from the queue and return its index, */
+/* or -1 if the queue is empty.                               */
+int PopPixel(PixelQueue *queue)
+{
+  int  index;
+  if (queue->size < 1) return -1;
+  --queue->size;
+  if (queue->kind==stack_queue) {
+    index = queue->stack[queue->size];
+  }
+  else if (queue->kind==heap_queue) {
+    /* move the last entry down from the top of the heap */
+    index = queue->heap[0].index;
+    SiftDown(queue->heap, queue->size, 0, queue->heap[queue->size]);
+  }
+  else {
+    while (queue->head[queue->top] < 0) --queue->top;
+    index = queue->head[queue->top];
+    queue->head[queue->top] = queue->next[index];
+    if (queue->head[queue->top] < 0) queue->tail[queue->top] = -1;
+  }
+  return index;
+}
+
+/* Put "entry" in the hole at position i (the bottom) of a heap, */
+/* moving it up until the heap is in order                       */
+void SiftUp(QueueEntry *heap, int i, QueueEntry entry)
+{
+  int  parent;
+  for ( ; i>0; i=parent) {
+    parent = (i - 1)/2;
+    if (!HigherPriority(&entry, &heap[parent])) break;
+    heap[i] = heap[parent];
+  }
+  heap[i] = entry;
+}
+
+/* Put "entry" in the hole at position i of a heap of n entries, */
+/* moving it down until the heap is in order                     */
+void SiftDown(QueueEntry *heap, int n, int i, QueueEntry entry)
+{
+  int  child;
+  for ( ; (child = 2*i + 1) < n; i=child) {
+    if (child + 1 < n && HigherPriority(&heap[child + 1],
+                                        &heap[child]))
+      ++child;
+    if (!HigherPriority(&heap[child], &entry)) break;
+    heap[i] = heap[child];
+  }
+  heap[i] = entry;
+}
+
+/* Reorder the n entries so that the first k of them are the k */
+/* that come out of the queue first                             */
+void SelectHighest(QueueEntry *entry, int n, int k)
+{
+  int         lo, hi, i, j;
+  QueueEntry  pivot, temp;
+  lo = 0;
+  hi = n - 1;
+  while (lo < hi) {
+    pivot = entry[(lo + hi)/2];
+    i = lo;
+    j = hi;
+    while (i <= j) {
+      while (HigherPriority(&entry[i], &pivot)) ++i;
+      while (HigherPriority(&pivot, &entry[j])) --j;
+      if (i <= j) {
+        temp = entry[i];
+        entry[i] = entry[j];
+        entry[j] = temp;
+        ++i;
+        --j;
+      }
+    }
+    if (k <= j) hi = j;
+    else if (k >= i) lo = i;
+    else break;
+  }
+}
+
+/* Return 1 if heap entry p comes out of the queue before q */
+int HigherPriority(QueueEntry *p, QueueEntry *q)
+{
+  return (p->quality > q->quality
+          || (p->quality==q->quality && p->order < q->order));
+}
+
+/* Add pixel "index" to the postponed pixels, unless it is */
+/* there already (i.e., it has the postponed code).  They are */
+/* kept in a heap of their own, highest quality on top.       */
+void PostponePixel(PixelQueue *queue, unsigned char *bitflags,
+                   int index, float quality, int postponed_code)
+{
+  QueueEntry  entry;
+  if (bitflags[index] & postponed_code) return;
+  bitflags[index] |= postponed_code;
+  if (queue->num_postponed >= queue->postponed_capacity) {
+    queue->postponed_capacity = (queue->postponed_capacity > 0)
+                    ? 2*queue->postponed_capacity : queue->capacity;
+    queue->postponed = (QueueEntry *) realloc(queue->postponed,
+                    queue->postponed_capacity*sizeof(QueueEntry));
+    if (!queue->postponed)
+      ErrorHandler("Cannot allocate memory", "postponed pixels",
+                   MEMORY_ALLOCATION_ERROR);
+  }
+  entry.quality = quality;
+  entry.order = queue->count++;
+  entry.index = index;
+  SiftUp(queue->postponed, queue->num_postponed++, entry);
+}
+
+/* The queue has reached its maximum size: postpone the lower  */
+/* half of it (by quality), and raise min_qual to the lowest    */
+/* quality left in the queue, so that pixels of lower quality   */
+/* are postponed when they are found.                           */
+void TrimPixelQueue(PixelQueue *queue, unsigned char *bitflags,
+                    int processed_code, int postponed_code,
+                    float *min_qual)
+{
+  int         i, k, n, keep, index;
+  QueueEntry  *heap;
+  n = 0.50*queue->size;  /* discard 50% */
+  keep = queue->size - n;
+  if (queue->kind==heap_queue) {
+    heap = queue->heap;
+    SelectHighest(heap, queue->size, keep);
+    for (i=keep; i<queue->size; i++) {
+      bitflags[heap[i].index] &= (~processed_code);
+      PostponePixel(queue, bitflags, heap[i].index, heap[i].quality,
+                    postponed_code);
+    }
+    *min_qual = heap[0].quality;
+    for (i=1; i<keep; i++)
+      if (*min_qual > heap[i].quality) *min_qual = heap[i].quality;
+    for (i=keep/2 - 1; i>=0; i--)
+      SiftDown(heap, keep, i, heap[i]);
+  }
+  else {
+    /* discard whole buckets from the bottom */
+    for (k=0, i=0; i<n && k<queue->top; k++) {
+      for (index=queue->head[k]; index>=0; index=queue->next[index]) {
+        bitflags[index] &= (~processed_code);
+        PostponePixel(queue, bitflags, index,
+                      queue->qmin + k/queue->qscale, postponed_code);
+        ++i;
+      }
+      queue->head[k] = queue->tail[k] = -1;
+    }
+    keep = queue->size - i;
+    if (i > 0) *min_qual = queue->qmin + k/queue->qscale;
+  }
+  queue->size = keep;
+}
+
+/* The queue has run empty: move the postponed pixels that have */
+/* not been unwrapped back into it, highest quality first, with */
+/* the unwrapped values already stored in soln.  If the queue   */
+/* size is limited, only enough to fill half of it are moved,   */
+/* and min_qual is set to the lowest quality moved; otherwise   */
+/* all are moved and min_qual is set to lowest_qual.  Returns   */
+/* the number of pixels moved.                                  */
+int ReactivatePixels(PixelQueue *queue, float *soln, float *qual_map,
+                     unsigned char *bitflags, int xsize, int ysize,
+                     int processed_code, int postponed_code,
+                     float *min_qual, float lowest_qual)
+{
+  int    c, num, target;
+  float  lowest;
+  target = (queue->max_size > 0) ? queue->max_size/2 : 0;
+  if (target < 1) target = 1;
+  *min_qual = lowest = lowest_qual;
+  num = 0;
+  while (queue->num_postponed > 0
+             && (queue->max_size <= 0 || queue->size < target)) {
+    c = queue->postponed[0].index;
+    --queue->num_postponed;
+    SiftDown(queue->postponed, queue->num_postponed, 0,
+             queue->postponed[queue->num_postponed]);
+    /* skip it if it was queued again after it was postponed */
+    if (!(bitflags[c] & postponed_code)
+           || (bitflags[c] & processed_code)) continue;
+    bitflags[c] &= (~postponed_code);
+    InsertList(soln, soln[c], qual_map, bitflags, c%xsize, c/xsize,
+               queue, xsize, ysize, processed_code, postponed_code,
+               min_qual);
+    if (num==0 || lowest > qual_map[c]) lowest = qual_map[c];
+    ++num;
+  }
+  if (num > 0 && queue->max_size > 0) *min_qual = lowest;
+  ++queue->reactivations;
+  queue->num_reactivated += num;
+  return num;
+}
+
+/* Range of qualities for a bucket queue.  If dxdy_flag is set, */
+/* UpdateList replaces the qualities by minus the magnitudes of */
+/* the phase gradients, which are at most half a cycle.         */
+void QualityRange(float *qual_map, int xsize, int ysize,
+                  int dxdy_flag, double *qmin, double *qmax)
+{
+  int  k;
+  if (dxdy_flag) {
+    *qmin = -0.5;
+    *qmax = 0.0;
+    return;
+  }
+  *qmin = *qmax = qual_map[0];
+  for (k=1; k<xsize*ysize; k++) {
+    if (*qmin > qual_map[k]) *qmin = qual_map[k];
+    if (*qmax < qual_map[k]) *qmax = qual_map[k];
+  }
+}
+
 /* Returns 0 if no pixels left, 1 otherwise */
-int GetNextOneToUnwrap(int *a, int *b, int *index_list,
-                       int *num_index, int xsize, int ysize)
+int GetNextOneToUnwrap(int *a, int *b, PixelQueue *queue,
+                       int xsize, int ysize)
 {
   int index;
-  if (*num_index < 1) 
-    return 0;   /* return if list empty */
-  index = index_list[*num_index - 1];
+  index = PopPixel(queue);
+  if (index < 0)
+    return 0;   /* return if queue empty */
   *a = index%xsize;
   *b = index/xsize;
-  --(*num_index);
   return 1;
 }
 
-/* Insert new pixel into the list.  */
+/* Insert new pixel into the queue. */
 /* Note: qual_map can be NULL       */
 void InsertList(float *soln, float val, float *qual_map, 
-           unsigned char *bitflags, int a, int b, int *index_list,
-           int *num_index, int xsize, int ysize, int processed_code,
-           int postponed_code, float *min_qual, int max_list_size)
+           unsigned char *bitflags, int a, int b, PixelQueue *queue,
+           int xsize, int ysize, int processed_code,
+           int postponed_code, float *min_qual)
 {
-  int i, n, index, top, bot, mid;
+  int     index;
   double  quality;
 
   index = b*xsize + a;
@@ -43,75 +385,30 @@ void InsertList(float *soln, float val, float *qual_map,
   }
   /* if quality is too low, postpone it */
   if (qual_map && min_qual && quality < *min_qual) {
-    bitflags[index] |= postponed_code;
+    PostponePixel(queue, bitflags, index, quality, postponed_code);
     return;
   }
-  /* otherwise, add to list */
-  if (!qual_map) {   /* don't order if qual_map is NULL */
-    index_list[*num_index] = index;
-    ++(*num_index);
-  }
-  else {
-    /* insert in list in order from lowest to highest quality */
-    n = *num_index;
-    if (n < 1) {
-      (*num_index) = 0;   /* will be incremented below */
-      index_list[0] = index;
-    }
-    else {
-      if (quality <= qual_map[index_list[0]]) {
-        /* insert at top of list */
-        for (i=n; i>0; i--) 
-          index_list[i] = index_list[i-1];
-        index_list[0] = index;
-      }
-      else if (quality > qual_map[index_list[n - 1]]) {
-        /* insert at bottom */
-        index_list[n] = index;
-      }
-      else {   /* insert in middle */
-        top = 0;
-        bot = n - 1;
-        while (bot - top > 1) {
-          mid = (top + bot)/2;
-          if (quality <= qual_map[index_list[mid]])  bot = mid;
-          else  top = mid;
-        }
-        for (i=n; i>top+1; i--) 
-          index_list[i] = index_list[i-1];
-        index_list[top+1] = index;
-      }
-    }
-    ++(*num_index);
-  }
+  /* otherwise, add to queue */
+  PushPixel(queue, index, quality);
   bitflags[index] |= processed_code;
   bitflags[index] &= (~postponed_code);
 
-  /* trim list if it's too big, and increase the quality */
-  if (qual_map && min_qual 
-          && max_list_size > 0 && *num_index >= max_list_size) {
-    n = 0.50*(*num_index);  /* discard 50% */
-    for (i=0; i<n; i++) {
-      bitflags[index_list[i]] |= postponed_code;
-      bitflags[index_list[i]] &= (~processed_code);
-    }
-    for (i=0; i<*num_index - n; i++)
-      index_list[i] = index_list[i + n];
-    *num_index -= n;
-    *min_qual = qual_map[index_list[0]];
-  }
-
+  /* trim queue if it's too big, and increase the quality */
+  if (qual_map && min_qual && queue->kind!=stack_queue
+          && queue->max_size > 0 && queue->size >= queue->max_size)
+    TrimPixelQueue(queue, bitflags, processed_code, postponed_code,
+                   min_qual);
   return;
 }
 
 /* Insert the four neighboring pixels of the given pixel */
-/* (x,y) into the list.  The quality value of the given  */
+/* (x,y) into the queue.  The quality value of the given */
 /* pixel is "val".                                       */
 void UpdateList(float *qual_map, int x, int y, float val,
          float *phase, float *soln, unsigned char *bitflags,
-         int xsize, int ysize, int *index_list, int *num_index,
-         int ignore_code, int processed_code, int postponed_code, 
-         int max_list_size, int dxdy_flag, float *min_qual)
+         int xsize, int ysize, PixelQueue *queue, int ignore_code,
+         int processed_code, int postponed_code, int dxdy_flag,
+         float *min_qual)
 {
   int    i, a, b, k, w;
   float  grad;
@@ -126,8 +423,8 @@ void UpdateList(float *qual_map, int x, int y, float val,
     if (dxdy_flag && qual_map)
       qual_map[k] = -fabs(grad);
     InsertList(soln, val + grad, qual_map, bitflags, a, b,
-               index_list, num_index, xsize, ysize, processed_code,
-               postponed_code, min_qual, max_list_size);
+               queue, xsize, ysize, processed_code, postponed_code,
+               min_qual);
   }
 
   a = x + 1;
@@ -140,8 +437,8 @@ void UpdateList(float *qual_map, int x, int y, float val,
     if (dxdy_flag && qual_map)
       qual_map[k] = -fabs(grad);
     InsertList(soln, val + grad, qual_map, bitflags, a, b,
-               index_list, num_index, xsize, ysize, processed_code,
-               postponed_code, min_qual, max_list_size);
+               queue, xsize, ysize, processed_code, postponed_code,
+               min_qual);
   }
 
   a = x;
@@ -154,8 +451,8 @@ void UpdateList(float *qual_map, int x, int y, float val,
     if (dxdy_flag && qual_map) 
       qual_map[k] = -fabs(grad);
     InsertList(soln, val + grad, qual_map, bitflags, a, b,
-               index_list, num_index, xsize, ysize, processed_code,
-               postponed_code, min_qual, max_list_size);
+               queue, xsize, ysize, processed_code, postponed_code,
+               min_qual);
   }
 
   a = x;
@@ -167,7 +464,7 @@ void UpdateList(float *qual_map, int x, int y, float val,
     grad = - Gradient(phase[w], phase[w+xsize]);
     if (dxdy_flag && qual_map) qual_map[k] = -fabs(grad);
     InsertList(soln, val + grad, qual_map, bitflags, a, b,
-               index_list, num_index, xsize, ysize, processed_code, 
-               postponed_code, min_qual, max_list_size);
+               queue, xsize, ysize, processed_code, postponed_code,
+               min_qual);
   }
 }
@@ -10,17 +10,77 @@
 #define POSTPONED   0x80   /* 8th bit */
 #define RESIDUE      (POS_RES | NEG_RES)
 #define AVOID        (BRANCH_CUT | BORDER)
-int GetNextOneToUnwrap(int *a, int *b, int *index_list,
-                       int *num_index, int xsize, int ysize);
+/* quality levels of a bucket queue */
+#define QUEUE_BUCKETS  4096
+/* Order in which the queue hands out the pixels to unwrap: last */
+/* in first out (stack), highest quality first (heap), or highest */
+/* quality first to within 1/QUEUE_BUCKETS of the quality range   */
+/* (bucket).  Pixels of equal quality (or in the same bucket) are */
+/* handed out in the order they were added.                       */
+typedef enum {
+  stack_queue, heap_queue, bucket_queue
+} QueueKind;
+/* heap entry */
+typedef struct {
+  float  quality;
+  int    order;          /* number of pixels added before it */
+  int    index;          /* pixel index */
+} QueueEntry;
+/* Queue of pixels waiting to be unwrapped.  The stack and heap */
+/* grow as needed, so the queue can hold any number of pixels,  */
+/* unless max_size is set.  Then the lower half of a full queue */
+/* is postponed, and so are pixels of lower quality than the    */
+/* rest, until the queue runs empty and they are reactivated    */
+/* (see ReactivatePixels).                                      */
+typedef struct {
+  QueueKind   kind;
+  int         size;          /* number of pixels in the queue */
+  int         max_size;      /* 0 if the size is not limited */
+  int         capacity;      /* stack or heap entries allocated */
+  int         count;         /* number of pixels added */
+  int         *stack;
+  QueueEntry  *heap;
+  int         num_buckets, top;   /* top: highest nonempty bucket */
+  double      qmin, qscale;       /* bucket = (quality - qmin)*qscale */
+  int         *head, *tail;  /* first and last pixel of each bucket */
+  int         *next;         /* next pixel in the same bucket */
+  QueueEntry  *postponed;     /* heap of postponed pixels */
+  int         num_postponed, postponed_capacity;
+  int         reactivations;     /* times postponed pixels were */
+  int         num_reactivated;   /* put back, and their number  */
+} PixelQueue;
+PixelQueue *AllocatePixelQueue(QueueKind kind, int xsize, int ysize,
+                               double qmin, double qmax);
+void FreePixelQueue(PixelQueue *queue);
+void ClearPixelQueue(PixelQueue *queue);
+void GrowPixelQueue(PixelQueue *queue);
+void PushPixel(PixelQueue *queue, int index, float quality);
+int PopPixel(PixelQueue *queue);
+void SiftUp(QueueEntry *heap, int i, QueueEntry entry);
+void SiftDown(QueueEntry *heap, int n, int i, QueueEntry entry);
+void SelectHighest(QueueEntry *entry, int n, int k);
+int HigherPriority(QueueEntry *p, QueueEntry *q);
+void PostponePixel(PixelQueue *queue, unsigned char *bitflags,
+                   int index, float quality, int postponed_code);
+void TrimPixelQueue(PixelQueue *queue, unsigned char *bitflags,
+                    int processed_code, int postponed_code,
+                    float *min_qual);
+int ReactivatePixels(PixelQueue *queue, float *soln, float *qual_map,
+                     unsigned char *bitflags, int xsize, int ysize,
+                     int processed_code, int postponed_code,
+                     float *min_qual, float lowest_qual);
+void QualityRange(float *qual_map, int xsize, int ysize,
+                  int dxdy_flag, double *qmin, double *qmax);
+int GetNextOneToUnwrap(int *a, int *b, PixelQueue *queue,
+                       int xsize, int ysize);
 void UpdateList(float *qual_map, int x, int y, float val,
                 float *phase, float *soln, unsigned char *bitflags,
-                int xsize, int ysize, int *index_list,
-                int *num_index, int ignore_code, int processed_code,
-                int postponed_code, int max_list_size, 
-                int dxdy_flag, float *min_qual);
+                int xsize, int ysize, PixelQueue *queue,
+                int ignore_code, int processed_code,
+                int postponed_code, int dxdy_flag, float *min_qual);
 void InsertList(float *soln, float val, float *qual_map,
                 unsigned char *bitflags, int a, int b,
-                int *index_list, int *num_index, int xsize,
-                int ysize, int processed_code, int postponed_code,
-                float *min_qual, int max_list_size);
+                PixelQueue *queue, int xsize, int ysize,
+                int processed_code, int postponed_code,
+                float *min_qual);
 #endif
@@ -15,33 +15,48 @@
 #define BORDER       0x20
 #define ZERO_WEIGHT  0x40
 
-/* Main iteration of minimum Lp-norm phase unwrapping algorithm */
+/* Main iteration of minimum Lp-norm phase unwrapping algorithm. */
+/* The cosine transform plan is shared by all the PCG solutions.  */
+/* If mg_precond is nonzero, the PCG solutions are preconditioned */
+/* by a weighted multigrid V-cycle instead (and plan may be null). */
 void LpNormUnwrap(float *soln, float *phase, float *dxwts,
              float *dywts, unsigned char *bitflags, float *qual_map,
              float *rarray, float *zarray, float *parray, int iter,
-             int pcg_iter, double e0, int xsize, int ysize) 
+             int pcg_iter, double e0, int xsize, int ysize,
+             CosinePlan *plan, int mg_precond) 
 {
   int  i, j, k, n;
   float  *residual;
+  Stencil  *stencil;
+  MgPrecond  *precond=NULL;
   residual = rarray;  /* borrow rarray to compute the residual */
   ResidualPhase(residual, phase, soln, xsize, ysize);
   n = Residues(residual, bitflags, POS_RES, NEG_RES, 
                BORDER, xsize, ysize);
+  /* the stencil weights are reset from dxwts and dywts each iter. */
+  stencil = AllocateStencil(dxwts, dywts, xsize, ysize);
+  if (mg_precond)
+    precond = AllocateMgPrecond(dxwts, dywts, xsize, ysize,
+                                MG_PRECOND_SWEEPS, 0);
   for (k=0; k<iter && n>0; k++) {
     printf("\nIter %d: %d residues\n", k+1, n);
     ComputeDerivWts(phase, soln, dxwts, dywts, qual_map, e0,
                     xsize, ysize);
-    ComputeLaplacian(phase, rarray, dxwts, dywts, xsize, ysize, 1);
+    SetStencilWeights(stencil, dxwts, dywts);
+    if (precond) SetMgPrecondWeights(precond, dxwts, dywts);
+    StencilLaplacian(stencil, phase, rarray, 1);
     /* borrow zarray temporarily to compute Laplacian of soln */
-    ComputeLaplacian(soln, zarray, dxwts, dywts, xsize, ysize, 0);
+    StencilLaplacian(stencil, soln, zarray, 0);
     for (i=0; i<xsize*ysize; i++) rarray[i] -= zarray[i];
-    PCGUnwrap(rarray, zarray, parray, soln, dxwts, dywts,
-              xsize, ysize, pcg_iter, 0.0);
+    PCGUnwrap(rarray, zarray, parray, soln, stencil,
+              xsize, ysize, pcg_iter, 0.0, plan, precond);
     ResidualPhase(residual, phase, soln, xsize, ysize);
     for (i=0; i<xsize*ysize; i++) bitflags[i] &= ~(POS_RES | NEG_RES);
     n = Residues(residual, bitflags, POS_RES, NEG_RES, 
                  BORDER, xsize, ysize);
   }
+  FreeMgPrecond(precond);
+  FreeStencil(stencil);
   printf("%d residues after %d iter.  Processing residual...\n", 
          n, k);
   /* see if the entire nonmasked array is residue-free */
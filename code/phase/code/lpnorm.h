@@ -1,9 +1,11 @@
 #ifndef __LPNORM
 #define __LPNORM
+#include "dct.h"
 void LpNormUnwrap(float *soln, float *phase, float *dxwts, 
           float *dywts, unsigned char *bitflags, float *qual_map, 
           float *rarray, float *zarray, float *parray, int iter,
-          int pcg_iter, double e0, int xsize, int ysize);
+          int pcg_iter, double e0, int xsize, int ysize,
+          CosinePlan *plan, int mg_precond);
 void RasterUnwrap(float *phase, float *soln, int xsize, int ysize);
 void ResidualPhase(float *resid, float *phase, float *soln,
                    int xsize, int ysize);
@@ -2,10 +2,10 @@
  * mainflyn.c -- phase unwrapping by Flynn's min discontinuity alg.
  *
  * Source code files required:
- *     dxdygrad.c     extract.c       flynn.c     getqual.c
- *         grad.c       histo.c    mainflyn.c     maskfat.c
- *     qualgrad.c    qualpseu.c     qualvar.c       trees.c
- *         util.c
+ *     dxdygrad.c     extract.c       flynn.c    flyntile.c
+ *      getqual.c        grad.c       histo.c    mainflyn.c
+ *      maskfat.c        pool.c    qualgrad.c    qualpseu.c
+ *      qualvar.c       seams.c       trees.c        util.c
  */
 #include <stdio.h>
 #include <math.h>
@@ -17,18 +17,18 @@
 #include "extract.h"
 #include "getqual.h"
 #include "flynn.h"
+#include "flyntile.h"
+#include "pool.h"
 #define BORDER  (0x20)
 
 main (int argc, char *argv[])
 {
-  int            i, j, k, tsize;
+  int            k, tsize;
   FILE           *ifp, *ofp, *mfp=0, *qfp=0;
   float          *phase;     /* array */ 
   float          *qual_map;  /* array */
   unsigned char  *bitflags;  /* array */
-  short          *hjump;     /* array */
-  short          *vjump;     /* array */
-  int            *value;     /* array */
+  FlynnNode      *nodes;     /* array */
   char           buffer[200], tempstr[200];
   char           infile[200], outfile[200];
   char           bmaskfile[200], qualfile[200];
@@ -36,6 +36,8 @@ main (int argc, char *argv[])
   int            in_format, debug_flag;
   int            xsize, ysize;   /* dimensions of arrays */ 
   int            avoid_code, thresh_flag, fatten, guess_mode;
+  int            tile_size, overlap, num_threads;
+  ThreadPool     *pool;
   UnwrapMode     mode;
   double         rmin, rmax, rscale, one_over_twopi = 1.0/TWOPI;
   /* define "use" statement */
@@ -43,7 +45,7 @@ main (int argc, char *argv[])
     "Usage: program-name -input file -format fkey -output file\n"
     "  -xsize x -ysize y [ -mode mkey -bmask file -corr file\n"
     "  -tsize size -debug yes/no -thresh yes/no -fat n\n"
-    "  -guess yes/no]\n"
+    "  -guess yes/no -tile size -overlap n -threads nt]\n"
     "where 'fkey' is a keyword designating the input file type\n"
     "(key = complex8, complex4, float or byte), 'x' and 'y' are\n"
     "the dimensions of the file, bmask is an optional byte-file\n"
@@ -67,7 +69,12 @@ main (int argc, char *argv[])
     "number of pixels by which to thicken.  If the 'guess'\n"
     "parameter is yes, then the input file must be a floating\n"
     "point array that represents an intermediate solution.\n"
-    "This solution must be congruent to the wrapped phase.\n";
+    "This solution must be congruent to the wrapped phase.\n"
+    "If the tile size is given, the algorithm is first run on\n"
+    "tiles of that size that overlap by 'n' pixels on each side\n"
+    "(default 32), among 'nt' threads (default 1).  The tiles\n"
+    "are merged by their seams into an intermediate solution,\n"
+    "which the algorithm then finishes on the whole image.\n";
 
   printf("Phase Unwrapping by Flynn's Min. Discontinuity Method\n");
 
@@ -96,6 +103,13 @@ main (int argc, char *argv[])
   if (!CommandLineParm(argc, argv, "-guess", StringParm,
         tempstr, 0, use)) guess_mode = 0;
   else guess_mode = Keyword(tempstr, "yes");
+  if (!CommandLineParm(argc, argv, "-tile", IntegerParm,
+        &tile_size, 0, use)) tile_size = 0;
+  if (!CommandLineParm(argc, argv, "-overlap", IntegerParm,
+        &overlap, 0, use)) overlap = FLYNN_OVERLAP;
+  if (!CommandLineParm(argc, argv, "-threads", IntegerParm,
+        &num_threads, 0, use)) num_threads = 1;
+  if (num_threads < 1) num_threads = 1;
 
   if (Keyword(format, "complex8"))  in_format = 0;
   else if (Keyword(format, "complex4"))  in_format = 1;
@@ -127,6 +141,13 @@ main (int argc, char *argv[])
       exit(BAD_PARAMETER);
     }
   }
+  if (tile_size < 0 || overlap < 1) {
+    fprintf(stderr, "Illegal tile size or overlap\n");
+    exit(BAD_PARAMETER);
+  }
+  if (tile_size > 0)
+    printf("Tile size = %d, overlap = %d, threads = %d\n", tile_size,
+           overlap, num_threads);
   mode = SetQualityMode(modekey, qualfile, 1);
   if (mode < 0) exit(BAD_PARAMETER);  /* error msg already printed */
 
@@ -139,11 +160,8 @@ main (int argc, char *argv[])
   if (!Keyword(bmaskfile, "none")) OpenFile(&mfp, bmaskfile, "r");
   if (mode==corr_coeffs) OpenFile(&qfp, qualfile, "r");
   AllocateFloat(&phase, xsize*ysize, "phase data");
-  AllocateByte(&bitflags, (xsize+1)*(ysize+1), "bitflags array");
+  AllocateByte(&bitflags, xsize*ysize, "bitflags array");
   AllocateFloat(&qual_map, xsize*ysize, "quality map");
-  AllocateShort(&hjump, (xsize+1)*(ysize+1), "hjump array");
-  AllocateShort(&vjump, (xsize+1)*(ysize+1), "vjump array");
-  AllocateInt(&value, (xsize+1)*(ysize+1), "value array");
 
   /*  READ AND PROCESS DATA  */
   if (guess_mode) {
@@ -192,19 +210,23 @@ main (int argc, char *argv[])
                      0, 0, 0);
   }
 
-  /* embed bitflags array in larger array for use by Flynn's routines */
-  for (j=ysize - 1; j>=0; j--) {
-    for (i=xsize - 1; i>=0; i--) {
-      bitflags[j*(xsize+1) + i] = bitflags[j*xsize + i];
-    }
-  }
-  for (j=0; j<=ysize; j++) bitflags[j*(xsize + 1) + xsize] = 0;
-  for (i=0; i<=xsize; i++) bitflags[ysize*(xsize + 1) + i] = 0;
+  /* the mask is passed to Flynn's routines in the quality map */
+  free(bitflags);
+  nodes = AllocateFlynnNodes(xsize, ysize);
 
   /*  UNWRAP  */
   printf("Unwrapping...\n");
-  FlynnMinDisc(phase, value, bitflags, qual_map, vjump, hjump,
-               xsize, ysize);
+  if (tile_size > 0) {
+    pool = AllocateThreadPool(num_threads);
+    TiledFlynnGuess(phase, qual_map, xsize, ysize, tile_size, overlap,
+                    pool);
+    FreeThreadPool(pool);
+    printf("%d discontinuities in the tiled solution\n",
+           Discontinuities(phase, xsize, ysize));
+    printf("Removing the discontinuities along the seams...\n");
+  }
+  FlynnMinDisc(phase, nodes, qual_map, xsize, ysize, 1);
+  printf("%d discontinuities\n", Discontinuities(phase, xsize, ysize));
   printf("\nFinished\n");
   PrintMinAndMax(xsize, ysize, phase, "solution");
 
@@ -214,9 +236,6 @@ main (int argc, char *argv[])
   printf("Saving unwrapped surface to file '%s'\n", outfile);
   WriteFloat(ofp, phase, xsize*ysize, outfile);
   free(phase);
-  free(bitflags);
+  free(nodes);
   if (qual_map) free(qual_map);
-  free(hjump);
-  free(vjump);
-  free(value);
 }
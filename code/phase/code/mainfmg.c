@@ -5,8 +5,8 @@
  *     congruen.c    dxdygrad.c     extract.c         fmg.c
  *      getqual.c        grad.c        grid.c     gridmem.c
  *      gridops.c       histo.c     mainfmg.c     maskfat.c
- *     qualgrad.c    qualpseu.c     qualvar.c       relax.c
- *         util.c
+ *         pool.c    qualgrad.c    qualpseu.c     qualvar.c
+ *        relax.c        util.c
  */
 #include <stdio.h>
 #include <math.h>
@@ -19,6 +19,7 @@
 #include "util.h"
 #include "extract.h"
 #include "fmg.h"
+#include "relax.h"
 #define BORDER           0x20
 #define DEFAULT_NUM_ITER    2
 #define DEFAULT_NUM_CYCLES  2
@@ -35,20 +36,23 @@ main (int argc, char *argv[])
   unsigned char  *bitflags;
   char           buffer[200], tempstr[200];
   char           infile[200], outfile[200];
-  char           bmaskfile[200], qualfile[200];
+  char           bmaskfile[200], qualfile[200], histfile[200];
   char           format[200], modekey[200];
   int            in_format, debug_flag;
   int            xsize, ysize;   /* dimensions of arrays */ 
   int            avoid_code, thresh_flag, fatten, tsize;
   int            num_iter=DEFAULT_NUM_ITER;
   int            num_cycles=DEFAULT_NUM_CYCLES;
+  int            num_threads;
+  double         tol=0.0, *history=NULL;
+  GridArena      *arena;
   double         rmin, rmax, rscale, one_over_twopi = 1.0/TWOPI;
   UnwrapMode     mode;
   char           use[] =   /* define usage statement */
     "Usage: prog-name -input file -format fkey -output file\n"
     "  -xsize x -ysize y [ -mode mkey -bmask file -corr file\n"
     "  -tsize size -debug yes/no -cycles numc -iter num\n"
-    "  -thresh yes/no -fat n ]\n"
+    "  -thresh yes/no -fat n -tol t -history file -threads nt ]\n"
     "where 'fkey' is a keyword designating the input file type\n"
     "(key = complex8, complex4, float or byte), 'x' and 'y' are\n"
     "the dimensions of the file, bmask is an optional byte-file\n"
@@ -71,7 +75,15 @@ main (int argc, char *argv[])
     "matic threshold to the quality map in order to produce\n"
     "a quality mask, the 'thresh' parm should be yes.  To\n"
     "thicken the quality mask, the 'fat' parm should be the\n"
-    "number of pixels by which to thicken.\n";
+    "number of pixels by which to thicken.  If 't' is given,\n"
+    "the cycles stop as soon as a cycle changes the solution by\n"
+    "at most 't' (rms of the change relative to rms of the\n"
+    "solution).  The weighted residual relative to that of the\n"
+    "zero solution after each cycle is saved to the comma-\n"
+    "separated 'history' file if one is given.  The residual\n"
+    "levels off at a floor that depends on the data, so it is\n"
+    "not used for stopping.  The relaxation sweeps are split\n"
+    "among 'nt' threads (default 1).\n";
 
   printf("Phase Unwrapping by Weighted Multigrid Algorithm\n");
       
@@ -98,6 +110,12 @@ main (int argc, char *argv[])
   CommandLineParm(argc, argv, "-cycles", IntegerParm, &num_cycles,
                   0, use);
   if (num_cycles < 0) num_cycles = 1;
+  CommandLineParm(argc, argv, "-tol", DoubleParm, &tol, 0, use);
+  if (!CommandLineParm(argc, argv, "-history", StringParm, histfile,
+        0, use)) strcpy(histfile, "none");
+  if (!CommandLineParm(argc, argv, "-threads", IntegerParm,
+        &num_threads, 0, use)) num_threads = 1;
+  if (num_threads < 1) num_threads = 1;
   if (!CommandLineParm(argc, argv, "-thresh", StringParm, tempstr,
         0, use)) thresh_flag = 0;
   else thresh_flag = Keyword(tempstr, "yes");
@@ -200,8 +218,17 @@ main (int argc, char *argv[])
   DxPhaseGradient(phase, dx, xsize, ysize);
   DyPhaseGradient(phase, dy, xsize, ysize);
   for (k=0; k<xsize*ysize; k++)  soln[k] = 0.0;
-  MultigridUnwrap(soln, dx, dy, qual_map, NULL, xsize, ysize,
-                  num_cycles, num_iter);
+  if (!Keyword(histfile, "none"))
+    AllocateDouble(&history, num_cycles, "residual history");
+  arena = AllocateGridArena(xsize, ysize, COARSEST_DIM, 1, num_threads);
+  n = MultigridUnwrap(soln, dx, dy, qual_map, NULL, xsize, ysize,
+                      num_cycles, num_iter, tol, history, arena);
+  FreeGridArena(arena);
+  if (history) {
+    printf("Saving residual history to %s\n", histfile);
+    WriteResidualHistory(histfile, history, n);
+    free(history);
+  }
   printf("\nFinished\n");
   PrintMinAndMax(xsize, ysize, soln, "solution");
 
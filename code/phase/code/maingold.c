@@ -14,6 +14,7 @@
 #include "util.h"
 #include "extract.h"
 #include "list.h"
+#include "brcut.h"
 #include "gold.h"
 #include "dipole.h"
 
@@ -24,6 +25,7 @@ main (int argc, char *argv[])
   float          *phase;     /* array */ 
   float          *soln;      /* array */
   unsigned char  *bitflags;
+  CutPlane       *plane;
   char           buffer[200], string[200];
   char           infile[200], outfile[200];
   char           maskfile[200], tempstr[200], format[200];
@@ -129,8 +131,10 @@ main (int argc, char *argv[])
   }
 
   /*  GENERATE BRANCH CUTS  */
+  plane = AllocateCutPlane(xsize, ysize);
   if (dipole_flag) {  /* elimate dipole-residues first */
-    Dipole(bitflags, xsize, ysize, BRANCH_CUT);
+    Dipole(bitflags, xsize, ysize, plane);
+    ApplyCutPlane(plane, bitflags, BRANCH_CUT);
     i = Residues(phase, bitflags, 0, 0, BORDER | BRANCH_CUT,
                  xsize, ysize);
     printf("%d Residues are left\n", i);
@@ -138,7 +142,8 @@ main (int argc, char *argv[])
 
   if (MaxCutLen==0) MaxCutLen = (xsize + ysize)/2;
   GoldsteinBranchCuts(bitflags, MaxCutLen, NumRes, xsize, ysize,
-                      BRANCH_CUT);
+                      plane);
+  ApplyCutPlane(plane, bitflags, BRANCH_CUT);
   if (debug_flag) {
     char filename[300];
     sprintf(filename, "%s.brc", outfile);
@@ -147,9 +152,8 @@ main (int argc, char *argv[])
   }
 
   /*  UNWRAP AROUND CUTS */
-  for (k=0, i=0; i<xsize*ysize; i++) 
-    if (bitflags[i] & BRANCH_CUT) k++;
-  printf("%d BRANCH CUT PIXELS\n", k);
+  printf("%d BRANCH CUT PIXELS\n", CountCutPixels(plane));
+  FreeCutPlane(plane);
   printf("Unwrapping around branch cuts\n");
   k = UnwrapAroundCuts(phase, bitflags, soln, xsize, ysize, AVOID,
                        0, NULL);
@@ -3,10 +3,11 @@
  *
  * Source code files required:
  *     congruen.c         dct.c    dxdygrad.c     extract.c
- *      getqual.c        grad.c       histo.c     laplace.c
- *       lpnorm.c    mainlpno.c     maskfat.c         pcg.c
- *     qualgrad.c    qualpseu.c     qualvar.c      raster.c
- *     residues.c     solncos.c        util.c
+ *      getqual.c        grad.c     gridops.c       histo.c
+ *      laplace.c      lpnorm.c    mainlpno.c     maskfat.c
+ *     mgprecon.c         pcg.c        pool.c    qualgrad.c
+ *     qualpseu.c     qualvar.c      raster.c    residues.c
+ *      solncos.c        util.c
  */
 #include <stdio.h>
 #include <math.h>
@@ -38,7 +39,7 @@ main (int argc, char *argv[])
   float          *dxwts;     /* array */
   float          *dywts;     /* array */
   unsigned char  *bitflags;
-  double         *xcos, *ycos;
+  CosinePlan     *plan;      /* cosine transform tables */
   char           buffer[200], tempstr[200];
   char           infile[200], outfile[200];
   char           bmaskfile[200], qualfile[200];
@@ -49,6 +50,7 @@ main (int argc, char *argv[])
   int            avoid_code, thresh_flag, fatten, tsize;
   int            num_iter=DEFAULT_NUM_ITER;
   int            pcg_iter=DEFAULT_PCG_ITER;
+  int            num_threads, mg_precond;
   double         rmin, rmax, rscale, e0=DEFAULT_E0;
   double         one_over_twopi = 1.0/TWOPI;
   UnwrapMode     mode;
@@ -56,7 +58,7 @@ main (int argc, char *argv[])
     "Usage: prog-name -input file -format fkey -output file\n"
     "  -xsize x -ysize y [ -mode mkey -bmask file -corr file\n"
     "  -tsize size -debug yes/no -iter num -pcg_iter nump\n"
-    "  -e0 e0val -thresh yes/no -fat n ]\n"
+    "  -e0 e0val -thresh yes/no -fat n -threads nt -precond pkey ]\n"
     "where 'fkey' is a keyword designating the input file type\n"
     "(key = complex8, complex4, float or byte), 'x' and 'y' are\n"
     "the dimensions of the file, bmask is an optional byte-file\n"
@@ -72,11 +74,20 @@ main (int argc, char *argv[])
     "is a raster file of elevation values of the unwrapped\n"
     "surface.  If the 'debug' parm is 'yes', then intermediate\n"
     "byte-files are saved.  The maximum number of iterations is\n"
-    "'num', and the number of PCG iterations is 'nump'.  The\n"
-    "normalization parameter is 'e0'.  To apply an automatic\n"
-    "threshold to the quality map, the 'thresh' parm should be\n"
-    "yes.  To thicken the quality mask, the 'fat' parm should be\n"
-    "the number of pixels by which to fatten it.\n";
+    "'num', and the number of PCG iterations is 'nump'.  With\n"
+    "either preconditioner, the PCG iterations also stop early\n"
+    "if their residual rises to 10 times its lowest value (as it\n"
+    "can once it reaches round-off level), and the solution of\n"
+    "the lowest residual is kept.  The normalization parameter\n"
+    "is 'e0'.  To apply an automatic threshold to the quality\n"
+    "map, the 'thresh' parm should be yes.  To thicken the\n"
+    "quality mask, the 'fat' parm should be the number of\n"
+    "pixels by which to fatten it.  The cosine transforms are\n"
+    "split among 'nt' threads (default 1).  The PCG precondi-\n"
+    "tioner 'pkey' may be 'dct' for the unweighted cosine\n"
+    "transform solution (default) or 'mg' for a weighted\n"
+    "multigrid V-cycle, which is single-threaded ('nt' must\n"
+    "then be 1).\n";
   
   printf("Phase Unwrapping by Minimum Lp Norm Algorithm\n");
   
@@ -102,6 +113,21 @@ main (int argc, char *argv[])
   else thresh_flag = Keyword(tempstr, "yes");
   if (!CommandLineParm(argc, argv, "-fat", IntegerParm,
         &fatten, 0, use)) fatten = 0;
+  if (!CommandLineParm(argc, argv, "-threads", IntegerParm,
+        &num_threads, 0, use)) num_threads = 1;
+  if (num_threads < 1) num_threads = 1;
+  if (!CommandLineParm(argc, argv, "-precond", StringParm,
+        tempstr, 0, use)) strcpy(tempstr, "dct");
+  mg_precond = Keyword(tempstr, "mg");
+  if (!mg_precond && !Keyword(tempstr, "dct")) {
+    fprintf(stderr, "Unrecognized preconditioner: %s\n", tempstr);
+    exit(BAD_PARAMETER);
+  }
+  if (mg_precond && num_threads > 1) {
+    fprintf(stderr, "The mg preconditioner is single-threaded: "
+            "-threads must be 1 with -precond mg\n");
+    exit(BAD_PARAMETER);
+  }
   CommandLineParm(argc, argv, "-iter", IntegerParm, &num_iter,
                   0, use);
   if (num_iter < 0) num_iter = 1;
@@ -142,15 +168,11 @@ main (int argc, char *argv[])
   mode = SetQualityMode(modekey, qualfile, 1);
   if (mode < 0) exit(BAD_PARAMETER);  /* error msg already printed */
 
-  /* Increase dimensions to power of two (plus one) */
+  /* Increase dimensions to the nearest fast DCT sizes */
   xsize_actual = xsize;
   ysize_actual = ysize;
-  for (xsize_dct = 1; xsize_dct+1 < xsize_actual; xsize_dct*=2)
-    ;
-  xsize_dct+=1;
-  for (ysize_dct = 1; ysize_dct+1 < ysize_actual; ysize_dct*=2)
-    ;
-  ysize_dct+=1;
+  xsize_dct = (mg_precond) ? xsize : DctSize(xsize);
+  ysize_dct = (mg_precond) ? ysize : DctSize(ysize);
   if (xsize_dct != xsize_actual || ysize_dct != ysize_actual) {
     printf("Dimensions increase from %dx%d to %dx%d for FFT's\n",
            xsize_actual, ysize_actual, xsize_dct, ysize_dct);
@@ -252,12 +274,15 @@ main (int argc, char *argv[])
   AllocateFloat(&parray, xsize*ysize, "p array data");
   AllocateFloat(&dxwts, xsize*ysize, "dx weights");
   AllocateFloat(&dywts, xsize*ysize, "dy weights");
+  plan = (mg_precond) ? NULL
+                      : AllocateCosinePlan(xsize, ysize, num_threads);
 
   /*  UNWRAP  */
   for (k=0; k<xsize*ysize; k++) soln[k] = 0.0;
   printf("Unwrapping...\n");
   LpNormUnwrap(soln, phase, dxwts, dywts, bitflags, qual_map,
-    rarray, zarray, parray, num_iter, pcg_iter, e0, xsize, ysize);
+    rarray, zarray, parray, num_iter, pcg_iter, e0, xsize, ysize,
+    plan, mg_precond);
   printf("\nFinished\n");
   PrintMinAndMax(xsize, ysize, soln, "solution");
 
@@ -280,4 +305,5 @@ main (int argc, char *argv[])
   free(bitflags);
   free(dxwts);
   free(dywts);
+  FreeCosinePlan(plan);
 }
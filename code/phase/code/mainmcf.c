@@ -0,0 +1,229 @@
+/*
+ * mainmcf.c -- phase unwrapping by minimum cost flow
+ *
+ * Source code files required:
+ *     dxdygrad.c     extract.c     getqual.c        grad.c
+ *        histo.c     mainmcf.c     maskfat.c         mcf.c
+ *     qualgrad.c    qualpseu.c     qualvar.c    residues.c
+ *         util.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "file.h"
+#include "histo.h"
+#include "maskfat.h"
+#include "pi.h"
+#include "util.h"
+#include "extract.h"
+#include "getqual.h"
+#include "list.h"
+#include "residues.h"
+#include "mcf.h"
+
+int main (int argc, char *argv[])
+{
+  int            k, tsize, num_res, num_paths;
+  FILE           *ifp, *ofp, *mfp=0, *qfp=0;
+  float          *phase;     /* array */
+  float          *soln;      /* array */
+  float          *qual_map;  /* array */
+  unsigned char  *bitflags;  /* array */
+  McfNetwork     *net;
+  char           tempstr[200];
+  char           infile[200], outfile[200];
+  char           bmaskfile[200], qualfile[200];
+  char           format[200], modekey[200];
+  int            in_format, debug_flag;
+  int            xsize, ysize;   /* dimensions of arrays */
+  int            thresh_flag, fatten;
+  UnwrapMode     mode;
+  clock_t        start_time;
+  /* define "use" statement */
+  char           use[] =     /* define usage statement */
+    "Usage: program-name -input file -format fkey -output file\n"
+    "  -xsize x -ysize y [ -mode mkey -bmask file -corr file\n"
+    "  -tsize size -debug yes/no -thresh yes/no -fat n]\n"
+    "where 'fkey' is a keyword designating the input file type\n"
+    "(key = complex8, complex4, float or byte), 'x' and 'y' are\n"
+    "the dimensions of the file, bmask is an optional byte-file\n"
+    "of masks for masking out undefined phase values, corr\n"
+    "is an optional byte-file of cross-correlation values,\n"
+    "tsize is the size of the square template for averaging the\n"
+    "corr file or quality values (default = 1), and 'mkey' is\n"
+    "a keyword designating the source of the quality values\n"
+    "that weight the discontinuities.  The value of mkey may be\n"
+    "'min_grad' for Minimum Gradient unwrapping, 'min_var' for\n"
+    "Minimum Variance unwrapping, 'max_corr' for Maximum\n"
+    "Correlation unwrapping, 'max_pseu' for Maximum Pseudo-\n"
+    "correlation unwrapping, or 'none'.  All files are simple\n"
+    "raster files, and the output file consists of floating\n"
+    "point numbers that define the heights of the unwrapped\n"
+    "surface.  If the 'debug' parm is 'yes', then the\n"
+    "intermediate byte-files are saved (quality map, residues\n"
+    "and branch cuts).  To apply an automatic threshold to the\n"
+    "quality map to make a quality mask, the 'thresh' parm\n"
+    "should be yes.  To thicken the quality mask, the 'fat'\n"
+    "parm should be the number of pixels by which to thicken.\n";
+
+  printf("Phase Unwrapping by Minimum Cost Flow\n");
+
+  /* GET COMMAND LINE PARAMETERS AND CHECK */
+  CommandLineParm(argc,argv, "-input", StringParm, infile, 1, use);
+  CommandLineParm(argc,argv, "-format", StringParm, format, 1, use);
+  CommandLineParm(argc,argv, "-output", StringParm, outfile, 1,use);
+  CommandLineParm(argc,argv, "-xsize", IntegerParm, &xsize, 1, use);
+  CommandLineParm(argc,argv, "-ysize", IntegerParm, &ysize, 1, use);
+  if (!CommandLineParm(argc, argv, "-mode", StringParm,
+        modekey, 0, use))   strcpy(modekey, "none");
+  if (!CommandLineParm(argc, argv, "-bmask", StringParm,
+        bmaskfile, 0, use)) strcpy(bmaskfile, "none");
+  if (!CommandLineParm(argc, argv, "-corr", StringParm,
+        qualfile, 0, use)) strcpy(qualfile, "none");
+  if (!CommandLineParm(argc, argv, "-tsize", IntegerParm,
+        &tsize, 0, use)) tsize = 1;
+  if (!CommandLineParm(argc, argv, "-debug", StringParm,
+        tempstr, 0, use)) debug_flag = 0;
+  else debug_flag = Keyword(tempstr, "yes");
+  if (!CommandLineParm(argc, argv, "-thresh", StringParm,
+        tempstr, 0, use)) thresh_flag = 0;
+  else thresh_flag = Keyword(tempstr, "yes");
+  if (!CommandLineParm(argc, argv, "-fat", IntegerParm,
+        &fatten, 0, use)) fatten = 0;
+
+  if (Keyword(format, "complex8"))  in_format = 0;
+  else if (Keyword(format, "complex4"))  in_format = 1;
+  else if (Keyword(format, "byte"))  in_format = 2;
+  else if (Keyword(format, "float"))  in_format = 3;
+  else {
+    fprintf(stderr, "Unrecognized format: %s\n", format);
+    exit(BAD_PARAMETER);
+  }
+
+  printf("Input file =  %s\n", infile);
+  printf("Input file type = %s\n", format);
+  printf("Output file =  %s\n", outfile);
+  printf("File dimensions = %dx%d (cols x rows).\n", xsize, ysize);
+
+  if (Keyword(bmaskfile, "none")) printf("No border mask file.\n");
+  else printf("Border mask file = %s\n", bmaskfile);
+  printf("Quality mode = %s\n", modekey);
+  if (Keyword(modekey, "none")) {
+    printf("No quality map.\n");
+    strcpy(qualfile, "none");
+  }
+  else {
+    if (Keyword(qualfile, "none")) printf("No correlation file.\n");
+    else printf("Correlation image file = %s\n", qualfile);
+    printf("Averaging template size = %d\n", tsize);
+    if (tsize < 0 || tsize > 30) {
+      fprintf(stderr, "Illegal size: must be between 0 and 30\n");
+      exit(BAD_PARAMETER);
+    }
+  }
+  mode = SetQualityMode(modekey, qualfile, 1);
+  if (mode < 0) exit(BAD_PARAMETER);  /* error msg already printed */
+
+  /*  OPEN FILES, ALLOCATE MEMORY   */
+  OpenFile(&ifp, infile, "r");
+  OpenFile(&ofp, outfile, "w");
+  if (!Keyword(bmaskfile, "none")) OpenFile(&mfp, bmaskfile, "r");
+  if (mode==corr_coeffs) OpenFile(&qfp, qualfile, "r");
+  AllocateFloat(&phase, xsize*ysize, "phase data");
+  AllocateFloat(&soln, xsize*ysize, "unwrapped data");
+  AllocateByte(&bitflags, xsize*ysize, "bitflags array");
+  AllocateFloat(&qual_map, xsize*ysize, "quality map");
+
+  /*  READ AND PROCESS DATA  */
+  printf("Reading phase data...\n");
+  GetPhase(in_format, ifp, infile, phase, xsize, ysize);
+
+  if (qfp) {
+    printf("Reading quality data...\n");
+    /* borrow the bitflags array temporarily */
+    ReadByte(qfp, bitflags, xsize*ysize, qualfile);
+    /* process data and store in quality map array */
+    AverageByteToFloat(bitflags, qual_map, tsize, xsize, ysize);
+  }
+
+  /* border mask data */
+  printf("Processing border mask data...\n");
+  if (mfp) {
+    ReadByte(mfp, bitflags, xsize*ysize, bmaskfile);
+  }
+  else {
+    for (k=0; k<xsize*ysize; k++)
+      bitflags[k] = 255;
+  }
+  for (k=0; k<xsize*ysize; k++) {
+    bitflags[k] = (!bitflags[k]) ? BORDER : 0;
+  }
+  if (mfp) FattenMask(bitflags, BORDER, 1, xsize, ysize);
+  GetQualityMap(mode, qual_map, phase, bitflags, BORDER,
+                tsize, xsize, ysize);
+  if (thresh_flag) {
+    HistoAndThresh(qual_map, xsize, ysize, 0.0, 0, 0.0,
+                   bitflags, BORDER);
+    if (fatten > 0)
+      FattenQual(qual_map, fatten, xsize, ysize);
+  }
+  if (debug_flag) {
+    char filename[300];
+    sprintf(filename, "%s.qual", outfile);
+    SaveFloatToImage(qual_map, "quality", filename, xsize, ysize,
+                     0, 0, 0);
+  }
+
+  /*  LOCATE AND PROCESS RESIDUES  */
+  /* The masked pixels have zero quality, so the flow crosses */
+  /* them cheaply, but their residues are kept so that the    */
+  /* solution is consistent everywhere.                       */
+  num_res = Residues(phase, bitflags, POS_RES, NEG_RES, 0,
+                     xsize, ysize);
+  printf("%d Residues\n", num_res);
+  if (debug_flag) {
+    char filename[300];
+    sprintf(filename, "%s.res", outfile);
+    SaveByteToImage(bitflags, "residues", filename, xsize, ysize,
+                    1, 1, 0);
+  }
+
+  /*  UNWRAP  */
+  printf("Computing the minimum cost flow...\n");
+  start_time = clock();
+  net = AllocateMcfNetwork(xsize, ysize);
+  McfCosts(net, qual_map);
+  McfSupplies(net, bitflags, POS_RES, NEG_RES);
+  num_paths = MinCostFlow(net);
+  printf("%d augmenting paths in %.2f seconds\n", num_paths,
+         (double)(clock() - start_time)/CLOCKS_PER_SEC);
+  printf("Total cost of the discontinuities = %.0lf\n", FlowCost(net));
+  k = McfNegativeArcs(net);
+  if (k) printf("Warning: %d residual arcs of negative reduced cost\n", k);
+  else printf("The flow is optimal (no negative residual cycle)\n");
+  if (debug_flag) {
+    char filename[300];
+    MarkFlows(net, bitflags, BRANCH_CUT);
+    sprintf(filename, "%s.cuts", outfile);
+    SaveByteToImage(bitflags, "branch cuts", filename, xsize, ysize,
+                    1, 1, BRANCH_CUT | BORDER);
+  }
+  printf("Integrating the corrected phase differences...\n");
+  IntegrateFlows(net, phase, soln);
+  FreeMcfNetwork(net);
+  printf("\nFinished\n");
+  PrintMinAndMax(xsize, ysize, soln, "solution");
+
+  /*  SAVE RESULT  */
+  for (k=0; k<xsize*ysize; k++)
+    soln[k] *= TWOPI;
+  printf("Saving unwrapped surface to file '%s'\n", outfile);
+  WriteFloat(ofp, soln, xsize*ysize, outfile);
+  free(soln);
+  free(phase);
+  free(bitflags);
+  free(qual_map);
+  return 0;
+}
@@ -3,9 +3,10 @@
  *
  * Source code files required:
  *     congruen.c         dct.c    dxdygrad.c     extract.c
- *      getqual.c        grad.c       histo.c     laplace.c
- *      mainpcg.c     maskfat.c         pcg.c    qualgrad.c
- *     qualpseu.c     qualvar.c     solncos.c        util.c
+ *      getqual.c        grad.c     gridops.c       histo.c
+ *      laplace.c     mainpcg.c     maskfat.c    mgprecon.c
+ *          pcg.c        pool.c    qualgrad.c    qualpseu.c
+ *      qualvar.c     solncos.c        util.c
  */
 #include <stdio.h>
 #include <math.h>
@@ -33,7 +34,9 @@ main (int argc, char *argv[])
   float          *parray;  /* array */
   float          *zarray;  /* array */
   unsigned char  *bitflags;
-  double         *xcos, *ycos;
+  CosinePlan     *plan;      /* cosine transform tables */
+  Stencil        *stencil;   /* Laplacian weights */
+  MgPrecond      *precond=NULL;  /* multigrid preconditioner */
   char           buffer[200], tempstr[200];
   char           infile[200], outfile[200];
   char           bmaskfile[200], qualfile[200];
@@ -44,6 +47,7 @@ main (int argc, char *argv[])
   int            xsize_dct, ysize_dct;
   int            avoid_code, thresh_flag, fatten;
   int            tsize, num_iter=DEFAULT_NUM_ITER;
+  int            num_threads, mg_precond;
   double         rmin, rmax, rscale, epsi_con;
   double         one_over_twopi = 1.0/TWOPI;
   UnwrapMode     mode;
@@ -51,7 +55,7 @@ main (int argc, char *argv[])
    "Usage: prog-name -input file -format fkey -output file\n"
    "  -xsize x -ysize y [ -mode mkey -bmask file -corr file\n"
    "  -tsize size -debug yes/no -iter num -converge epsi\n"
-   "  -thresh yes/no -fat n ]\n"
+   "  -thresh yes/no -fat n -threads nt -precond pkey ]\n"
    "where 'fkey' is a keyword designating the input file type\n"
    "(key = complex8, complex4, float or byte), 'x' and 'y' are\n"
    "the dimensions of the file, bmask is an optional byte-file\n"
@@ -70,11 +74,19 @@ main (int argc, char *argv[])
    "surface.  If the 'debug' parm is 'yes', then intermediate\n"
    "byte-files are saved (quality map, etc.)  The maximum number\n"
    "of iterations is given by 'num' (default 20), and the con-\n"
-   "vergence tolerance is given by 'epsi' (default = 0).  To\n"
-   "apply an automatic threshold to the quality map to make\n"
-   "a quality mask, the 'thresh' parm should be yes.  To\n"
-   "thicken the quality mask, the 'fat' parm should be the\n"
-   "number of pixels by which to thicken.\n";
+   "vergence tolerance is given by 'epsi' (default = 0).  With\n"
+   "either preconditioner, the iterations also stop early if\n"
+   "the residual rises to 10 times its lowest value (as it can\n"
+   "once it reaches round-off level), and the solution of the\n"
+   "lowest residual is the one saved.  To apply an automatic\n"
+   "threshold to the quality map to make a quality mask, the\n"
+   "'thresh' parm should be yes.  To thicken the quality mask,\n"
+   "the 'fat' parm should be the number of pixels by which to\n"
+   "thicken.  The cosine transforms are split among 'nt'\n"
+   "threads (default 1).  The preconditioner 'pkey' may be\n"
+   "'dct' for the unweighted cosine transform solution\n"
+   "(default) or 'mg' for a weighted multigrid V-cycle, which\n"
+   "is single-threaded ('nt' must then be 1).\n";
 
   printf("Phase Unwrapping by PCG algorithm\n");
 
@@ -105,6 +117,21 @@ main (int argc, char *argv[])
   else thresh_flag = Keyword(tempstr, "yes");
   if (!CommandLineParm(argc, argv, "-fat", IntegerParm,
         &fatten, 0, use)) fatten = 0;
+  if (!CommandLineParm(argc, argv, "-threads", IntegerParm,
+        &num_threads, 0, use)) num_threads = 1;
+  if (num_threads < 1) num_threads = 1;
+  if (!CommandLineParm(argc, argv, "-precond", StringParm,
+        tempstr, 0, use)) strcpy(tempstr, "dct");
+  mg_precond = Keyword(tempstr, "mg");
+  if (!mg_precond && !Keyword(tempstr, "dct")) {
+    fprintf(stderr, "Unrecognized preconditioner: %s\n", tempstr);
+    exit(BAD_PARAMETER);
+  }
+  if (mg_precond && num_threads > 1) {
+    fprintf(stderr, "The mg preconditioner is single-threaded: "
+            "-threads must be 1 with -precond mg\n");
+    exit(BAD_PARAMETER);
+  }
 
   if (Keyword(format, "complex8"))  in_format = 0;
   else if (Keyword(format, "complex4"))  in_format = 1;
@@ -135,15 +162,11 @@ main (int argc, char *argv[])
   mode = SetQualityMode(modekey, qualfile, 0);
   if (mode < 0) exit(BAD_PARAMETER);  /* error msg already printed */
 
-  /* Increase dimensions to power of two (plus one) */
+  /* Increase dimensions to the nearest fast DCT sizes */
   xsize_actual = xsize;
   ysize_actual = ysize;
-  for (xsize_dct = 1; xsize_dct + 1 < xsize_actual; xsize_dct*=2)
-    ;
-  xsize_dct = xsize_dct + 1;
-  for (ysize_dct = 1; ysize_dct + 1 < ysize_actual; ysize_dct*=2)
-    ;
-  ysize_dct = ysize_dct + 1;
+  xsize_dct = (mg_precond) ? xsize : DctSize(xsize);
+  ysize_dct = (mg_precond) ? ysize : DctSize(ysize);
   if (xsize_dct != xsize_actual || ysize_dct != ysize_actual) {
     printf("Dim's increased from %dx%d to %dx%d for FFT/DCT's\n",
            xsize_actual, ysize_actual, xsize_dct, ysize_dct);
@@ -238,13 +261,22 @@ main (int argc, char *argv[])
   AllocateFloat(&rarray, xsize*ysize, "r array data");
   AllocateFloat(&zarray, xsize*ysize, "z array data");
   AllocateFloat(&parray, xsize*ysize, "p array data");
+  stencil = AllocateStencil(qual_map, NULL, xsize, ysize);
+  if (mg_precond) {
+    plan = NULL;
+    precond = AllocateMgPrecond(qual_map, NULL, xsize, ysize,
+                                MG_PRECOND_SWEEPS, 0);
+  }
+  else {
+    plan = AllocateCosinePlan(xsize, ysize, num_threads);
+  }
 
   /*  UNWRAP  */
   printf("Unwrapping...\n");
   for (k=0; k<xsize*ysize; k++)  soln[k] = 0.0;
-  ComputeLaplacian(phase, rarray, qual_map, NULL, xsize, ysize, 1);
-  PCGUnwrap(rarray, zarray, parray, soln, qual_map, NULL,
-            xsize, ysize, num_iter, epsi_con);
+  StencilLaplacian(stencil, phase, rarray, 1);
+  PCGUnwrap(rarray, zarray, parray, soln, stencil,
+            xsize, ysize, num_iter, epsi_con, plan, precond);
   printf("\nFinished\n");
   PrintMinAndMax(xsize, ysize, soln, "solution");
 
@@ -257,16 +289,6 @@ main (int argc, char *argv[])
       soln[j*xsize + i] = soln[j*xsize_dct + i];
     }
   }
-  for (j=0; j<ysize; j++) {
-    for (i=0; i<xsize; i++) {
-      qual_map[j*xsize + i] = qual_map[j*xsize_dct + i];
-    }
-  }
-  for (j=0; j<ysize; j++) {
-    for (i=0; i<xsize; i++) {
-      phase[j*xsize + i] = phase[j*xsize_dct + i];
-    }
-  }
   /* make result congruent to input phase */
 /***  CongruentSoln(soln, phase, qual_map, xsize, ysize); ***/
   /* scale and save result */
@@ -279,4 +301,7 @@ main (int argc, char *argv[])
   free(rarray);
   free(parray);
   free(zarray);
+  FreeCosinePlan(plan);
+  FreeMgPrecond(precond);
+  FreeStencil(stencil);
 }
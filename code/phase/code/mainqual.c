@@ -3,8 +3,9 @@
  *
  * Source code files required:
  *     dxdygrad.c     extract.c     getqual.c        grad.c
- *         list.c    mainqual.c     maskfat.c     quality.c
- *     qualgrad.c    qualpseu.c     qualvar.c        util.c
+ *         list.c    mainqual.c     maskfat.c        pool.c
+ *     qualgrad.c     quality.c    qualpseu.c    qualtile.c
+ *      qualvar.c       seams.c        util.c
  */
 #include <stdio.h>
 #include <math.h>
@@ -14,8 +15,9 @@
 #include "util.h"
 #include "extract.h"
 #include "getqual.h"
+#include "qualtile.h"
+#include "pool.h"
 
-#define BORDER (0x20)
 main (int argc, char *argv[])
 {
   int            i, j, k;
@@ -28,14 +30,19 @@ main (int argc, char *argv[])
   char           infile[200], outfile[200];
   char           bmaskfile[200], qualfile[200];
   char           tempstr[200], format[200], modekey[200];
+  char           queuekey[200];
   int            xsize, ysize;   /* dimensions of arrays */ 
   int            tsize, in_format, debug_flag, avoid_code;
+  int            max_list_size, tile_size, overlap, num_threads;
+  ThreadPool     *pool;
   double         rmin, rmax, rscale;
   UnwrapMode     mode;
+  QueueKind      queue_kind;
   char           use[] =      /* define usage statement */
     "Usage: prog-name -input file -format fkey -output file\n"
     "  -xsize x -ysize y -mode mkey [ -bmask file -corr file\n"
-    "  -tsize size -debug yes/no]\n"
+    "  -tsize size -queue qkey -maxlist m -tile size -overlap n\n"
+    "  -threads nt -debug yes/no]\n"
     "where 'fkey' is a keyword designating the input file type\n"
     "(key = complex8, complex4, float or byte), 'x' and 'y' are\n"
     "the dimensions of the file, bmask is an optional byte-file\n"
@@ -48,9 +55,18 @@ main (int argc, char *argv[])
     "'min_grad' for Minimum Gradient unwrapping, 'min_var' for\n"
     "Minimum Variance unwrapping, 'max_corr' for Maximum\n"
     "Correlation unwrapping, or 'max_pseu' for Maximum\n"
-    "Pseudocorrelation unwrapping.  All files are simple\n"
-    "raster files, and the output file consists of floating\n"
-    "point numbers that define the heights of the unwrapped\n"
+    "Pseudocorrelation unwrapping.  'qkey' is 'heap' (default)\n"
+    "to unwrap the pixels in order of quality, or 'bucket' to\n"
+    "order them by quality rounded to 1/4096 of its range, which\n"
+    "is faster for large images.  If 'm' is given (and not 0),\n"
+    "the queue holds at most m pixels; the lower quality ones\n"
+    "are postponed until the queue runs empty.  If the tile size\n"
+    "is given, the image is unwrapped on tiles of that size that\n"
+    "overlap by 'n' pixels on each side (default 64), among 'nt'\n"
+    "threads (default 1), and the tiles are then merged by their\n"
+    "overlaps.  All files are simple raster files, and the\n"
+    "output file consists of floating point numbers that\n"
+    "define the heights of the unwrapped\n"
     "surface.  If the 'debug' parm is 'yes', then intermediate\n"
     "byte-files are saved (quality map, unwrapping paths, etc.)\n";
 
@@ -69,6 +85,17 @@ main (int argc, char *argv[])
         qualfile, 0, use)) strcpy(qualfile, "none");
   if (!CommandLineParm(argc, argv, "-tsize", IntegerParm,
         &tsize, 0, use)) tsize = 1;
+  if (!CommandLineParm(argc, argv, "-queue", StringParm,
+        queuekey, 0, use)) strcpy(queuekey, "heap");
+  if (!CommandLineParm(argc, argv, "-maxlist", IntegerParm,
+        &max_list_size, 0, use)) max_list_size = 0;
+  if (!CommandLineParm(argc, argv, "-tile", IntegerParm,
+        &tile_size, 0, use)) tile_size = 0;
+  if (!CommandLineParm(argc, argv, "-overlap", IntegerParm,
+        &overlap, 0, use)) overlap = TILE_OVERLAP;
+  if (!CommandLineParm(argc, argv, "-threads", IntegerParm,
+        &num_threads, 0, use)) num_threads = 1;
+  if (num_threads < 1) num_threads = 1;
   if (!CommandLineParm(argc, argv, "-debug", StringParm,
         tempstr, 0, use)) debug_flag = 0;
   else debug_flag = Keyword(tempstr, "yes");
@@ -82,6 +109,13 @@ main (int argc, char *argv[])
     exit(BAD_PARAMETER);
   }
 
+  if (Keyword(queuekey, "heap"))  queue_kind = heap_queue;
+  else if (Keyword(queuekey, "bucket"))  queue_kind = bucket_queue;
+  else {
+    fprintf(stderr, "Unrecognized queue: %s\n", queuekey);
+    exit(BAD_PARAMETER);
+  }
+
   printf("Input file =  %s\n", infile);
   printf("Input file type = %s\n", format);
   printf("Output file =  %s\n", outfile);
@@ -93,6 +127,20 @@ main (int argc, char *argv[])
   else printf("Correlation image file = %s\n", qualfile);
 
   printf("Averaging template size = %d\n", tsize);
+  printf("Pixel queue = %s\n", queuekey);
+  if (max_list_size < 0) {
+    fprintf(stderr, "Illegal queue size: must be 0 or more\n");
+    exit(BAD_PARAMETER);
+  }
+  if (max_list_size > 0)
+    printf("Maximum queue size = %d\n", max_list_size);
+  if (tile_size < 0 || overlap < 1) {
+    fprintf(stderr, "Illegal tile size or overlap\n");
+    exit(BAD_PARAMETER);
+  }
+  if (tile_size > 0)
+    printf("Tile size = %d, overlap = %d, threads = %d\n", tile_size,
+           overlap, num_threads);
   if (tsize < 0 || tsize > 30) {
     fprintf(stderr, "Illegal size: must be between 0 and 30\n");
     exit(BAD_PARAMETER);
@@ -156,8 +204,18 @@ main (int argc, char *argv[])
   /*  UNWRAP  */
   avoid_code = BORDER;
   if (mode==gradient && tsize==1) mode = dxdygrad;
-  k = QualityGuidedPathFollower(phase, qual_map, bitflags, soln,
-              xsize, ysize, avoid_code, mode, debug_flag, outfile);
+  if (tile_size > 0) {
+    pool = AllocateThreadPool(num_threads);
+    k = TiledPathFollower(phase, qual_map, bitflags, soln, xsize,
+              ysize, avoid_code, mode, queue_kind, max_list_size,
+              tile_size, overlap, pool);
+    FreeThreadPool(pool);
+  }
+  else {
+    k = QualityGuidedPathFollower(phase, qual_map, bitflags, soln,
+              xsize, ysize, avoid_code, mode, queue_kind,
+              max_list_size, debug_flag, outfile);
+  }
   if (k > 1) printf("\n%d pieces\n", k);
 
   printf("\nFinished\n");
@@ -4,8 +4,8 @@
  *
  * Source code files required:
  *     dxdygrad.c     extract.c        grad.c     gridmem.c
- *      gridops.c    mainunmg.c       relax.c       unfmg.c
- *       ungrid.c        util.c
+ *      gridops.c    mainunmg.c        pool.c       relax.c
+ *        unfmg.c      ungrid.c        util.c
  */
 #include <stdio.h>
 #include <math.h>
@@ -14,6 +14,7 @@
 #include "util.h"
 #include "extract.h"
 #include "unfmg.h"
+#include "relax.h"
 #define DEFAULT_NUM_ITER    2
 #define DEFAULT_NUM_CYCLES  2
 
@@ -25,22 +26,34 @@ main (int argc, char *argv[])
   float          *soln;      /* array */ 
   float          *dx;        /* array */
   float          *dy;        /* array */
-  char           infile[200], outfile[200];
+  char           infile[200], outfile[200], histfile[200];
   char           format[200];
   int            in_format;
   int            xsize, ysize;   /* dimensions of arrays */ 
   int            num_iter=DEFAULT_NUM_ITER;
   int            num_cycles=DEFAULT_NUM_CYCLES;
+  int            num_threads;
+  double         tol=0.0, *history=NULL;
+  GridArena      *arena;
   char           use[] =   /* define usage statement */
     "Usage: prog-name -input file -format fkey -output file\n"
-    "  -xsize x -ysize y [ -cycles numc -iter num]\n"
+    "  -xsize x -ysize y [ -cycles numc -iter num -tol t\n"
+    "  -history file -threads nt ]\n"
     "where 'fkey' is a keyword designating the input file type\n"
     "(key = complex8, complex4, float or byte) and 'x' and 'y'\n"
     "are the dimensions of the file.  All files are simple\n"
     "raster files, and the output file consists of floating\n"
     "point numbers that define the heights of the unwrapped\n"
     "surface.  The number of cycles is given by 'numc'.  The\n"
-    "number of Gauss-Seidel iterations is given by 'num'.\n";
+    "number of Gauss-Seidel iterations is given by 'num'.  If\n"
+    "'t' is given, the cycles stop as soon as a cycle changes\n"
+    "the solution by at most 't' (rms of the change relative\n"
+    "to rms of the solution).  The residual relative to that\n"
+    "of the zero solution after each cycle is saved to the\n"
+    "comma-separated 'history' file if one is given (it levels\n"
+    "off at a floor that depends on the data, so it is not used\n"
+    "for stopping).  The relaxation sweeps are split among 'nt'\n"
+    "threads (default 1).\n";
 
   printf("Unweighted Phase Unwrapping by Multigrid Algorithm\n");
       
@@ -56,6 +69,12 @@ main (int argc, char *argv[])
   CommandLineParm(argc, argv, "-cycles", IntegerParm, &num_cycles,
                   0, use);
   if (num_cycles < 0) num_cycles = 1;
+  CommandLineParm(argc, argv, "-tol", DoubleParm, &tol, 0, use);
+  if (!CommandLineParm(argc, argv, "-history", StringParm, histfile,
+        0, use)) strcpy(histfile, "none");
+  if (!CommandLineParm(argc, argv, "-threads", IntegerParm,
+        &num_threads, 0, use)) num_threads = 1;
+  if (num_threads < 1) num_threads = 1;
 
   if (Keyword(format, "complex8"))  in_format = 0;
   else if (Keyword(format, "complex4"))  in_format = 1;
@@ -88,8 +107,18 @@ main (int argc, char *argv[])
   DxPhaseGradient(phase, dx, xsize, ysize);
   DyPhaseGradient(phase, dy, xsize, ysize);
   for (k=0; k<xsize*ysize; k++)  soln[k] = 0.0;
-  UnweightedMultigridUnwrap(soln, dx, dy, xsize, ysize,
-                            num_cycles, num_iter);
+  if (!Keyword(histfile, "none"))
+    AllocateDouble(&history, num_cycles, "residual history");
+  arena = AllocateGridArena(xsize, ysize, COARSEST_DIM, 0, num_threads);
+  n = UnweightedMultigridUnwrap(soln, dx, dy, xsize, ysize,
+                                num_cycles, num_iter, tol, history,
+                                arena);
+  FreeGridArena(arena);
+  if (history) {
+    printf("Saving residual history to %s\n", histfile);
+    WriteResidualHistory(histfile, history, n);
+    free(history);
+  }
   printf("\nFinished\n");
   PrintMinAndMax(xsize, ysize, soln, "solution");
 
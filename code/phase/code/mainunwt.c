@@ -4,7 +4,7 @@
  *
  * Source code files required:
  *          dct.c     extract.c        grad.c     laplace.c
- *     mainunwt.c     solncos.c        util.c
+ *     mainunwt.c        pool.c     solncos.c        util.c
  */
 #include <stdio.h>
 #include <math.h>
@@ -21,20 +21,22 @@ main (int argc, char *argv[])
   FILE           *ifp, *ofp;
   float          *phase;     /* array */ 
   float          *soln;      /* array */ 
-  double         *xcos, *ycos;
+  CosinePlan     *plan;      /* cosine transform tables */
   char           infile[200], outfile[200];
   char           format[200];
   int            in_format;
   int            xsize, ysize;   /* dimensions of arrays */ 
-  int            xsize_dct, ysize_dct;
+  int            num_threads;
   double         rmin, rmax, rscale;
   double         one_over_twopi = 1.0/TWOPI;
   char           use[] =       /* define usage statement */
    "Usage: prog-name -input file -format fkey -output file\n"
-   "  -xsize x -ysize y\n"
+   "  -xsize x -ysize y [ -threads nt ]\n"
    "where 'fkey' is a keyword designating the input file type\n"
    "(key = complex8, complex4, float or byte).  The dimensions\n"
-   "x and y must be powers of two plus 1 (e.g., 257, 513, etc.)\n";
+   "x and y may be any size, but powers of two plus 1 (e.g., 257,\n"
+   "513, etc.) are fastest.  The cosine transforms are split\n"
+   "among 'nt' threads (default 1).\n";
 
   printf("Unweighted Phase Unwrapping by DCT/FFT\n");
 
@@ -44,6 +46,9 @@ main (int argc, char *argv[])
   CommandLineParm(argc,argv, "-output", StringParm, outfile, 1,use);
   CommandLineParm(argc,argv, "-xsize", IntegerParm, &xsize, 1, use);
   CommandLineParm(argc,argv, "-ysize", IntegerParm, &ysize, 1, use);
+  if (!CommandLineParm(argc, argv, "-threads", IntegerParm,
+        &num_threads, 0, use)) num_threads = 1;
+  if (num_threads < 1) num_threads = 1;
 
   if (Keyword(format, "complex8"))  in_format = 0;
   else if (Keyword(format, "complex4"))  in_format = 1;
@@ -59,19 +64,6 @@ main (int argc, char *argv[])
   printf("Output file =  %s\n", outfile);
   printf("File dimensions = %dx%d (cols x rows).\n", xsize, ysize);
 
-  /* Verify dimensions are of form 2**n + 1 */
-  for (xsize_dct = 1; xsize_dct + 1 < xsize; xsize_dct*=2)
-    ;
-  xsize_dct = xsize_dct + 1;
-  for (ysize_dct = 1; ysize_dct + 1 < ysize; ysize_dct*=2)
-    ;
-  ysize_dct = ysize_dct + 1;
-  if (xsize_dct != xsize || ysize_dct != ysize) {
-    fprintf(stderr, "Error: dims %dx%d must be 2**n + 1\n",
-            xsize, ysize);
-    exit(BAD_PARAMETER);
-  }
-
   /*  OPEN FILES, ALLOCATE MEMORY   */
   OpenFile(&ifp, infile, "r");
   OpenFile(&ofp, outfile, "w");
@@ -86,12 +78,10 @@ main (int argc, char *argv[])
   printf("Computing Laplacian...\n");
   ComputeLaplacian(phase, soln, NULL, NULL, xsize, ysize, 1);
   free(phase);  
-  AllocateDouble(&xcos, xsize, "cosine terms");
-  AllocateDouble(&ycos, ysize, "cosine terms");
+  plan = AllocateCosinePlan(xsize, ysize, num_threads);
   printf("Performing direct transform...\n");
-  DirectSolnByCosineTransform(soln, xsize, ysize, xcos, ycos);
-  free(xcos);
-  free(ycos);
+  DirectSolnByCosineTransform(soln, xsize, ysize, plan);
+  FreeCosinePlan(plan);
   printf("\nFinished\n");
   PrintMinAndMax(xsize, ysize, soln, "solution");
 
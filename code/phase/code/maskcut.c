@@ -16,8 +16,8 @@ int QualityGuidedMask(float *phase, float *qual_map,
   int  i, j, k, a, b, c, n, num_pieces=0;
   float  value;
   float  min_qual, small_val = -1.0E+10;
-  int    num_index, max_list_size, bench, benchout;
-  int    *index_list;
+  int    bench, benchout;
+  PixelQueue  *queue;
   int    postponed_code=POSTPONED;
   int    avoid_code;
   int    charge, num_pixels;
@@ -25,18 +25,15 @@ int QualityGuidedMask(float *phase, float *qual_map,
   bench = xsize*ysize/100;
   if (bench < 1) bench = 1;
   benchout = 10*bench;
-  max_list_size = xsize*ysize/2; /* this size can be reduced */ 
-  AllocateInt(&index_list, max_list_size + 1,
-              "bookkeeping list (index)");
+  queue = AllocatePixelQueue(heap_queue, xsize, ysize, 0.0, 0.0);
 
   /* find starting point */
   n = 0;
-  num_index = 0;
   avoid_code = BORDER | mask_code;
   for (j=0; j<ysize; j++) {
     for (i=0; i<xsize; i++) {
       min_qual = small_val;
-      num_index = 0;
+      ClearPixelQueue(queue);
       k = j*xsize + i;
       if ((bitflags[k] & RESIDUE) && !(bitflags[k] & avoid_code)) {
         charge = (bitflags[k] & POS_RES) ? 1 : -1;
@@ -48,17 +45,15 @@ int QualityGuidedMask(float *phase, float *qual_map,
           continue;
         }
         UpdateList(qual_map, i, j, value, phase, NULL, bitflags,
-                xsize, ysize, index_list, &num_index,
-                postponed_code, VISITED, postponed_code,
-                max_list_size, unwrap_mode==dxdygrad, &min_qual);
-        while (charge != 0 && num_index > 0) {
+                xsize, ysize, queue, postponed_code, VISITED,
+                postponed_code, unwrap_mode==dxdygrad, &min_qual);
+        while (charge != 0 && queue->size > 0) {
           if (n%bench==0) {
             printf("%d ", n/bench);
             fflush(stdout);
           }
           ++n;
-          if (!GetNextOneToUnwrap(&a, &b, index_list, &num_index,
-                                  xsize, ysize))
+          if (!GetNextOneToUnwrap(&a, &b, queue, xsize, ysize))
             break;   /* no more to unwrap */
           c = b*xsize + a;
           ++num_pixels; 
@@ -70,19 +65,16 @@ int QualityGuidedMask(float *phase, float *qual_map,
           }
           bitflags[c] |= mask_code;
           UpdateList(qual_map, a, b, value, phase, NULL, bitflags,
-                xsize, ysize, index_list, &num_index,
-                postponed_code, VISITED, postponed_code,
-                max_list_size, unwrap_mode==dxdygrad, &min_qual);
+                xsize, ysize, queue, postponed_code, VISITED,
+                postponed_code, unwrap_mode==dxdygrad, &min_qual);
         }
-        /* reset pixels on list */
-        for (k=0; k<num_index; k++) 
-          bitflags[index_list[k]] &= ~(VISITED);
+        /* reset visited pixels */
         for (k=0; k<xsize*ysize; k++) 
           bitflags[k] &= ~(VISITED);
       }
     }
   }
   printf("\n");
-  free(index_list);
+  FreePixelQueue(queue);
   return num_pieces;
 }
@@ -0,0 +1,408 @@
+/*
+ *  mcf.c -- functions for phase unwrapping by minimum cost flow:
+ *           the residues are the supplies and demands of a flow
+ *           on the grid of loops, the flow across each edge is
+ *           the 2pi correction of its phase difference, and the
+ *           cost of a unit of flow is the quality of the edge
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "file.h"
+#include "util.h"
+#include "grad.h"
+#include "mcf.h"
+
+/* Allocate the network of the loops of an xsize x ysize image, */
+/* with zero flows, costs, supplies and potentials              */
+McfNetwork *AllocateMcfNetwork(int xsize, int ysize)
+{
+  int         k, n;
+  McfNetwork  *net;
+  if (xsize < 2 || ysize < 2)
+    ErrorHandler("Image too small", "min. cost flow", BAD_DIMENSIONS);
+  net = (McfNetwork *) malloc(sizeof(McfNetwork));
+  if (!net)
+    ErrorHandler("Cannot allocate memory", "min. cost flow",
+                 MEMORY_ALLOCATION_ERROR);
+  net->xsize = xsize;
+  net->ysize = ysize;
+  net->num_loops = (xsize - 1)*(ysize - 1);
+  net->ground = net->num_loops;
+  n = net->num_loops + 1;
+  AllocateInt(&net->hflow, xsize*ysize, "flows");
+  AllocateInt(&net->vflow, xsize*ysize, "flows");
+  AllocateInt(&net->hcost, xsize*ysize, "costs");
+  AllocateInt(&net->vcost, xsize*ysize, "costs");
+  AllocateInt(&net->potential, n, "potentials");
+  AllocateInt(&net->dist, n, "distances");
+  AllocateInt(&net->mark, n, "search marks");
+  AllocateInt(&net->settled, n, "settled nodes");
+  AllocateInt(&net->supply, n, "supplies");
+  AllocateByte(&net->link, n, "search tree");
+  net->num_ground_arcs = 2*(xsize - 1) + 2*(ysize - 1);
+  for (k=0; k<xsize*ysize; k++) {
+    net->hflow[k] = net->vflow[k] = 0;
+    net->hcost[k] = net->vcost[k] = 1;
+  }
+  for (k=0; k<n; k++) {
+    net->potential[k] = net->mark[k] = 0;
+    net->supply[k] = 0;
+  }
+  net->search = net->num_settled = 0;
+  net->heap.size = 0;
+  net->heap.max_size = 1024;
+  AllocateInt(&net->heap.dist, net->heap.max_size, "search heap");
+  AllocateInt(&net->heap.node, net->heap.max_size, "search heap");
+  return net;
+}
+
+/* Free the network */
+void FreeMcfNetwork(McfNetwork *net)
+{
+  free(net->hflow);
+  free(net->vflow);
+  free(net->hcost);
+  free(net->vcost);
+  free(net->potential);
+  free(net->dist);
+  free(net->mark);
+  free(net->settled);
+  free(net->link);
+  free(net->supply);
+  free(net->heap.dist);
+  free(net->heap.node);
+  free(net);
+}
+
+/* Set the unit cost of each edge from the lower of the qualities */
+/* (between 0 and 1) of its two pixels                            */
+void McfCosts(McfNetwork *net, float *qual_map)
+{
+  int    i, j, k, xsize = net->xsize, ysize = net->ysize;
+  float  q;
+  for (j=0; j<ysize; j++) {
+    for (i=0; i<xsize; i++) {
+      k = j*xsize + i;
+      if (i < xsize - 1) {
+        q = (qual_map[k] < qual_map[k+1]) ? qual_map[k] : qual_map[k+1];
+        net->hcost[k] = 1 + (int)(MCF_COST_SCALE*q);
+      }
+      if (j < ysize - 1) {
+        q = (qual_map[k] < qual_map[k+xsize])
+                  ? qual_map[k] : qual_map[k+xsize];
+        net->vcost[k] = 1 + (int)(MCF_COST_SCALE*q);
+      }
+    }
+  }
+}
+
+/* Set the supplies of the loops from the residues marked in the */
+/* bitflags array (positive residues are sources and negative    */
+/* ones sinks).  The ground balances them.  Return the number of */
+/* residues.                                                     */
+int McfSupplies(McfNetwork *net, unsigned char *bitflags,
+                int pos_code, int neg_code)
+{
+  int  i, j, k, num = 0, total = 0, w = net->xsize - 1;
+  for (j=0; j<net->ysize - 1; j++) {
+    for (i=0; i<w; i++) {
+      k = j*net->xsize + i;
+      if (bitflags[k] & pos_code) net->supply[j*w + i] = 1;
+      else if (bitflags[k] & neg_code) net->supply[j*w + i] = -1;
+      else net->supply[j*w + i] = 0;
+      if (net->supply[j*w + i]) ++num;
+      total += net->supply[j*w + i];
+    }
+  }
+  net->supply[net->ground] = -total;
+  return num;
+}
+
+/* Solve the min. cost flow problem by successive shortest paths. */
+/* Each unit of supply (of a source, or of the ground if there are */
+/* more sinks) is sent to the nearest node of negative supply.     */
+/* The ground is a node like the others, so that flow may also    */
+/* pass through it.  The searches stop at the first sink, and the */
+/* potentials of the nodes they settle keep the reduced costs     */
+/* nonnegative.  Return the number of augmenting paths.           */
+int MinCostFlow(McfNetwork *net)
+{
+  int  k, t, num = 0, bench;
+  bench = net->num_loops/100;
+  if (bench < 1) bench = 1;
+  for (k=0; k<=net->num_loops; k++) {
+    if (k%bench==0 && k<net->num_loops) {
+      printf("%d ", k/bench);
+      fflush(stdout);
+    }
+    while (net->supply[k] > 0) {
+      t = ForwardSearch(net, k);
+      --net->supply[k];
+      ++net->supply[t];
+      ++num;
+    }
+  }
+  printf("\n");
+  return num;
+}
+
+/* Return the neighbor of the node in direction dir (0 = up,     */
+/* 1 = down, 2 = left, 3 = right), and the edge between them and */
+/* the sign of its flow when flow goes from the node to the      */
+/* neighbor.  Directions 0 and 1 cross the horizontal edges      */
+/* (hflow) and 2 and 3 the vertical ones (vflow).                */
+int McfNeighbor(McfNetwork *net, int node, int dir, int *edge,
+                int *sign)
+{
+  int  w = net->xsize - 1, i = node%w, j = node/w;
+  switch (dir) {
+    case 0:
+      *edge = j*net->xsize + i;
+      *sign = 1;
+      return (j > 0) ? node - w : net->ground;
+    case 1:
+      *edge = (j + 1)*net->xsize + i;
+      *sign = -1;
+      return (j < net->ysize - 2) ? node + w : net->ground;
+    case 2:
+      *edge = j*net->xsize + i;
+      *sign = 1;
+      return (i > 0) ? node - 1 : net->ground;
+    default:
+      *edge = j*net->xsize + i + 1;
+      *sign = -1;
+      return (i < w - 1) ? node + 1 : net->ground;
+  }
+}
+
+/* Return the loop at the end of arc number k (0 to               */
+/* num_ground_arcs - 1) of the ground, and the direction of the  */
+/* ground from that loop.  The arcs cross the top and bottom rows */
+/* and then the left and right columns of edges.                  */
+int McfGroundArc(McfNetwork *net, int k, int *dir)
+{
+  int  w = net->xsize - 1, h = net->ysize - 1;
+  if (k < 2*w) {
+    *dir = k%2;
+    return (k%2) ? (h - 1)*w + k/2 : k/2;
+  }
+  k -= 2*w;
+  *dir = 2 + k%2;
+  return (k%2) ? (k/2)*w + w - 1 : (k/2)*w;
+}
+
+/* Cost of adding sign to the flow across the edge: its unit cost */
+/* if that increases the size of the flow, or its negative if it  */
+/* reduces it                                                     */
+int ResidualCost(McfNetwork *net, int dir, int edge, int sign)
+{
+  int  flow, cost;
+  if (dir < 2) {
+    flow = net->hflow[edge];
+    cost = net->hcost[edge];
+  }
+  else {
+    flow = net->vflow[edge];
+    cost = net->vcost[edge];
+  }
+  return (sign*flow >= 0) ? cost : -cost;
+}
+
+/* Add sign to the flow across the edge */
+void AddFlow(McfNetwork *net, int dir, int edge, int sign)
+{
+  if (dir < 2) net->hflow[edge] += sign;
+  else net->vflow[edge] += sign;
+}
+
+/* Find the shortest path (by the reduced costs) from the source */
+/* to the nearest node of negative supply, send one unit of flow */
+/* along it, and update the potentials.  The ground is expanded  */
+/* through its arcs to the loops on the edges of the image (see  */
+/* McfGroundArc).  Return the sink.                              */
+int ForwardSearch(McfNetwork *net, int source)
+{
+  int  v, n, d, nd, a, num_arcs, dir, back, edge, sign, t, k;
+  int  labeled = 2*(++net->search), settled = labeled + 1;
+  net->heap.size = net->num_settled = 0;
+  net->dist[source] = 0;
+  net->mark[source] = labeled;
+  McfPush(&net->heap, 0, source);
+  for (;;) {
+    if (!McfPop(&net->heap, &d, &v))
+      ErrorHandler("No path to a sink", "min. cost flow",
+                   BAD_PARAMETER);
+    if (net->mark[v]==settled || d > net->dist[v]) continue;
+    net->mark[v] = settled;
+    net->settled[net->num_settled++] = v;
+    if (net->supply[v] < 0) break;
+    num_arcs = (v==net->ground) ? net->num_ground_arcs : 4;
+    for (a=0; a<num_arcs; a++) {
+      if (v==net->ground) {
+        n = McfGroundArc(net, a, &dir);
+        McfNeighbor(net, n, dir, &edge, &sign);
+        sign = -sign;
+        back = dir;
+      }
+      else {
+        dir = a;
+        n = McfNeighbor(net, v, dir, &edge, &sign);
+        back = dir^1;
+      }
+      if (net->mark[n]==settled) continue;
+      nd = d + ResidualCost(net, dir, edge, sign)
+             + net->potential[v] - net->potential[n];
+      if (net->mark[n] != labeled || nd < net->dist[n]) {
+        net->mark[n] = labeled;
+        net->dist[n] = nd;
+        if (n==net->ground) net->ground_link = 4*v + dir;
+        else net->link[n] = back;
+        McfPush(&net->heap, nd, n);
+      }
+    }
+  }
+  t = v;
+  for (k=0; k<net->num_settled; k++) {
+    n = net->settled[k];
+    net->potential[n] -= d - net->dist[n];
+  }
+  /* send the flow back along the search tree */
+  while (v != source) {
+    if (v==net->ground) {
+      n = net->ground_link/4;
+      dir = net->ground_link%4;
+      McfNeighbor(net, n, dir, &edge, &sign);
+      AddFlow(net, dir, edge, sign);
+    }
+    else {
+      dir = net->link[v];
+      n = McfNeighbor(net, v, dir, &edge, &sign);
+      AddFlow(net, dir, edge, -sign);
+    }
+    v = n;
+  }
+  return t;
+}
+
+/* Insert the node into the heap with the given distance */
+void McfPush(McfHeap *heap, int dist, int node)
+{
+  int  k, p;
+  if (heap->size >= heap->max_size) {
+    heap->max_size *= 2;
+    heap->dist = (int *) realloc(heap->dist,
+                                 heap->max_size*sizeof(int));
+    heap->node = (int *) realloc(heap->node,
+                                 heap->max_size*sizeof(int));
+    if (!heap->dist || !heap->node)
+      ErrorHandler("Cannot allocate memory", "search heap",
+                   MEMORY_ALLOCATION_ERROR);
+  }
+  for (k=heap->size++; k>0; k=p) {
+    p = (k - 1)/2;
+    if (heap->dist[p] <= dist) break;
+    heap->dist[k] = heap->dist[p];
+    heap->node[k] = heap->node[p];
+  }
+  heap->dist[k] = dist;
+  heap->node[k] = node;
+}
+
+/* Remove the node of least distance from the heap.  Return 0 if */
+/* the heap is empty.                                            */
+int McfPop(McfHeap *heap, int *dist, int *node)
+{
+  int  k, c, d, n;
+  if (heap->size==0) return 0;
+  *dist = heap->dist[0];
+  *node = heap->node[0];
+  d = heap->dist[--heap->size];
+  n = heap->node[heap->size];
+  for (k=0; (c = 2*k + 1) < heap->size; k=c) {
+    if (c + 1 < heap->size && heap->dist[c+1] < heap->dist[c]) ++c;
+    if (d <= heap->dist[c]) break;
+    heap->dist[k] = heap->dist[c];
+    heap->node[k] = heap->node[c];
+  }
+  heap->dist[k] = d;
+  heap->node[k] = n;
+  return 1;
+}
+
+/* Integrate the corrected phase differences.  Since the flows */
+/* cancel the residues, the corrected differences have no curl */
+/* and can be summed along any path: here, down the first      */
+/* column and then along each row.                             */
+void IntegrateFlows(McfNetwork *net, float *phase, float *soln)
+{
+  int  i, j, k, xsize = net->xsize, ysize = net->ysize;
+  soln[0] = phase[0];
+  for (j=1; j<ysize; j++) {
+    k = j*xsize;
+    soln[k] = soln[k-xsize] + Gradient(phase[k], phase[k-xsize])
+                + net->vflow[k-xsize];
+  }
+  for (j=0; j<ysize; j++) {
+    for (i=1; i<xsize; i++) {
+      k = j*xsize + i;
+      soln[k] = soln[k-1] + Gradient(phase[k], phase[k-1])
+                  - net->hflow[k-1];
+    }
+  }
+}
+
+/* Set the bits given by "code" in the bitflags array for the */
+/* pixels on both sides of the edges that carry flow (i.e.,   */
+/* the branch cuts of the solution)                           */
+void MarkFlows(McfNetwork *net, unsigned char *bitflags, int code)
+{
+  int  i, j, k, xsize = net->xsize, ysize = net->ysize;
+  for (j=0; j<ysize; j++) {
+    for (i=0; i<xsize; i++) {
+      k = j*xsize + i;
+      if (i < xsize - 1 && net->hflow[k]) {
+        bitflags[k] |= code;
+        bitflags[k+1] |= code;
+      }
+      if (j < ysize - 1 && net->vflow[k]) {
+        bitflags[k] |= code;
+        bitflags[k+xsize] |= code;
+      }
+    }
+  }
+}
+
+/* Return the total cost of the flows */
+double FlowCost(McfNetwork *net)
+{
+  int     k;
+  double  cost = 0.0;
+  for (k=0; k<net->xsize*net->ysize; k++) {
+    cost += (double) abs(net->hflow[k])*net->hcost[k]
+              + (double) abs(net->vflow[k])*net->vcost[k];
+  }
+  return cost;
+}
+
+/* Check the optimality of the flows: with the potentials, no arc  */
+/* of the residual network may have a negative reduced cost, so    */
+/* that there is no negative cycle.  Return the number of arcs     */
+/* that violate this (0 if the flows are optimal).                 */
+int McfNegativeArcs(McfNetwork *net)
+{
+  int  v, n, dir, edge, sign, num = 0;
+  int  *pot = net->potential;
+  for (v=0; v<net->num_loops; v++) {
+    for (dir=0; dir<4; dir++) {
+      n = McfNeighbor(net, v, dir, &edge, &sign);
+      if (ResidualCost(net, dir, edge, sign) + pot[v] - pot[n] < 0)
+        ++num;
+      /* the arcs from the ground are not seen from its side */
+      if (n==net->ground
+            && ResidualCost(net, dir, edge, -sign) + pot[n] - pot[v] < 0)
+        ++num;
+    }
+  }
+  return num;
+}
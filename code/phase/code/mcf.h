@@ -0,0 +1,53 @@
+#ifndef __MCF
+#define __MCF
+/* unit cost of a discontinuity is 1 + MCF_COST_SCALE*(quality) */
+#define MCF_COST_SCALE  255
+/* heap of (distance, node) pairs for the shortest path searches */
+typedef struct {
+  int  size, max_size;
+  int  *dist, *node;
+} McfHeap;
+/* Residual network of the min. cost flow problem.  Node         */
+/* j*(xsize-1) + i is the loop of pixels (i,j), (i+1,j),         */
+/* (i+1,j+1) and (i,j+1), whose residue Residues marks at pixel  */
+/* (i,j), and node 'ground' is the outside of the image, which   */
+/* balances the supplies and is joined to the loops on the edges */
+/* of the image by its num_ground_arcs arcs.  The neighbors of a */
+/* loop are up, down, left and right of it (directions 0 to 3).  */
+/* hflow[k] and vflow[k] are the flows (i.e., the 2pi            */
+/* corrections) across the edges from pixel k to its right and   */
+/* lower neighbors, and hcost[k] and vcost[k] are their unit     */
+/* costs.  link holds the search tree, and mark says whether a   */
+/* node is labeled or settled in the current search.             */
+typedef struct {
+  int            xsize, ysize;
+  int            num_loops, ground, num_ground_arcs;
+  int            *hflow, *vflow;
+  int            *hcost, *vcost;
+  int            *supply;
+  int            *potential, *dist, *mark;
+  unsigned char  *link;
+  int            ground_link;    /* 4*loop + direction to ground */
+  int            search;
+  int            *settled, num_settled;
+  McfHeap        heap;
+} McfNetwork;
+McfNetwork *AllocateMcfNetwork(int xsize, int ysize);
+void FreeMcfNetwork(McfNetwork *net);
+void McfCosts(McfNetwork *net, float *qual_map);
+int McfSupplies(McfNetwork *net, unsigned char *bitflags,
+                int pos_code, int neg_code);
+int MinCostFlow(McfNetwork *net);
+int McfNeighbor(McfNetwork *net, int node, int dir, int *edge,
+                int *sign);
+int McfGroundArc(McfNetwork *net, int k, int *dir);
+int ResidualCost(McfNetwork *net, int dir, int edge, int sign);
+void AddFlow(McfNetwork *net, int dir, int edge, int sign);
+int ForwardSearch(McfNetwork *net, int source);
+void McfPush(McfHeap *heap, int dist, int node);
+int McfPop(McfHeap *heap, int *dist, int *node);
+void IntegrateFlows(McfNetwork *net, float *phase, float *soln);
+void MarkFlows(McfNetwork *net, unsigned char *bitflags, int code);
+double FlowCost(McfNetwork *net);
+int McfNegativeArcs(McfNetwork *net);
+#endif
@@ -0,0 +1,380 @@
+/*
+ *  mgprecon.c -- weighted multigrid V-cycle used as the
+ *                preconditioner of the PCG algorithm
+ */
+#include <stdio.h>
+#include <math.h>
+#include <malloc.h>
+#include "file.h"
+#include "util.h"
+#include "gridops.h"
+#include "mgprecon.h"
+
+/* Allocate the grids of the multigrid preconditioner for the    */
+/* Laplacian with the weights dxwts and dywts (see               */
+/* AllocateStencil).  numit is the number of relaxation sweeps   */
+/* before and after each coarse grid correction, and mindim is   */
+/* the smallest coarse grid dimension (0 for the default; see    */
+/* Coarsest in gridops.c).                                       */
+MgPrecond *AllocateMgPrecond(float *dxwts, float *dywts, int xsize,
+                             int ysize, int numit, int mindim)
+{
+  int        n, w, h, num_levels, weighted;
+  MgPrecond  *mg;
+  w = xsize;
+  h = ysize;
+  for (num_levels=1; !Coarsest(w, h, mindim); num_levels++) {
+    w = (w + 1)/2;
+    h = (h + 1)/2;
+  }
+  mg = (MgPrecond *) malloc(sizeof(MgPrecond));
+  if (!mg)
+    ErrorHandler("Cannot allocate memory", "multigrid preconditioner",
+                 MEMORY_ALLOCATION_ERROR);
+  mg->num_levels = num_levels;
+  mg->numit = (numit < 1) ? 1 : numit;
+  AllocateInt(&mg->w, num_levels, "multigrid preconditioner");
+  AllocateInt(&mg->h, num_levels, "multigrid preconditioner");
+  mg->xwts = (float **) calloc(num_levels, sizeof(float *));
+  mg->ywts = (float **) calloc(num_levels, sizeof(float *));
+  mg->temp = (float **) calloc(num_levels, sizeof(float *));
+  mg->rhs = (float **) calloc(num_levels, sizeof(float *));
+  mg->soln = (float **) calloc(num_levels, sizeof(float *));
+  mg->resid = (float **) calloc(num_levels, sizeof(float *));
+  mg->stencil = (Stencil **) calloc(num_levels, sizeof(Stencil *));
+  if (!mg->xwts || !mg->ywts || !mg->temp || !mg->rhs || !mg->soln
+                || !mg->resid || !mg->stencil)
+    ErrorHandler("Cannot allocate memory", "multigrid preconditioner",
+                 MEMORY_ALLOCATION_ERROR);
+  weighted = (dxwts || dywts);
+  mg->w[0] = xsize;
+  mg->h[0] = ysize;
+  mg->stencil[0] = AllocateStencil(dxwts, dywts, xsize, ysize);
+  AllocateFloat(&mg->resid[0], xsize*ysize, "multigrid arrays");
+  for (n=1; n<num_levels; n++) {
+    w = mg->w[n] = (mg->w[n - 1] + 1)/2;
+    h = mg->h[n] = (mg->h[n - 1] + 1)/2;
+    if (weighted) {
+      AllocateFloat(&mg->xwts[n], w*h, "multigrid weights");
+      AllocateFloat(&mg->ywts[n], w*h, "multigrid weights");
+    }
+    AllocateFloat(&mg->temp[n], mg->w[n - 1]*h, "multigrid arrays");
+    mg->stencil[n] = AllocateStencil(mg->xwts[n], mg->ywts[n], w, h);
+    AllocateFloat(&mg->rhs[n], w*h, "multigrid arrays");
+    AllocateFloat(&mg->soln[n], w*h, "multigrid arrays");
+    AllocateFloat(&mg->resid[n], w*h, "multigrid arrays");
+  }
+  if (weighted) SetMgPrecondWeights(mg, dxwts, dywts);
+  return mg;
+}
+
+/* Free the grids */
+void FreeMgPrecond(MgPrecond *mg)
+{
+  int  n;
+  if (!mg) return;
+  for (n=0; n<mg->num_levels; n++) {
+    if (mg->xwts[n]) free(mg->xwts[n]);
+    if (mg->ywts[n]) free(mg->ywts[n]);
+    if (mg->temp[n]) free(mg->temp[n]);
+    if (n > 0) {
+      free(mg->rhs[n]);
+      free(mg->soln[n]);
+    }
+    free(mg->resid[n]);
+    FreeStencil(mg->stencil[n]);
+  }
+  free(mg->w);
+  free(mg->h);
+  free(mg->xwts);
+  free(mg->ywts);
+  free(mg->temp);
+  free(mg->rhs);
+  free(mg->soln);
+  free(mg->resid);
+  free(mg->stencil);
+  free(mg);
+}
+
+/* Set the weights of the fine grid stencil, and coarsen them to  */
+/* the coarse grids.  The weights are kept above MG_WEIGHT_FLOOR  */
+/* times the largest one, so the masked (zero-weight) pixels are  */
+/* filled in smoothly and the coarse grids are not split into     */
+/* separate pieces.                                               */
+void SetMgPrecondWeights(MgPrecond *mg, float *dxwts, float *dywts)
+{
+  int      k, n, size;
+  double   floor;
+  Stencil  *stencil = mg->stencil[0];
+  if (!stencil->w1) return;   /* unweighted */
+  SetStencilWeights(stencil, dxwts, dywts);
+  size = mg->w[0]*mg->h[0];
+  for (k=0, floor=0.0; k<size; k++) {
+    if (floor < stencil->w1[k]) floor = stencil->w1[k];
+    if (floor < stencil->w3[k]) floor = stencil->w3[k];
+  }
+  FloorStencilWeights(stencil, MG_WEIGHT_FLOOR*floor);
+  for (n=1; n<mg->num_levels; n++) {
+    stencil = mg->stencil[n];
+    CoarsenStencil(mg->xwts[n], mg->ywts[n], mg->w[n], mg->h[n],
+                   mg->stencil[n - 1]);
+    SetStencilWeights(stencil, mg->xwts[n], mg->ywts[n]);
+  }
+}
+
+/* Raise the stencil weights below floor to floor */
+void FloorStencilWeights(Stencil *stencil, double floor)
+{
+  int  k, n = stencil->xsize*stencil->ysize;
+  for (k=0; k<n; k++) {
+    if (stencil->w1[k] < floor) stencil->w1[k] = floor;
+    if (stencil->w2[k] < floor) stencil->w2[k] = floor;
+    if (stencil->w3[k] < floor) stencil->w3[k] = floor;
+    if (stencil->w4[k] < floor) stencil->w4[k] = floor;
+  }
+}
+
+/* Compute the edge weights of the coarse grid from the stencil   */
+/* of the fine grid.  The coarse pixel (i,j) is the fine pixel    */
+/* (2i,2j), so a coarse edge crosses two fine edges in series     */
+/* (which are combined like conductances) and spans three rows    */
+/* or columns of them in parallel (which are combined with the    */
+/* weights 1/4, 1/2, 1/4).  xwts[k] is the weight of the edge     */
+/* from k to k + 1, and ywts[k] is that from k to k + wc.  The    */
+/* coarse weights of a unit stencil are 1.                        */
+void CoarsenStencil(float *xwts, float *ywts, int wc, int hc,
+                    Stencil *fine)
+{
+  int     i, j, k, m, a, b, c, wf = fine->xsize;
+  double  sum, e1, e2, scale;
+  for (j=0; j<hc; j++) {
+    for (i=0; i<wc; i++) {
+      k = j*wc + i;
+      /* x edges */
+      if (i < wc - 1) {
+        for (m=-1, sum=0.0; m<=1; m++) {
+          b = (2*j + m < 0) ? 1 : 2*j + m;
+          c = b*wf + 2*i;
+          e1 = fine->w1[c];
+          e2 = fine->w1[c + 1];
+          scale = (m==0) ? 1.0 : 0.5;
+          if (e1 + e2 > 0.0) sum += scale*e1*e2/(e1 + e2);
+        }
+        xwts[k] = sum;
+      }
+      else {
+        xwts[k] = (i > 0) ? xwts[k - 1] : 0.0;
+      }
+      /* y edges */
+      if (j < hc - 1) {
+        for (m=-1, sum=0.0; m<=1; m++) {
+          a = (2*i + m < 0) ? 1 : 2*i + m;
+          c = 2*j*wf + a;
+          e1 = fine->w3[c];
+          e2 = fine->w3[c + wf];
+          scale = (m==0) ? 1.0 : 0.5;
+          if (e1 + e2 > 0.0) sum += scale*e1*e2/(e1 + e2);
+        }
+        ywts[k] = sum;
+      }
+      else {
+        ywts[k] = (j > 0) ? ywts[k - wc] : 0.0;
+      }
+    }
+  }
+}
+
+/* Apply one V-cycle, starting from zero, to the equation Q z = r, */
+/* where Q is the (weighted) Laplacian, r is rarray and z is       */
+/* zarray.  Relaxation before the coarse grid correction sweeps    */
+/* the red then the black pixels, and after it the black then the  */
+/* red.                                                            */
+void MgPrecondition(float *rarray, float *zarray, MgPrecond *mg)
+{
+  mg->rhs[0] = rarray;
+  mg->soln[0] = zarray;
+  Zero(zarray, mg->w[0], mg->h[0]);
+  PrecondVcycle(mg, 0);
+}
+
+/* V-cycle of the preconditioner (called recursively).  The        */
+/* reflecting borders make the Laplacian Q = D^-1 S, where S is     */
+/* symmetric and D is 1/2 on the edges (1/4 at the corners) and 1   */
+/* elsewhere.  The residual is scaled by D before the restriction   */
+/* and by D^-1 after it, so that the restriction matches the        */
+/* prolongation and the V-cycle, like the cosine transform          */
+/* solution, is symmetric for the inner product weighted by D.      */
+void PrecondVcycle(MgPrecond *mg, int level)
+{
+  int      w = mg->w[level], h = mg->h[level], w2, h2;
+  float    *soln = mg->soln[level], *rhs = mg->rhs[level];
+  Stencil  *stencil = mg->stencil[level];
+  if (level < mg->num_levels - 1) {
+    w2 = mg->w[level + 1];
+    h2 = mg->h[level + 1];
+    RelaxStencil(stencil, soln, rhs, mg->numit, 0);
+    StencilResidual(stencil, soln, rhs, mg->resid[level]);
+    ScaleBorder(mg->resid[level], w, h, 0.5);
+    RestrictStencil(mg->rhs[level + 1], w2, h2, mg->resid[level],
+                    w, h, mg->temp[level + 1], stencil);
+    ScaleBorder(mg->rhs[level + 1], w2, h2, 2.0);
+    Zero(mg->soln[level + 1], w2, h2);
+    PrecondVcycle(mg, level + 1);
+    ProlongStencil(soln, w, h, mg->soln[level + 1], w2, h2,
+                   mg->temp[level + 1], stencil);
+    RelaxStencil(stencil, soln, rhs, mg->numit, 1);
+  }
+  else { /* coarsest */
+    RelaxStencil(stencil, soln, rhs, w*h, 0);
+    RelaxStencil(stencil, soln, rhs, w*h, 1);
+  }
+}
+
+/* Multiply the pixels on the edges of the array by factor (those */
+/* at the corners by its square)                                  */
+void ScaleBorder(float *array, int w, int h, double factor)
+{
+  int  i, j;
+  for (i=0; i<w; i++) {
+    array[i] *= factor;
+    array[(h - 1)*w + i] *= factor;
+  }
+  for (j=0; j<h; j++) {
+    array[j*w] *= factor;
+    array[j*w + w - 1] *= factor;
+  }
+}
+
+/* Red-black Gauss-Seidel relaxation of Q soln = rhs, where Q is */
+/* the (weighted) Laplacian of the stencil.  Each sweep relaxes  */
+/* the red pixels (i + j even) and then the black ones, or the   */
+/* black and then the red if reverse is nonzero.  A pixel with   */
+/* zero weights is set to the average of its neighbors.         */
+void RelaxStencil(Stencil *stencil, float *soln, float *rhs,
+                  int numit, int reverse)
+{
+  int     i, j, k, n, ipass, color;
+  int     k1, k2, k3, k4;
+  int     w = stencil->xsize, h = stencil->ysize;
+  double  w1, w2, w3, w4, norm;
+  w1 = w2 = w3 = w4 = 1.0;
+  for (n=0; n<numit; n++) {
+    for (ipass=0; ipass<2; ipass++) {
+      color = (reverse) ? 1 - ipass : ipass;
+      for (j=0; j<h; j++) {
+        for (i=(j + color)%2; i<w; i+=2) {
+          k = j*w + i;
+          k1 = (i < w - 1) ? k + 1 : k - 1;
+          k2 = (i > 0) ? k - 1 : k + 1;
+          k3 = (j < h - 1) ? k + w : k - w;
+          k4 = (j > 0) ? k - w : k + w;
+          if (stencil->w1) {
+            w1 = stencil->w1[k];    w2 = stencil->w2[k];
+            w3 = stencil->w3[k];    w4 = stencil->w4[k];
+          }
+          norm = w1 + w2 + w3 + w4;
+          if (norm > 1.0e-6) {
+            soln[k] = (rhs[k] + w1*soln[k1] + w2*soln[k2]
+                          + w3*soln[k3] + w4*soln[k4])/norm;
+          }
+          else {
+            soln[k] = 0.25*(soln[k1] + soln[k2] + soln[k3] + soln[k4]);
+          }
+        }
+      }
+    }
+  }
+}
+
+/* Compute resid = rhs - Q soln, where Q is the (weighted)       */
+/* Laplacian of the stencil                                      */
+void StencilResidual(Stencil *stencil, float *soln, float *rhs,
+                     float *resid)
+{
+  int  i, j, k, w = stencil->xsize;
+  for (j=0; j<stencil->ysize; j++) {
+    StencilOperatorRow(stencil, soln, resid, j);
+    for (i=0, k=j*w; i<w; i++, k++) {
+      resid[k] = rhs[k] - resid[k];
+    }
+  }
+}
+
+/* Multigrid prolongation operator of the preconditioner: adds   */
+/* the coarse grid values, interpolated to the fine grid, to     */
+/* fine.  The values are interpolated along the rows and then    */
+/* along the columns, weighted by the edge weights of the fine   */
+/* stencil.  temp is a scratch array of wf x hc values.          */
+void ProlongStencil(float *fine, int wf, int hf, float *coarse,
+                    int wc, int hc, float *temp, Stencil *stencil)
+{
+  int     a, b, j, lo;
+  double  c, v;
+  for (j=0; j<hc; j++) {
+    b = 2*j;
+    for (a=0; a<wf; a++) {
+      c = InterpCoef(stencil->w1, b*wf + a, 1, a, wc, &lo);
+      v = c*coarse[j*wc + lo];
+      if (lo + 1 < wc) v += (1.0 - c)*coarse[j*wc + lo + 1];
+      temp[j*wf + a] = v;
+    }
+  }
+  for (b=0; b<hf; b++) {
+    for (a=0; a<wf; a++) {
+      c = InterpCoef(stencil->w3, b*wf + a, wf, b, hc, &lo);
+      v = c*temp[lo*wf + a];
+      if (lo + 1 < hc) v += (1.0 - c)*temp[(lo + 1)*wf + a];
+      fine[b*wf + a] += v;
+    }
+  }
+}
+
+/* Multigrid restriction operator of the preconditioner: the     */
+/* transpose of ProlongStencil.  temp is a scratch array of      */
+/* wf x hc values.                                               */
+void RestrictStencil(float *coarse, int wc, int hc, float *fine,
+                     int wf, int hf, float *temp, Stencil *stencil)
+{
+  int     a, b, j, lo;
+  double  c, v;
+  Zero(temp, wf, hc);
+  for (b=0; b<hf; b++) {
+    for (a=0; a<wf; a++) {
+      c = InterpCoef(stencil->w3, b*wf + a, wf, b, hc, &lo);
+      v = fine[b*wf + a];
+      temp[lo*wf + a] += c*v;
+      if (lo + 1 < hc) temp[(lo + 1)*wf + a] += (1.0 - c)*v;
+    }
+  }
+  Zero(coarse, wc, hc);
+  for (j=0; j<hc; j++) {
+    b = 2*j;
+    for (a=0; a<wf; a++) {
+      c = InterpCoef(stencil->w1, b*wf + a, 1, a, wc, &lo);
+      v = temp[j*wf + a];
+      coarse[j*wc + lo] += c*v;
+      if (lo + 1 < wc) coarse[j*wc + lo + 1] += (1.0 - c)*v;
+    }
+  }
+}
+
+/* Interpolation coefficient for the fine grid index a (of the   */
+/* row or column of pixel k) from the coarse grid indexes lo and */
+/* lo + 1 (of nc), where the weight of lo is returned and that   */
+/* of lo + 1 is one minus it.  wts are the edge weights of the   */
+/* fine stencil from k to k + step (or null if unweighted).      */
+double InterpCoef(float *wts, int k, int step, int a, int nc,
+                  int *lo)
+{
+  double  e1, e2;
+  if (a%2==0 && a/2 < nc) {   /* coarse grid pixel */
+    *lo = a/2;
+    return 1.0;
+  }
+  *lo = (a - 1)/2;
+  if (*lo + 1 >= nc) return 1.0;   /* beyond the last one */
+  if (!wts) return 0.5;
+  e1 = wts[k - step];
+  e2 = wts[k];
+  return (e1 + e2 > 0.0) ? e1/(e1 + e2) : 0.5;
+}
@@ -0,0 +1,42 @@
+#ifndef __MGPRECON
+#define __MGPRECON
+#include "laplace.h"
+/* relaxation sweeps before and after each coarse grid correction */
+#define MG_PRECOND_SWEEPS  2
+/* smallest stencil weight of the preconditioner, relative to the */
+/* largest one                                                    */
+#define MG_WEIGHT_FLOOR    1.0e-3
+/* Grids of the multigrid preconditioner.  Level 0 is the full   */
+/* array, and pixel (i,j) of each coarser level is pixel (2i,2j) */
+/* of the one above it.  xwts and ywts are the coarse grid edge  */
+/* weights (see CoarsenStencil), and temp is scratch memory for  */
+/* the prolongation and restriction.                             */
+typedef struct {
+  int      num_levels;
+  int      numit;            /* relaxation sweeps per level */
+  int      *w, *h;
+  float    **xwts, **ywts, **temp;
+  Stencil  **stencil;
+  float    **rhs, **soln, **resid;
+} MgPrecond;
+MgPrecond *AllocateMgPrecond(float *dxwts, float *dywts, int xsize,
+                             int ysize, int numit, int mindim);
+void FreeMgPrecond(MgPrecond *mg);
+void SetMgPrecondWeights(MgPrecond *mg, float *dxwts, float *dywts);
+void FloorStencilWeights(Stencil *stencil, double floor);
+void CoarsenStencil(float *xwts, float *ywts, int wc, int hc,
+                    Stencil *fine);
+void MgPrecondition(float *rarray, float *zarray, MgPrecond *mg);
+void PrecondVcycle(MgPrecond *mg, int level);
+void ScaleBorder(float *array, int w, int h, double factor);
+void RelaxStencil(Stencil *stencil, float *soln, float *rhs,
+                  int numit, int reverse);
+void StencilResidual(Stencil *stencil, float *soln, float *rhs,
+                     float *resid);
+void ProlongStencil(float *fine, int wf, int hf, float *coarse,
+                    int wc, int hc, float *temp, Stencil *stencil);
+void RestrictStencil(float *coarse, int wc, int hc, float *fine,
+                     int wf, int hf, float *temp, Stencil *stencil);
+double InterpCoef(float *wts, int k, int step, int a, int nc,
+                  int *lo);
+#endif
@@ -17,8 +17,8 @@ int UnwrapAroundCuts(float *phase, unsigned char *bitflags,
   int  i, j, k, a, b, c, n, num_pieces=0;
   float  value;
   float  min_qual, small_val = -1.0E+10;
-  int    num_index, max_list_size, bench, benchout;
-  int    *index_list;
+  int    bench, benchout;
+  PixelQueue  *queue;
   int    unwrapped_code=UNWRAPPED, postponed_code = POSTPONED;
   int    avoid_code; 
 
@@ -26,15 +26,12 @@ int UnwrapAroundCuts(float *phase, unsigned char *bitflags,
   if (bench < 1) bench = 1;
   benchout = 10*bench;
   min_qual = small_val;
-  max_list_size = xsize*ysize; /* this size may be reduced */
-  AllocateInt(&index_list, max_list_size + 1, 
-              "bookkeeping list (index)");
+  queue = AllocatePixelQueue(stack_queue, xsize, ysize, 0.0, 0.0);
 
   avoid_code = cut_code | unwrapped_code | BORDER;
 
   /* find starting point */
   n = 0;
-  num_index = 0;
   for (j=0; j<ysize; j++) {
     for (i=0; i<xsize; i++) {
       k = j*xsize + i;
@@ -48,10 +45,9 @@ int UnwrapAroundCuts(float *phase, unsigned char *bitflags,
           value = soln[k] = phase[k];
         }
         UpdateList(NULL, i, j, value, phase, soln, bitflags, xsize,
-                   ysize, index_list, &num_index, avoid_code,
-                   unwrapped_code, postponed_code, max_list_size,
-                   0, &min_qual);
-        while (num_index > 0) {
+                   ysize, queue, avoid_code, unwrapped_code,
+                   postponed_code, 0, &min_qual);
+        while (queue->size > 0) {
           if (n%bench==0) {
             printf("%d ", n/bench);
             fflush(stdout);
@@ -64,22 +60,20 @@ int UnwrapAroundCuts(float *phase, unsigned char *bitflags,
             }
           }
           ++n;
-          if (!GetNextOneToUnwrap(&a, &b, index_list,
-                                  &num_index, xsize, ysize))
+          if (!GetNextOneToUnwrap(&a, &b, queue, xsize, ysize))
             break;   /* no more to unwrap */
           c = b*xsize + a;
           bitflags[c] |= unwrapped_code;
           value = soln[c];        
           UpdateList(NULL, a, b, value, phase, soln, bitflags,
-                     xsize, ysize, index_list, &num_index,
-                     avoid_code, unwrapped_code, postponed_code,
-                     max_list_size, 0, &min_qual);
+                     xsize, ysize, queue, avoid_code, unwrapped_code,
+                     postponed_code, 0, &min_qual);
         }
       }
     }
   }
   printf("\n");
-  free(index_list);
+  FreePixelQueue(queue);
   /* unwrap branch cut pixels */
   for (j=1; j<ysize; j++) {
     for (i=1; i<xsize; i++) {
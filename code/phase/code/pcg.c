@@ -3,138 +3,159 @@
  *           of weighted least-squares phase-unwrapping problem
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "solncos.h"
 #include "pcg.h"
 #include "util.h"
-#define SIMIN(x,y) (((x)*(x) < (y)*(y)) ? (x)*(x) : (y)*(y))
 
-/* Main function of PCG algorithm for phase unwrapping.  If dywts */
-/* is null, then the dx and dy weights are calculated from dxwts  */
+/* Main function of PCG algorithm for phase unwrapping.  The      */
+/* stencil holds the weights of the Laplacian (see laplace.c,     */
+/* AllocateStencil).  The preconditioner is the unweighted soln   */
+/* by cosine transforms, or one weighted multigrid V-cycle if     */
+/* precond is not null (see mgprecon.c).  The cosine transform    */
+/* plan is made by AllocateCosinePlan(xsize, ysize); if it is     */
+/* null, a plan is made for this call only.  Once the residual    */
+/* reaches the round-off level of the float arrays, further       */
+/* iterations can make it grow again: if epsi rises above         */
+/* PCG_RISE_FACTOR times its lowest value, the iterations stop.   */
+/* Whenever the last iteration did not reach the lowest epsi, the */
+/* solution of that lowest value is returned.                     */
 void PCGUnwrap(float *rarray, float *zarray, float *parray,
-               float *soln, float *dxwts, float *dywts, int xsize,
-               int ysize, int max_iter, double epsi_con)
+               float *soln, Stencil *stencil, int xsize,
+               int ysize, int max_iter, double epsi_con,
+               CosinePlan *plan, MgPrecond *precond)
 {
-  int      i, j, k, iloop;
-  double   sum, alpha, beta, beta_prev, epsi;
-  double   *xcos, *ycos;
-  for (k=0, sum=0.0; k<xsize*ysize; k++)
+  int         k, iloop, n = xsize*ysize;
+  double      sum, alpha, beta, beta_prev, epsi=-1.0, rsum, savg;
+  double      best_epsi = -1.0;
+  float       *best;
+  CosinePlan  *own_plan=NULL;
+  for (k=0, sum=0.0, rsum=0.0; k<xsize*ysize; k++) {
     sum += rarray[k]*rarray[k];
+    rsum += rarray[k];
+  }
   sum = sqrt(sum/(xsize*ysize));
-  AllocateDouble(&xcos, xsize, "cosine terms");
-  AllocateDouble(&ycos, ysize, "cosine terms");
+  savg = 0.0;
+  if (!plan && !precond) plan = own_plan = AllocateCosinePlan(xsize, ysize, 1);
+  AllocateFloat(&best, n, "best solution");
   for (iloop=0; iloop < max_iter; iloop++) {
-    PCGIterate(rarray, zarray, parray, soln, dxwts, dywts, 
-               xsize, ysize, xcos, ycos, iloop, sum, &alpha,
-               &beta, &beta_prev, &epsi);
+    PCGIterate(rarray, zarray, parray, soln, stencil,
+               xsize, ysize, plan, precond, iloop, sum, &alpha,
+               &beta, &beta_prev, &epsi, &rsum, &savg);
+    if (best_epsi < 0.0 || epsi < best_epsi) {
+      /* save the solution, without its bias */
+      best_epsi = epsi;
+      for (k=0; k<n; k++)  best[k] = soln[k] - savg;
+    }
+    else if (epsi > PCG_RISE_FACTOR*best_epsi) {
+      printf("Breaking out of main loop (residual rising)\n");
+      break;
+    }
     if (epsi < epsi_con) {
       printf("Breaking out of main loop (due to convergence)\n");
       break;
     }
   }
-  free(xcos);
-  free(ycos);
+  if (best_epsi >= 0.0 && epsi > best_epsi) {
+    printf("Restoring solution of EPSI %lg\n", best_epsi);
+    for (k=0; k<n; k++)  soln[k] = best[k];
+  }
+  else {
+    /* remove the constant bias left in soln by the last iteration */
+    for (k=0; k<n; k++)  soln[k] -= savg;
+  }
+  free(best);
+  FreeCosinePlan(own_plan);
 } 
 
-/* Main function within iterative loop of PCG algorithm. */
+/* Main function within iterative loop of PCG algorithm.  The     */
+/* updates and reductions are fused into five passes through the  */
+/* arrays.  rsum is the sum of rarray, which is computed in the   */
+/* last pass for the next iteration.  The bias savg of soln is    */
+/* also carried to the next iteration (or to the end of           */
+/* PCGUnwrap) and removed there; the results are the same as if   */
+/* each step were done in a separate pass.                        */
 void PCGIterate(float *rarray, float *zarray, float *parray,
-                float *soln, float *dxwts, float *dywts, int xsize,
-                int ysize, double *xcos, double *ycos, int iloop,
+                float *soln, Stencil *stencil, int xsize,
+                int ysize, CosinePlan *plan, MgPrecond *precond,
+                int iloop,
                 double sum0, double *alpha, double *beta,
-                double *beta_prev, double *epsi)
+                double *beta_prev, double *epsi, double *rsum,
+                double *savg)
 {
-  int     i, j, k;
-  int     k1, k2, k3, k4;
-  double  sum, w1, w2, w3, w4, btemp, delta, avg, scale;
-  float   *wts;
+  int     i, j, k, n;
+  double  btemp, delta, avg, scale;
+  double  psum, qsum, esum, dsum, ssum, rs;
+  float   s;
 
-  scale = 1.0/(xsize*ysize);
-  /* remove constant bias from rarray */
-  for (k=0, avg=0.0; k<xsize*ysize; k++)  avg += rarray[k];
-  avg *= scale;
-  for (k=0; k<xsize*ysize; k++)  rarray[k] -= avg;
-  /* compute cosine transform solution of Laplacian in rarray */
-  for (k=0; k<xsize*ysize; k++)  {
+  n = xsize*ysize;
+  scale = 1.0/n;
+  /* remove constant bias from rarray, and copy it to zarray */
+  avg = (*rsum)*scale;
+  for (k=0; k<n; k++)  {
+    rarray[k] -= avg;
     zarray[k] = rarray[k];
   }
-  DirectSolnByCosineTransform(zarray, xsize, ysize, xcos, ycos);
-  /* calculate beta and parray */
-  for (k=0, *beta=0.0; k<xsize*ysize; k++) {
+  /* compute preconditioned residual in zarray: the cosine    */
+  /* transform solution of Laplacian, or a multigrid V-cycle   */
+  if (precond)
+    MgPrecondition(rarray, zarray, precond);
+  else
+    DirectSolnByCosineTransform(zarray, xsize, ysize, plan);
+  /* calculate beta */
+  for (k=0, *beta=0.0; k<n; k++) {
     *beta += rarray[k]*zarray[k];
   }
   printf("beta = %lf\n", *beta);
+  /* calculate parray and its sum */
+  psum = 0.0;
   if (iloop == 0) {
-    for (k=0; k<xsize*ysize; k++) {
+    for (k=0; k<n; k++) {
       parray[k] = zarray[k];
+      psum += parray[k];
     }
   }
   else {
     btemp = (*beta)/(*beta_prev);
-    for (k=0; k<xsize*ysize; k++) {
+    for (k=0; k<n; k++) {
       parray[k] = zarray[k] + btemp*parray[k];
+      psum += parray[k];
     }
   }
-  /* remove constant bias from parray */
-  for (k=0, avg=0.0; k<xsize*ysize; k++)  avg += parray[k];
-  avg *= scale;
-  for (k=0; k<xsize*ysize; k++)  parray[k] -= avg;
+  avg = psum*scale;
   *beta_prev = *beta;
-  /* calculate Qp */
-  for (j=0; j<ysize; j++) {
-    for (i=0; i<xsize; i++) {
-      k = j*xsize + i;
-      k1 = (i<xsize-1) ? k + 1 : k - 1;
-      k2 = (i>0) ? k - 1 : k + 1;
-      k3 = (j<ysize-1) ? k + xsize : k - xsize;
-      k4 = (j>0) ? k - xsize : k + xsize;
-      if (dxwts==NULL && dywts==NULL) {  /* unweighted */
-        w1 = w2 = w3 = w4 = 1.0;
-      }
-      else if (dxwts==NULL || dywts==NULL) {  /* one set of wts */
-        wts = (dxwts) ? dxwts : dywts;
-        w1 = SIMIN(wts[k], wts[k1]);
-        w2 = SIMIN(wts[k], wts[k2]);
-        w3 = SIMIN(wts[k], wts[k3]);
-        w4 = SIMIN(wts[k], wts[k4]);
-      }
-      else {    /* dxwts and dywts are both supplied */
-        w1 = dxwts[k];
-        w2 = (i>0) ? dxwts[k-1] : dxwts[k];
-        w3 = dywts[k];
-        w4 = (j>0) ? dywts[k-xsize] : dywts[k];
-      }
-
-      zarray[k] = (w1 + w2 + w3 + w4)*parray[k]
-                        - (w1*parray[k1] + w2*parray[k2] 
-                                + w3*parray[k3] + w4*parray[k4]);
+  /* calculate Qp (in zarray) and alpha.  The constant bias is */
+  /* removed from each row of parray one row ahead of Qp.     */
+  for (i=0; i<xsize; i++)  parray[i] -= avg;
+  for (j=0, qsum=0.0; j<ysize; j++) {
+    if (j < ysize - 1) {
+      for (i=0; i<xsize; i++)  parray[(j + 1)*xsize + i] -= avg;
+    }
+    StencilOperatorRow(stencil, parray, zarray, j);
+    for (i=0, k=j*xsize; i<xsize; i++, k++) {
+      qsum += zarray[k]*parray[k];
     }
   }
-  /* calculate alpha */
-  for (k=0, *alpha=0.0; k<xsize*ysize; k++) {
-    *alpha += zarray[k]*parray[k];
-  }
-  *alpha = *beta/(*alpha);
+  *alpha = *beta/qsum;
   printf("alpha = %lf\n", *alpha);
-  /* update rarray */
-  for (k=0; k<xsize*ysize; k++) {
+  /* update rarray and soln (removing the bias left by the last */
+  /* iteration), and compute the sums for epsi, delta, the bias */
+  /* of soln and the bias of rarray                             */
+  esum = dsum = ssum = rs = 0.0;
+  for (k=0; k<n; k++) {
     rarray[k] -= (*alpha)*zarray[k];
+    s = soln[k] - (*savg);
+    soln[k] = s + (*alpha)*parray[k];
+    esum += rarray[k]*rarray[k];
+    dsum += (*alpha)*(*alpha)*parray[k]*parray[k];
+    ssum += soln[k];
+    rs += rarray[k];
   }
-  /* update parray */
-  for (k=0; k<xsize*ysize; k++) {
-    soln[k] += (*alpha)*parray[k];
-  }
-  /* remove constant bias from soln */
-  for (k=0, avg=0.0; k<xsize*ysize; k++)  avg += soln[k];
-  avg *= scale;
-  for (k=0; k<xsize*ysize; k++)  soln[k] -= avg;
+  *savg = ssum*scale;
+  *rsum = rs;
   /* compute epsi and delta */
-  for (k=0, sum=0.0; k<xsize*ysize; k++) {
-    sum += rarray[k]*rarray[k];
-  }
-  *epsi = sqrt(sum/(xsize*ysize))/sum0;
-  for (k=0, sum=0.0; k<xsize*ysize; k++) {
-    sum += (*alpha)*(*alpha)*parray[k]*parray[k];
-  }
-  delta = sqrt(sum/(xsize*ysize));
+  *epsi = sqrt(esum/n)/sum0;
+  delta = sqrt(dsum/n);
   printf("ITER %d: EPSI %lf DELTA %lf\n", iloop, *epsi, delta);
 }
@@ -1,11 +1,19 @@
 #ifndef __PCG
 #define __PCG
+#include "dct.h"
+#include "laplace.h"
+#include "mgprecon.h"
+/* the iterations stop when epsi rises above this factor times */
+/* its lowest value (see PCGUnwrap)                            */
+#define PCG_RISE_FACTOR  10.0
 void PCGUnwrap(float *rarray, float *zarray, float *parray, 
-               float *soln, float *dxwts, float *dywts, int xsize,
-               int ysize, int max_iter, double epsi_con);
+               float *soln, Stencil *stencil, int xsize,
+               int ysize, int max_iter, double epsi_con,
+               CosinePlan *plan, MgPrecond *precond);
 void PCGIterate(float *rarray, float *zarray, float *parray,
-                float *soln, float *dxwts, float *dywts, int xsize,
-                int ysize, double *xcos, double *ycos, int iloop,
-                double sum0, double *alpha, double *beta,
-                double *beta_prev, double *epsi);
+                float *soln, Stencil *stencil, int xsize,
+                int ysize, CosinePlan *plan, MgPrecond *precond,
+                int iloop, double sum0, double *alpha, double *beta,
+                double *beta_prev, double *epsi, double *rsum,
+                double *savg);
 #endif
@@ -0,0 +1,152 @@
+/*
+ *  pool.c -- a pool of worker threads for running independent
+ *            tasks (e.g., the 1-dim transforms of a 2-dim DCT)
+ *            in parallel
+ */
+#include <stdio.h>
+#include <malloc.h>
+#include "file.h"
+#include "util.h"
+#include "pool.h"
+
+/* Worker thread index and the pool it belongs to */
+typedef struct {
+  ThreadPool  *pool;
+  int         worker;
+} PoolWorkerArg;
+
+/* Start a pool of num_threads threads.  The calling thread counts */
+/* as one of them (it runs tasks in RunThreadPool), so num_threads */
+/* - 1 new threads are created.  If num_threads <= 1, no threads   */
+/* are created and the tasks are run serially.                     */
+ThreadPool *AllocateThreadPool(int num_threads)
+{
+  int            t;
+  ThreadPool     *pool;
+  PoolWorkerArg  *args;
+  if (num_threads < 1) num_threads = 1;
+  pool = (ThreadPool *) malloc(sizeof(ThreadPool));
+  args = (PoolWorkerArg *) malloc(num_threads*sizeof(PoolWorkerArg));
+  if (!pool || !args)
+    ErrorHandler("Cannot allocate memory", "thread pool",
+                 MEMORY_ALLOCATION_ERROR);
+  pool->num_threads = num_threads;
+  pool->threads = NULL;
+  pool->task = NULL;
+  pool->arg = NULL;
+  pool->num_tasks = pool->next_task = pool->busy = 0;
+  pool->generation = pool->quit = 0;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->busy = num_threads - 1;
+  if (num_threads > 1) {
+    pool->threads = (pthread_t *) malloc(num_threads*sizeof(pthread_t));
+    if (!pool->threads)
+      ErrorHandler("Cannot allocate memory", "thread pool",
+                   MEMORY_ALLOCATION_ERROR);
+    for (t=1; t<num_threads; t++) {
+      args[t].pool = pool;
+      args[t].worker = t;
+      if (pthread_create(&pool->threads[t], NULL, PoolWorker,
+                         &args[t]))
+        ErrorHandler("Cannot create thread", "thread pool",
+                     MEMORY_ALLOCATION_ERROR);
+    }
+  }
+  /* the workers copy their args before the first task is posted */
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busy > 0) pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+  free(args);
+  return pool;
+}
+
+/* Stop the threads and free the pool */
+void FreeThreadPool(ThreadPool *pool)
+{
+  int  t;
+  if (!pool) return;
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = 1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  for (t=1; t<pool->num_threads; t++) {
+    pthread_join(pool->threads[t], NULL);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  if (pool->threads) free(pool->threads);
+  free(pool);
+}
+
+/* Run task(arg, k, worker) for k = 0, ..., num_tasks - 1, and   */
+/* return when all are done.  Tasks are handed out in order to   */
+/* whichever thread is free.  If pool is null, the tasks are run */
+/* serially as worker 0.                                          */
+void RunThreadPool(ThreadPool *pool, PoolTask task, void *arg,
+                   int num_tasks)
+{
+  int  k;
+  if (!pool || pool->num_threads==1 || num_tasks<=1) {
+    for (k=0; k<num_tasks; k++) task(arg, k, 0);
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->task = task;
+  pool->arg = arg;
+  pool->num_tasks = num_tasks;
+  pool->next_task = 0;
+  pool->busy = pool->num_threads - 1;
+  ++pool->generation;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  RunPoolTasks(pool, 0);
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busy > 0) pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/* Take tasks from the pool until there are none left */
+void RunPoolTasks(ThreadPool *pool, int worker)
+{
+  int  k;
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    k = pool->next_task++;
+    pthread_mutex_unlock(&pool->lock);
+    if (k >= pool->num_tasks) break;
+    pool->task(pool->arg, k, worker);
+  }
+}
+
+/* Main function of each worker thread */
+void *PoolWorker(void *ptr)
+{
+  int         worker, generation;
+  ThreadPool  *pool;
+  pool = ((PoolWorkerArg *) ptr)->pool;
+  worker = ((PoolWorkerArg *) ptr)->worker;
+  pthread_mutex_lock(&pool->lock);
+  generation = pool->generation;
+  if (--pool->busy==0) pthread_cond_signal(&pool->done);
+  for (;;) {
+    while (generation==pool->generation && !pool->quit)
+      pthread_cond_wait(&pool->start, &pool->lock);
+    if (pool->quit) break;
+    generation = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+    RunPoolTasks(pool, worker);
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->busy==0) pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/* Number of threads in the pool (1 if pool is null) */
+int PoolThreads(ThreadPool *pool)
+{
+  return (pool) ? pool->num_threads : 1;
+}
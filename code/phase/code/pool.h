@@ -0,0 +1,22 @@
+#ifndef __POOL
+#define __POOL
+#include <pthread.h>
+/* task function: does task number "task" on thread number "worker" */
+typedef void (*PoolTask)(void *arg, int task, int worker);
+typedef struct {
+  int              num_threads;
+  pthread_t        *threads;
+  pthread_mutex_t  lock;
+  pthread_cond_t   start, done;
+  PoolTask         task;
+  void             *arg;
+  int              num_tasks, next_task, busy, generation, quit;
+} ThreadPool;
+ThreadPool *AllocateThreadPool(int num_threads);
+void FreeThreadPool(ThreadPool *pool);
+void RunThreadPool(ThreadPool *pool, PoolTask task, void *arg,
+                   int num_tasks);
+void RunPoolTasks(ThreadPool *pool, int worker);
+void *PoolWorker(void *ptr);
+int PoolThreads(ThreadPool *pool);
+#endif
@@ -2,7 +2,9 @@
  *  qualgrad.c -- functions for computing max gradient quality map
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
+#include "util.h"
 #include "qualgrad.h"
 #include "dxdygrad.h"
 
@@ -25,7 +27,7 @@ void MaxPhaseGradients(float *phase, float *result,
   add_flag = 1;
   printf("Extracting dy max's\n");
   /* add to dx max's */
-  DxGradMax(temp1, result, xsize, ysize, tsize, bitflags,
+  DyGradMax(temp1, result, xsize, ysize, tsize, bitflags,
             ignore_code, add_flag);
 }
 
@@ -35,33 +37,16 @@ void MaxPhaseGradients(float *phase, float *result,
 void DxGradMax(float *dx, float *dxmax, int xsize, int ysize,
    int tsize, unsigned char *bitflags, int avoid_code, int add_code)
 {
-  int    i, j, a, b, c, hs;
-  float  r, dmax;
+  int    i, hs;
   if (tsize < 3) {
     for (i=0; i<xsize*ysize; i++)
       dxmax[i] = (add_code) ? dxmax[i] + dx[i] : dx[i];
   }
   else {
     hs = tsize/2;
-    for (j=0; j<ysize; j++) {
-      for (i=0; i<xsize; i++) {
-        for (dmax = 0.0, b=j-hs; b<=j+hs; b++) {
-          if (b < 0 || b >= ysize) continue;
-          for (a=i-hs; a < i+hs; a++) {  /* a < to match dx */
-            if (a < 0 || a >= xsize) continue;
-            c = b*xsize + a;
-            if (bitflags && (bitflags[c]&avoid_code)) continue;
-            r = dx[c];
-            if (r < 0) r = -r;
-            if (dmax < r) dmax = r; 
-          }
-        }
-        if (add_code)
-          dxmax[j*xsize + i] += dmax;
-        else
-          dxmax[j*xsize + i] = dmax;
-      }
-    }   
+    /* the windows are one pixel narrower to match dx */
+    GradMaxFilter(dx, dxmax, xsize, ysize, -hs, hs - 1, -hs, hs,
+                  bitflags, avoid_code, add_code);
   }
 } 
 
@@ -71,33 +56,100 @@ void DxGradMax(float *dx, float *dxmax, int xsize, int ysize,
 void DyGradMax(float *dy, float *dymax, int xsize, int ysize,
    int tsize, unsigned char *bitflags, int avoid_code, int add_code)
 {
-  int    i, j, a, b, c, hs;
-  float  r, dmax;
+  int    i, hs;
   if (tsize < 3) {
     for (i=0; i<xsize*ysize; i++)
       dymax[i] = (add_code) ? dymax[i] + dy[i] : dy[i];
   }
   else {
     hs = tsize/2;
-    for (j=0; j<ysize; j++) {
-      for (i=0; i<xsize; i++) {
-        for (dmax = 0.0, b=j-hs; b < j+hs; b++) {  
-          /* b < j+hs to match dy */
-          if (b < 0 || b >= ysize) continue;
-          for (a=i-hs; a<=i+hs; a++) {
-            if (a < 0 || a >= xsize) continue;
-            c = b*xsize + a;
-            if (bitflags && (bitflags[c] & avoid_code)) continue;
-            r = dy[c];
-            if (r < 0) r = -r;
-            if (dmax < r) dmax = r; 
-          }
-        }
-        if (add_code)
-          dymax[j*xsize + i] += dmax;
-        else
-          dymax[j*xsize + i] = dmax;
-      }
-    }   
+    /* the windows are one pixel shorter to match dy */
+    GradMaxFilter(dy, dymax, xsize, ysize, -hs, hs, -hs, hs - 1,
+                  bitflags, avoid_code, add_code);
   }
 } 
+
+/* Compute the max of the absolute gradients in the window of  */
+/* columns i+xlo to i+xhi and rows j+ylo to j+yhi of each      */
+/* pixel (i,j), ignoring the pixels outside the image or       */
+/* marked with avoid_code (i.e., taking them as zero).  The    */
+/* max is separable, so the rows are filtered and then the     */
+/* columns.                                                    */
+void GradMaxFilter(float *grad, float *gmax, int xsize, int ysize,
+                   int xlo, int xhi, int ylo, int yhi,
+                   unsigned char *bitflags, int avoid_code,
+                   int add_code)
+{
+  int    j, k;
+  float  r, *absgrad, *rowmax, *run;
+  AllocateFloat(&absgrad, xsize*ysize, "absolute gradients");
+  AllocateFloat(&rowmax, xsize*ysize, "row max's");
+  AllocateFloat(&run, xsize, "running max's");
+  for (k=0; k<xsize*ysize; k++) {
+    r = grad[k];
+    if (r < 0) r = -r;
+    if ((bitflags && (bitflags[k]&avoid_code)) || !(r > 0)) r = 0.0;
+    absgrad[k] = r;
+  }
+  for (j=0; j<ysize; j++) {
+    RunningMax(absgrad + j*xsize, rowmax + j*xsize, xsize, 1, 1,
+               xlo, xhi, run);
+  }
+  RunningMax(rowmax, absgrad, ysize, xsize, xsize, ylo, yhi, run);
+  for (k=0; k<xsize*ysize; k++) {
+    if (add_code)
+      gmax[k] += absgrad[k];
+    else
+      gmax[k] = absgrad[k];
+  }
+  free(absgrad);
+  free(rowmax);
+  free(run);
+}
+
+/* Set out[i] to the max of in[i+lo], ..., in[i+hi] (nonnegative  */
+/* values, taken as zero beyond 0, ..., n-1) for i = 0, ..., n-1. */
+/* Each in[i] and out[i] is a vector of len floats, and they are  */
+/* stride floats apart.  By van Herk and Gil-Werman's method, the */
+/* padded sequence is cut into blocks of the window size w, and   */
+/* each window is the tail of one block and the head of the next, */
+/* so two running max's per block give all of the windows in      */
+/* about three comparisons per element, whatever w is.  The       */
+/* array run holds len floats.                                    */
+void RunningMax(float *in, float *out, int n, int len, int stride,
+                int lo, int hi, float *run)
+{
+  int    w = hi - lo + 1, m, m0, a, c, pos;
+  float  *p, *q;
+  /* max's from each element to the end of its block */
+  for (m0=0; m0<n; m0+=w) {
+    for (c=0; c<len; c++) run[c] = 0.0;
+    for (m=m0 + w - 1; m>=m0; m--) {
+      if ((a = m + lo) >= 0 && a < n) {
+        p = in + a*stride;
+        for (c=0; c<len; c++)
+          if (p[c] > run[c]) run[c] = p[c];
+      }
+      if (m < n) {
+        q = out + m*stride;
+        for (c=0; c<len; c++) q[c] = run[c];
+      }
+    }
+  }
+  /* max's from the start of each block, merged with the above */
+  for (m=0, pos=0; m<n + w - 1; m++, pos++) {
+    if (pos==w) pos = 0;
+    if (pos==0)
+      for (c=0; c<len; c++) run[c] = 0.0;
+    if ((a = m + lo) >= 0 && a < n) {
+      p = in + a*stride;
+      for (c=0; c<len; c++)
+        if (p[c] > run[c]) run[c] = p[c];
+    }
+    if (m >= w - 1) {
+      q = out + (m - w + 1)*stride;
+      for (c=0; c<len; c++)
+        if (run[c] > q[c]) q[c] = run[c];
+    }
+  }
+}
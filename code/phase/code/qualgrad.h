@@ -7,4 +7,10 @@ void DxGradMax(float *dx, float *dxvar, int xsize, int ysize,
    int size, unsigned char *bitflags, int avoid_code, int add_flag);
 void DyGradMax(float *dy, float *dyvar, int xsize, int ysize,
    int size, unsigned char *bitflags, int avoid_code, int add_flag);
+void GradMaxFilter(float *grad, float *gmax, int xsize, int ysize,
+                   int xlo, int xhi, int ylo, int yhi,
+                   unsigned char *bitflags, int avoid_code,
+                   int add_code);
+void RunningMax(float *in, float *out, int n, int len, int stride,
+                int lo, int hi, float *run);
 #endif
@@ -11,27 +11,55 @@
 int QualityGuidedPathFollower(float *phase, float *qual_map,
                             unsigned char *bitflags, float *soln, 
                             int xsize, int ysize, int avoid_code, 
-                            UnwrapMode unwrap_mode, int debug_flag,
-                            char *infile)
+                            UnwrapMode unwrap_mode,
+                            QueueKind queue_kind, int max_list_size,
+                            int debug_flag, char *infile)
+{
+  int    num_pieces;
+  double qmin, qmax;
+  PixelQueue  *queue;
+
+  QualityRange(qual_map, xsize, ysize, unwrap_mode==dxdygrad,
+               &qmin, &qmax);
+  queue = AllocatePixelQueue(queue_kind, xsize, ysize, qmin, qmax);
+  queue->max_size = max_list_size;
+  num_pieces = QualityGuidedPieces(phase, qual_map, bitflags, soln,
+                      NULL, xsize, ysize, avoid_code,
+                      unwrap_mode==dxdygrad, queue, 1, debug_flag,
+                      infile);
+  printf("\n");
+  if (queue->reactivations > 0)
+    printf("Postponed pixels reactivated %d times (%d pixels)\n",
+           queue->reactivations, queue->num_reactivated);
+  FreePixelQueue(queue);
+  return num_pieces;
+}
+
+/* Unwrap each piece of the phase data that is not avoided, by */
+/* following the pixels in the order of the queue.  If piece   */
+/* is not null, the pieces are numbered from 0 in it (other    */
+/* pixels are not changed).  If progress is set, the progress  */
+/* is printed.  Returns the number of pieces.                  */
+int QualityGuidedPieces(float *phase, float *qual_map,
+                        unsigned char *bitflags, float *soln,
+                        int *piece, int xsize, int ysize,
+                        int avoid_code, int dxdy_flag,
+                        PixelQueue *queue, int progress,
+                        int debug_flag, char *infile)
 {
   int  i, j, k, a, b, c, n, num_pieces=0;
   float  value;
   float  min_qual, small_val = -1.0E+10;
-  int    num_index, max_list_size, bench, benchout;
-  int    *index_list;
+  int    bench, benchout;
   int    postponed_code=POSTPONED, unwrapped_code=UNWRAPPED;
 
   bench = xsize*ysize/100;
   if (bench < 1) bench = 1;
   benchout = 10*bench;
   min_qual = small_val;
-  max_list_size = (xsize + ysize);
-  AllocateInt(&index_list, max_list_size + 1, 
-              "bookkeeping list (index)");
   avoid_code |= unwrapped_code;
   /* find starting point */
   n = 0;
-  num_index = 0;
   for (j=0; j<ysize; j++) {
     for (i=0; i<xsize; i++) {
       k = j*xsize + i;
@@ -45,12 +73,19 @@ int QualityGuidedPathFollower(float *phase, float *qual_map,
         } 
         bitflags[k] |= unwrapped_code;
         bitflags[k] &= ~postponed_code;
+        if (piece) piece[k] = num_pieces - 1;
         UpdateList(qual_map, i, j, value, phase, soln, bitflags,
-                   xsize, ysize, index_list, &num_index, avoid_code, 
-                   unwrapped_code, postponed_code, max_list_size,
-                   unwrap_mode==dxdygrad, &min_qual);
-        while (num_index > 0) {
-          if (n%bench==0) {
+                   xsize, ysize, queue, avoid_code, unwrapped_code,
+                   postponed_code, dxdy_flag, &min_qual);
+        while (queue->size > 0 || queue->num_postponed > 0) {
+          if (queue->size <= 0) {
+            /* put the postponed pixels back in the queue */
+            ReactivatePixels(queue, soln, qual_map, bitflags, xsize,
+                             ysize, unwrapped_code, postponed_code,
+                             &min_qual, small_val);
+            if (queue->size <= 0) break;
+          }
+          if (progress && n%bench==0) {
             printf("%d ", n/bench);
             fflush(stdout);
             if (0 && debug_flag && n%benchout==0 && n>0) {
@@ -62,36 +97,19 @@ int QualityGuidedPathFollower(float *phase, float *qual_map,
             }
           }
           ++n;
-          if (!GetNextOneToUnwrap(&a, &b, index_list, &num_index,
-                xsize, ysize)) break;   /* no more to unwrap */
+          if (!GetNextOneToUnwrap(&a, &b, queue, xsize, ysize))
+            break;   /* no more to unwrap */
           c = b*xsize + a;
           bitflags[c] |= unwrapped_code;
           bitflags[c] &= ~postponed_code;
+          if (piece) piece[c] = num_pieces - 1;
           value = soln[c];
           UpdateList(qual_map, a, b, value, phase, soln, bitflags,
-                   xsize, ysize, index_list, &num_index, avoid_code, 
-                   unwrapped_code, postponed_code, max_list_size,
-                   unwrap_mode==dxdygrad, &min_qual);
-          if (num_index <= 0) {
-            min_qual = small_val;
-            for (c=0; c<xsize*ysize; c++) {
-              if ((bitflags[c] & postponed_code) 
-                       && !(bitflags[c] & unwrapped_code)) {
-                a = c%xsize;    
-                b = c/xsize;
-                InsertList(soln, soln[c], qual_map, bitflags, a, b,
-                           index_list, &num_index, xsize, ysize,
-                           unwrapped_code, postponed_code,
-                           &min_qual, max_list_size);
-              }
-            }
-            if (num_index > 0) min_qual = qual_map[index_list[0]];
-          }
+                   xsize, ysize, queue, avoid_code, unwrapped_code,
+                   postponed_code, dxdy_flag, &min_qual);
         }  /* while ... */
       }
     }   /* for (b ...  */
   }   /* for (a ... */
-  printf("\n");
-  free(index_list);
   return num_pieces;
 }
@@ -1,8 +1,13 @@
 #ifndef __QUALITY
 #define __QUALITY
 #include "getqual.h"
+#include "list.h"
 int QualityGuidedPathFollower(float *phase, float *qual_map,
       unsigned char *bitflags, float *soln, int xsize, int ysize,
-      int avoid_code, UnwrapMode unwrap_mode, int debug_mode,
-      char *infile);
+      int avoid_code, UnwrapMode unwrap_mode, QueueKind queue_kind,
+      int max_list_size, int debug_mode, char *infile);
+int QualityGuidedPieces(float *phase, float *qual_map,
+      unsigned char *bitflags, float *soln, int *piece, int xsize,
+      int ysize, int avoid_code, int dxdy_flag, PixelQueue *queue,
+      int progress, int debug_flag, char *infile);
 #endif
@@ -0,0 +1,230 @@
+/*
+ *  qualtile.c -- functions for quality-guided path following on
+ *                overlapping tiles in parallel, and for merging
+ *                the tiles along their seams
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <malloc.h>
+#include "file.h"
+#include "util.h"
+#include "grad.h"
+#include "list.h"
+#include "quality.h"
+#include "qualtile.h"
+
+/* Unwrap the phase on tiles of tile_size x tile_size pixels that  */
+/* overlap their neighbors by "overlap" pixels on each side.  The  */
+/* tiles are unwrapped independently on the threads of the pool,   */
+/* and then shifted by integer numbers of cycles so that they      */
+/* agree in the overlaps.  The offset between two pieces of        */
+/* neighboring tiles is the one that most of the overlap (weighted */
+/* by quality) agrees on, and the pieces are merged along the      */
+/* seams of highest quality first.  The paths within the tiles     */
+/* differ from the untiled ones, so the solution can differ from   */
+/* the untiled solution where the unwrapping order matters.        */
+/* Returns the number of pieces.                                   */
+int TiledPathFollower(float *phase, float *qual_map,
+      unsigned char *bitflags, float *soln, int xsize, int ysize,
+      int avoid_code, UnwrapMode unwrap_mode, QueueKind queue_kind,
+      int max_list_size, int tile_size, int overlap,
+      ThreadPool *pool)
+{
+  int              i, j, k, t, x, y, nx, ny, num_tiles, num_nodes;
+  int              num_pieces, a, oa;
+  int              *parent, *offset, *shift;
+  unsigned char    *used;
+  QualityTile      *tiles, *tile;
+  QualityTileTask  task;
+  SeamGraph        *graph;
+  if (tile_size < 1) tile_size = (xsize > ysize) ? xsize : ysize;
+  if (overlap < 1) overlap = 1;
+  nx = (xsize + tile_size - 1)/tile_size;
+  ny = (ysize + tile_size - 1)/tile_size;
+  num_tiles = nx*ny;
+  tiles = (QualityTile *) malloc(num_tiles*sizeof(QualityTile));
+  if (!tiles)
+    ErrorHandler("Cannot allocate memory", "tiles",
+                 MEMORY_ALLOCATION_ERROR);
+  for (j=0; j<ny; j++) {
+    for (i=0; i<nx; i++) {
+      tile = &tiles[j*nx + i];
+      tile->cx0 = i*tile_size;
+      tile->cy0 = j*tile_size;
+      tile->cx1 = (i < nx - 1) ? tile->cx0 + tile_size : xsize;
+      tile->cy1 = (j < ny - 1) ? tile->cy0 + tile_size : ysize;
+      tile->x0 = (tile->cx0 > overlap) ? tile->cx0 - overlap : 0;
+      tile->y0 = (tile->cy0 > overlap) ? tile->cy0 - overlap : 0;
+      tile->w = ((tile->cx1 + overlap < xsize) ? tile->cx1 + overlap
+                                               : xsize) - tile->x0;
+      tile->h = ((tile->cy1 + overlap < ysize) ? tile->cy1 + overlap
+                                               : ysize) - tile->y0;
+    }
+  }
+
+  /* unwrap the tiles */
+  printf("Unwrapping %d tiles of %dx%d pixels on %d threads\n",
+         num_tiles, tile_size, tile_size, PoolThreads(pool));
+  task.phase = phase;
+  task.qual_map = qual_map;
+  task.bitflags = bitflags;
+  task.xsize = xsize;
+  task.ysize = ysize;
+  task.avoid_code = avoid_code;
+  task.dxdy_flag = (unwrap_mode==dxdygrad);
+  task.queue_kind = queue_kind;
+  task.max_list_size = max_list_size;
+  QualityRange(qual_map, xsize, ysize, task.dxdy_flag,
+               &task.qmin, &task.qmax);
+  task.tiles = tiles;
+  RunThreadPool(pool, UnwrapTileTask, &task, num_tiles);
+  for (t=0, num_nodes=0; t<num_tiles; t++) {
+    tiles[t].first_node = num_nodes;
+    num_nodes += tiles[t].num_pieces;
+  }
+
+  /* find the offsets across the overlaps of the neighbors */
+  graph = AllocateSeamGraph();
+  for (j=0; j<ny; j++) {
+    for (i=0; i<nx; i++) {
+      t = j*nx + i;
+      if (i < nx - 1)
+        SeamVotes(&tiles[t], &tiles[t + 1], phase, qual_map, xsize,
+                  task.qmin, graph);
+      if (j < ny - 1)
+        SeamVotes(&tiles[t], &tiles[t + nx], phase, qual_map, xsize,
+                  task.qmin, graph);
+    }
+  }
+
+  /* merge the pieces, best seams first */
+  AllocateInt(&parent, num_nodes + 1, "seam graph");
+  AllocateInt(&offset, num_nodes + 1, "seam graph");
+  AllocateInt(&shift, num_nodes + 1, "seam graph");
+  AllocateByte(&used, num_nodes + 1, "seam graph");
+  MergeSeams(graph->edges, graph->num_edges, parent, offset,
+             num_nodes);
+  printf("Merged %d pieces of %d tiles along %d seams\n", num_nodes,
+         num_tiles, graph->num_edges);
+
+  /* copy the cores of the tiles to the solution.  Like the  */
+  /* untiled unwrapping, each piece is shifted so that its    */
+  /* first pixel keeps its wrapped value.                     */
+  num_pieces = 0;
+  for (y=0; y<ysize; y++) {
+    for (x=0; x<xsize; x++) {
+      tile = &tiles[(y/tile_size)*nx + x/tile_size];
+      i = (y - tile->y0)*tile->w + x - tile->x0;
+      if (tile->piece[i] < 0) continue;
+      a = FindPiece(parent, offset, tile->first_node
+                                    + tile->piece[i], &oa);
+      k = y*xsize + x;
+      if (!used[a]) {
+        used[a] = 1;
+        shift[a] = floor(phase[k] - tile->soln[i] - oa + 0.5);
+        ++num_pieces;
+      }
+      soln[k] = tile->soln[i] + oa + shift[a];
+      bitflags[k] |= UNWRAPPED;
+    }
+  }
+  for (t=0; t<num_tiles; t++) {
+    free(tiles[t].soln);
+    free(tiles[t].piece);
+  }
+  free(parent);
+  free(offset);
+  free(shift);
+  free(used);
+  FreeSeamGraph(graph);
+  free(tiles);
+  return num_pieces;
+}
+
+/* Unwrap tile number "task" on its own copies of the arrays */
+void UnwrapTileTask(void *arg, int task, int worker)
+{
+  int              x, y, k, g, n;
+  float            *phase, *qual_map;
+  unsigned char    *bitflags;
+  PixelQueue       *queue;
+  QualityTileTask  *tt = (QualityTileTask *) arg;
+  QualityTile      *tile = &tt->tiles[task];
+  (void)worker;   /* the tile owns its arrays */
+  n = tile->w*tile->h;
+  AllocateFloat(&phase, n, "tile phase data");
+  AllocateFloat(&qual_map, n, "tile quality map");
+  AllocateByte(&bitflags, n, "tile bitflags");
+  AllocateFloat(&tile->soln, n, "tile unwrapped data");
+  AllocateInt(&tile->piece, n, "tile pieces");
+  for (y=0; y<tile->h; y++) {
+    for (x=0; x<tile->w; x++) {
+      k = y*tile->w + x;
+      g = (tile->y0 + y)*tt->xsize + tile->x0 + x;
+      phase[k] = tt->phase[g];
+      qual_map[k] = tt->qual_map[g];
+      bitflags[k] = tt->bitflags[g] & ~(UNWRAPPED | POSTPONED);
+      tile->piece[k] = -1;
+    }
+  }
+  queue = AllocatePixelQueue(tt->queue_kind, tile->w, tile->h,
+                             tt->qmin, tt->qmax);
+  queue->max_size = tt->max_list_size;
+  tile->num_pieces = QualityGuidedPieces(phase, qual_map, bitflags,
+                         tile->soln, tile->piece, tile->w, tile->h,
+                         tt->avoid_code, tt->dxdy_flag, queue, 0, 0,
+                         NULL);
+  FreePixelQueue(queue);
+  free(phase);
+  free(qual_map);
+  free(bitflags);
+}
+
+/* Add the seam graph edges between the pieces of two neighboring */
+/* tiles to the graph.  Each pair of pixels that face each other  */
+/* across the edge of the cores (ta left of or above tb)           */
+/* votes, with the lower of their qualities, for the offset that   */
+/* makes the unwrapped values of tb continue those of ta; for each */
+/* pair of pieces, the offset with the most votes is kept.         */
+/* Returns the number of edges added.                              */
+int SeamVotes(QualityTile *ta, QualityTile *tb, float *phase,
+              float *qual_map, int xsize, double qmin,
+              SeamGraph *graph)
+{
+  int       x, y, x0, x1, y0, y1, dx, dy, ka, kb, a, b, d, i, j;
+  double    w;
+  StartSeam(graph);
+  if (tb->cx0==ta->cx1) {   /* side by side */
+    x0 = x1 = ta->cx1 - 1;
+    y0 = (ta->cy0 > tb->cy0) ? ta->cy0 : tb->cy0;
+    y1 = ((ta->cy1 < tb->cy1) ? ta->cy1 : tb->cy1) - 1;
+    dx = 1;
+    dy = 0;
+  }
+  else {                    /* one above the other */
+    y0 = y1 = ta->cy1 - 1;
+    x0 = (ta->cx0 > tb->cx0) ? ta->cx0 : tb->cx0;
+    x1 = ((ta->cx1 < tb->cx1) ? ta->cx1 : tb->cx1) - 1;
+    dx = 0;
+    dy = 1;
+  }
+  for (y=y0; y<=y1; y++) {
+    for (x=x0; x<=x1; x++) {
+      ka = (y - ta->y0)*ta->w + x - ta->x0;
+      kb = (y + dy - tb->y0)*tb->w + x + dx - tb->x0;
+      if (ta->piece[ka] < 0 || tb->piece[kb] < 0) continue;
+      a = ta->first_node + ta->piece[ka];
+      b = tb->first_node + tb->piece[kb];
+      i = y*xsize + x;
+      j = (y + dy)*xsize + x + dx;
+      d = floor(ta->soln[ka] + Gradient(phase[j], phase[i])
+                  - tb->soln[kb] + 0.5);
+      w = ((qual_map[i] < qual_map[j]) ? qual_map[i] : qual_map[j])
+            - qmin + 1.0E-6;
+      AddSeamVote(graph, a, b, d, w);
+    }
+  }
+  /* keep the offset with the most votes for each pair of pieces */
+  return BestSeams(graph);
+}
@@ -0,0 +1,40 @@
+#ifndef __QUALTILE
+#define __QUALTILE
+#include "getqual.h"
+#include "list.h"
+#include "pool.h"
+#include "seams.h"
+/* default overlap of neighboring tiles (pixels on each side) */
+#define TILE_OVERLAP  64
+/* One tile of a tiled quality-guided unwrapping.  The cores of  */
+/* the tiles partition the image, and each tile is unwrapped on  */
+/* its core widened by the overlap on each side (its extent).    */
+/* Each piece of each tile is a node of the seam graph.          */
+typedef struct {
+  int    x0, y0, w, h;           /* extent */
+  int    cx0, cy0, cx1, cy1;     /* core: [cx0,cx1) x [cy0,cy1) */
+  int    num_pieces;
+  int    first_node;             /* node of piece 0 */
+  float  *soln;
+  int    *piece;                 /* -1 where not unwrapped */
+} QualityTile;
+/* arguments of the tile unwrapping tasks */
+typedef struct {
+  float          *phase, *qual_map;
+  unsigned char  *bitflags;
+  int            xsize, ysize, avoid_code, dxdy_flag;
+  QueueKind      queue_kind;
+  int            max_list_size;
+  double         qmin, qmax;
+  QualityTile    *tiles;
+} QualityTileTask;
+int TiledPathFollower(float *phase, float *qual_map,
+      unsigned char *bitflags, float *soln, int xsize, int ysize,
+      int avoid_code, UnwrapMode unwrap_mode, QueueKind queue_kind,
+      int max_list_size, int tile_size, int overlap,
+      ThreadPool *pool);
+void UnwrapTileTask(void *arg, int task, int worker);
+int SeamVotes(QualityTile *ta, QualityTile *tb, float *phase,
+              float *qual_map, int xsize, double qmin,
+              SeamGraph *graph);
+#endif
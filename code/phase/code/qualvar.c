@@ -3,7 +3,9 @@
  *               quality map
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
+#include "util.h"
 #include "qualvar.h"
 #include "dxdygrad.h"
 
@@ -36,40 +38,16 @@ void PhaseVariance(float *phase, float *result,
 void DxGradVar(float *dx, float *dxvar, int xsize, int ysize,
   int tsize, unsigned char *bitflags, int avoid_code, int add_code)
 {
-  int    i, j, k, a, b, aa, bb, cc, n, hs;
-  float  r, avg, avgsqr;
+  int    i, hs;
   if (tsize < 3 && !add_code) {
     for (i=0; i<xsize*ysize; i++)
       dxvar[i] = 0.0;
   }
   else {
     hs = tsize/2;
-    for (j=0; j<ysize; j++) {
-      for (i=0; i<xsize; i++) {
-        avg = avgsqr = 0.0;
-        for (n=0, b=j-hs; b<=j+hs; b++) {
-          if ((bb = b) < 0) bb = -bb;
-          else if (bb >= ysize) bb = 2*ysize - 2 - bb; 
-          for (a=i-hs; a < i+hs; a++) {   /* a < to match dx */
-            if ((aa = a) < 0) aa = -aa;
-            else if (aa >= xsize) aa = 2*xsize - 2 - aa; 
-            cc = bb*xsize + aa;
-            if (bitflags && (bitflags[cc]&avoid_code)) continue;
-            r = dx[cc];
-            avg += r;
-            avgsqr += r*r;
-            ++n;  
-          }
-        }
-        r = (n>0) ? 1.0/n : 0.0;
-        avg *= r;
-        avgsqr *= r;
-        if (add_code)
-          dxvar[j*xsize + i] += avgsqr - avg*avg;   /* variance */
-        else
-          dxvar[j*xsize + i] = avgsqr - avg*avg;   /* variance */
-      }
-    }   
+    /* the windows are one pixel narrower to match dx */
+    WindowVariance(dx, dxvar, xsize, ysize, -hs, hs - 1, -hs, hs,
+                   bitflags, avoid_code, add_code);
   }
 } 
 
@@ -79,39 +57,112 @@ void DxGradVar(float *dx, float *dxvar, int xsize, int ysize,
 void DyGradVar(float *dy, float *dyvar, int xsize, int ysize,
   int tsize, unsigned char *bitflags, int avoid_code, int add_code)
 {
-  int    i, j, k, a, b, aa, bb, cc, n, hs;
-  float  r, avg, avgsqr;
+  int    i, hs;
   if (tsize < 3 && !add_code) {
     for (i=0; i<xsize*ysize; i++)
       dyvar[i] = 0.0;
   }
   else {
     hs = tsize/2;
-    for (j=0; j<ysize; j++) {
-      for (i=0; i<xsize; i++) {
-        avg = avgsqr = 0.0;
-        for (n=0, b=j-hs; b < j+hs; b++) { /* b < to match dy */
-          if ((bb = b) < 0) bb = -bb;
-          else if (bb >= ysize) bb = 2*ysize - 2 - bb; 
-          for (a=i-hs; a<=i+hs; a++) {
-            if ((aa = a) < 0) aa = -aa;
-            else if (aa >= xsize) aa = 2*xsize - 2 - aa; 
-            cc = bb*xsize + aa;
-            if (bitflags && (bitflags[cc]&avoid_code)) continue;
-            r = dy[cc];
-            avg += r;
-            avgsqr += r*r;
-            ++n;
-          }
-        }
-        r = (n>0) ? 1.0/n : 0.0;
-        avg *= r;
-        avgsqr *= r;
-        if (add_code)
-          dyvar[j*xsize + i] += avgsqr - avg*avg;   /* variance */
-        else
-          dyvar[j*xsize + i] = avgsqr - avg*avg;   /* variance */
-      }
-    }   
+    /* the windows are one pixel shorter to match dy */
+    WindowVariance(dy, dyvar, xsize, ysize, -hs, hs, -hs, hs - 1,
+                   bitflags, avoid_code, add_code);
   }
-} 
+}
+
+/* Compute the variance of the data in the window of columns   */
+/* i+xlo to i+xhi and rows j+ylo to j+yhi of each pixel (i,j), */
+/* mirrored at the edges, ignoring the pixels marked with      */
+/* avoid_code.  The sums of the windows are slid down the      */
+/* image a row at a time, so the cost per pixel does not       */
+/* depend on the window size.  The sums are exact (and thus    */
+/* equal to those of the pixel by pixel loops) when the terms  */
+/* are, as for phase data read from bytes.                     */
+void WindowVariance(float *data, float *var, int xsize, int ysize,
+                    int xlo, int xhi, int ylo, int yhi,
+                    unsigned char *bitflags, int avoid_code,
+                    int add_code)
+{
+  int     i, j, b, *count;
+  double  *sum, *sumsq;
+  float   r, avg, avgsqr;
+  AllocateDouble(&sum, xsize, "window sums");
+  AllocateDouble(&sumsq, xsize, "window sums");
+  AllocateInt(&count, xsize, "window counts");   /* all zero */
+  for (b=ylo; b<=yhi; b++)
+    AddRowWindows(data, MirrorIndex(b, ysize), xlo, xhi, 1, sum,
+                  sumsq, count, xsize, bitflags, avoid_code);
+  for (j=0; j<ysize; j++) {
+    if (j > 0) {
+      AddRowWindows(data, MirrorIndex(j + yhi, ysize), xlo, xhi, 1,
+                    sum, sumsq, count, xsize, bitflags, avoid_code);
+      AddRowWindows(data, MirrorIndex(j - 1 + ylo, ysize), xlo, xhi,
+                    -1, sum, sumsq, count, xsize, bitflags,
+                    avoid_code);
+    }
+    for (i=0; i<xsize; i++) {
+      avg = sum[i];
+      avgsqr = sumsq[i];
+      r = (count[i]>0) ? 1.0/count[i] : 0.0;
+      avg *= r;
+      avgsqr *= r;
+      if (add_code)
+        var[j*xsize + i] += avgsqr - avg*avg;   /* variance */
+      else
+        var[j*xsize + i] = avgsqr - avg*avg;   /* variance */
+    }
+  }
+  free(sum);
+  free(sumsq);
+  free(count);
+}
+
+/* Add sign times the sums, sums of squares and counts of the */
+/* windows of columns i+xlo to i+xhi of the row to those of   */
+/* each column i                                               */
+void AddRowWindows(float *data, int row, int xlo, int xhi, int sign,
+                   double *sum, double *sumsq, int *count, int xsize,
+                   unsigned char *bitflags, int avoid_code)
+{
+  int     i, a, k, n;
+  double  s, q;
+  float   r;
+  float   *line = data + row*xsize;
+  unsigned char  *flags = (bitflags) ? bitflags + row*xsize : NULL;
+  for (s=q=0.0, n=0, a=xlo; a<=xhi; a++) {
+    k = MirrorIndex(a, xsize);
+    if (flags && (flags[k]&avoid_code)) continue;
+    r = line[k];
+    s += r;
+    q += r*r;
+    ++n;
+  }
+  for (i=0; i<xsize; i++) {
+    sum[i] += sign*s;
+    sumsq[i] += sign*q;
+    count[i] += sign*n;
+    /* slide the window one column to the right */
+    k = MirrorIndex(i + xlo, xsize);
+    if (!flags || !(flags[k]&avoid_code)) {
+      r = line[k];
+      s -= r;
+      q -= r*r;
+      --n;
+    }
+    k = MirrorIndex(i + 1 + xhi, xsize);
+    if (!flags || !(flags[k]&avoid_code)) {
+      r = line[k];
+      s += r;
+      q += r*r;
+      ++n;
+    }
+  }
+}
+
+/* Mirror the index a about the first and last of 0, ..., size-1 */
+int MirrorIndex(int a, int size)
+{
+  if (a < 0) return -a;
+  else if (a >= size) return 2*size - 2 - a;
+  return a;
+}
@@ -7,4 +7,12 @@ void DxGradVar(float *dx, float *dxvar, int xsize, int ysize,
   int size, unsigned char *bitflags, int avoid_code, int add_flag);
 void DyGradVar(float *dy, float *dyvar, int xsize, int ysize,
   int size, unsigned char *bitflags, int avoid_code, int add_flag);
+void WindowVariance(float *data, float *var, int xsize, int ysize,
+                    int xlo, int xhi, int ylo, int yhi,
+                    unsigned char *bitflags, int avoid_code,
+                    int add_code);
+void AddRowWindows(float *data, int row, int xlo, int xhi, int sign,
+                   double *sum, double *sumsq, int *count, int xsize,
+                   unsigned char *bitflags, int avoid_code);
+int MirrorIndex(int a, int size);
 #endif
@@ -6,6 +6,9 @@
  */
 #include <stdio.h>
 #include <math.h>
+#include <malloc.h>
+#include "file.h"
+#include "util.h"
 #include "relax.h"
 
 /*
@@ -14,65 +17,456 @@
  * Thus, f(i,j) 
  *    = 0.25*(f(i-1,j) + f(i+1,j) + f(i,j-1) + f(i,j+1)) + rho(i,j)
  * This version solves the weighted equation.  For the unweighted
- * equation, just pass null pointers for dxwts and dywts.
+ * equation, just pass null pointers for dxwts and dywts.  The
+ * sweeps are done in the color-split arrays of plan (see
+ * RelaxPlan), which may be a null pointer for a temporary one,
+ * up to RELAX_BLOCK_PASSES of them at a time in a wavefront
+ * (see RelaxWavefrontTask).
  */
 void Relax(float *soln, float *dx, float *dy, float *dxwts,
-           float *dywts, int w, int h, int numit)
+           float *dywts, int w, int h, int numit, RelaxPlan *plan)
 {
-  int i, j, k, n, ipass, istart;
-  float  x1, x2, x3, x4, y, z, r;
-  float  w1, w2, w3, w4, norm=0.0;
-  double  diff, maxdiff, sum;
+  int        n, j, p, num_passes;
+  double     sum;
+  RelaxPlan  *own_plan=NULL;
+  RelaxTask  task;
 
   if (w*h < 8*8 && numit < 2) numit = 2*(w + h);
-  for (n=0; n<numit; n++) {             /* iteration */
-    for (ipass=0; ipass<2; ipass++) {   /* red and black sweeps */
-      istart = ipass;
-      sum = maxdiff = 0.0;
-      for (j=0; j<h; j++) {             /* row */
-        for (i=istart; i<w; i+=2) {     /* column */
-          k = j*w + i;
-          /* weights */
-          if (dxwts && dywts) {
-            w1 = (i < w - 1) ? dxwts[k+1] : dxwts[k-1];
-            if (w1 > dxwts[k]) w1 = dxwts[k];
-            w1 = w1*w1;
-            w2 = (i > 0) ? dxwts[k-1] : dxwts[k+1];  
-            if (w2 > dxwts[k]) w2 = dxwts[k];
-            w2 = w2*w2;
-            w3 = (j < h - 1) ? dywts[k+w] : dywts[k-w];
-            if (w3 > dywts[k]) w3 = dywts[k];
-            w3 = w3*w3;
-            w4 = (j > 0) ? dywts[k-w] : dywts[k+w];
-            if (w4 > dywts[k]) w4 = dywts[k];
-            w4 = w4*w4;
-            norm = w1 + w2 + w3 + w4;
-          } 
-          /* surface points */
-          x1 = (i < w - 1) ? soln[k+1] : soln[k-1];
-          x2 = (i > 0) ? soln[k-1] : soln[k+1];
-          x3 = (j < h - 1) ? soln[k+w] : soln[k-w];
-          x4 = (j > 0) ? soln[k-w] : soln[k+w];
-          /* derivatives */
-          y = (i > 0) ? dx[k-1] : -dx[k];
-          z = (j > 0) ? dy[k-w] : -dy[k];
-          if (norm > 1.0e-6) { 
-            r = (w1*(x1 - dx[k]) + w2*(x2 + y) 
-                            + w3*(x3 - dy[k]) + w4*(x4 + z))/norm; 
-          } 
-          else {
-            r = 0.25*(x1 - dx[k] + x2 + y + x3 - dy[k] + x4 + z);
-          }
-          diff = r - soln[k];
-          if (diff < 0) diff = -diff;
-          maxdiff = (maxdiff < diff) ? diff : maxdiff;
-          sum += diff*diff;
-          soln[k] = r;
-        }
-        istart = (istart) ? 0 : 1;
-      }
-    }
+  if (!plan || plan->w!=w || plan->h!=h
+        || (dxwts && dywts && !plan->weighted))
+    plan = own_plan = AllocateRelaxPlan(w, h, (dxwts && dywts), NULL);
+  PackRelaxPlan(plan, soln, dx, dy, dxwts, dywts);
+  RelaxGhosts(plan, 0);
+  RelaxGhosts(plan, 1);
+  for (j=0; j<h; j++) plan->sums[j] = 0.0;
+  task.plan = plan;
+  task.weighted = (dxwts && dywts);
+  num_passes = 2*numit;                 /* red and black sweeps */
+  task.sum_pass = num_passes - 1;
+  for (p=0; p<num_passes; p+=task.num_passes) {
+    task.first_pass = p;
+    task.num_passes = num_passes - p;
+    RelaxBlocking(plan, &task.num_passes, &task.num_bands);
+    RunThreadPool(plan->pool, RelaxWavefrontTask, &task,
+                  task.num_bands);
+    if (task.num_passes > 1)
+      RunThreadPool(plan->pool, RelaxSeamTask, &task,
+                    task.num_bands - 1);
   }
+  UnpackRelaxPlan(plan, soln);
+  for (sum=0.0, j=0; j<h; j++) sum += plan->sums[j];
+  FreeRelaxPlan(own_plan);
   for (n=1; n<w; n*=2) printf("  ");
   printf("Relax %d %d: rms = %lf\n", w, h, sqrt(sum/(w*h)));
 }
+
+/* Choose how many of the remaining *num_passes sweeps to do in  */
+/* one wavefront (at most RELAX_BLOCK_PASSES), and the number of */
+/* bands of rows to split them into.  Each band must have at     */
+/* least 2*(*num_passes) + 2 rows (see RelaxSeamTask); if even   */
+/* one band is too small, the sweeps are done one at a time.     */
+void RelaxBlocking(RelaxPlan *plan, int *num_passes, int *num_bands)
+{
+  int  h = plan->h;
+  if (*num_passes > RELAX_BLOCK_PASSES) *num_passes = RELAX_BLOCK_PASSES;
+  *num_bands = 1;
+  if (PoolThreads(plan->pool) > 1 && plan->w*h >= RELAX_MIN_PARALLEL)
+    *num_bands = RELAX_BANDS_PER_THREAD*PoolThreads(plan->pool);
+  if (*num_passes > 1) {
+    while (*num_bands > 1 && h/(*num_bands) < 2*(*num_passes) + 2)
+      --(*num_bands);
+  }
+  else if (*num_bands > h) {
+    *num_bands = h;
+  }
+}
+
+/* Allocate the color-split arrays for relaxing a w x h grid. */
+/* The weight arrays are only allocated if weighted is        */
+/* nonzero.  The rows of each sweep are split among the       */
+/* threads of pool (which may be a null pointer).             */
+RelaxPlan *AllocateRelaxPlan(int w, int h, int weighted,
+                             ThreadPool *pool)
+{
+  int        c, size;
+  RelaxPlan  *plan;
+  plan = (RelaxPlan *) malloc(sizeof(RelaxPlan));
+  if (!plan) 
+    ErrorHandler("Cannot allocate memory", "relaxation arrays",
+                 MEMORY_ALLOCATION_ERROR);
+  plan->w = w;
+  plan->h = h;
+  plan->stride = w/2 + 2;
+  plan->weighted = weighted;
+  plan->wts_ready = 0;
+  plan->pool = pool;
+  size = (h + 2)*plan->stride;
+  for (c=0; c<2; c++) {
+    AllocateFloat(&plan->soln[c], size, "relaxation arrays");
+    AllocateFloat(&plan->dxp[c], size, "relaxation arrays");
+    AllocateFloat(&plan->dxm[c], size, "relaxation arrays");
+    AllocateFloat(&plan->dyp[c], size, "relaxation arrays");
+    AllocateFloat(&plan->dym[c], size, "relaxation arrays");
+    plan->w1[c] = plan->w2[c] = plan->w3[c] = plan->w4[c] = NULL;
+    plan->norm[c] = NULL;
+    if (weighted) {
+      AllocateFloat(&plan->w1[c], size, "relaxation weights");
+      AllocateFloat(&plan->w2[c], size, "relaxation weights");
+      AllocateFloat(&plan->w3[c], size, "relaxation weights");
+      AllocateFloat(&plan->w4[c], size, "relaxation weights");
+      AllocateFloat(&plan->norm[c], size, "relaxation weights");
+    }
+  }
+  AllocateDouble(&plan->sums, h, "relaxation sums");
+  AllocateFloat(&plan->prev, PoolThreads(pool)*plan->stride,
+                "relaxation arrays");
+  return plan;
+}
+
+/* Free the arrays made by AllocateRelaxPlan */
+void FreeRelaxPlan(RelaxPlan *plan)
+{
+  int  c;
+  if (!plan) return;
+  for (c=0; c<2; c++) {
+    free(plan->soln[c]);
+    free(plan->dxp[c]);
+    free(plan->dxm[c]);
+    free(plan->dyp[c]);
+    free(plan->dym[c]);
+    if (plan->w1[c]) free(plan->w1[c]);
+    if (plan->w2[c]) free(plan->w2[c]);
+    if (plan->w3[c]) free(plan->w3[c]);
+    if (plan->w4[c]) free(plan->w4[c]);
+    if (plan->norm[c]) free(plan->norm[c]);
+  }
+  free(plan->sums);
+  free(plan->prev);
+  free(plan);
+}
+
+/* Copy the solution and the derivative terms of the equation   */
+/* into the color-split arrays, and the squared edge weights if  */
+/* they are not there yet (see PackRelaxWeights).                */
+void PackRelaxPlan(RelaxPlan *plan, float *soln, float *dx, float *dy,
+                   float *dxwts, float *dywts)
+{
+  int    i, j, k, c, m, w = plan->w, h = plan->h;
+  float  *s, *dxp, *dxm, *dyp, *dym;
+  for (j=0; j<h; j++) {
+    for (c=0; c<2; c++) {
+      i = (c + j) & 1;
+      k = j*w + i;
+      m = (j + 1)*plan->stride + 1;
+      s = plan->soln[c] + m;
+      dxp = plan->dxp[c] + m;
+      dxm = plan->dxm[c] + m;
+      dyp = plan->dyp[c] + m;
+      dym = plan->dym[c] + m;
+      for (m=0; i<w; i+=2, k+=2, m++) {
+        s[m] = soln[k];
+        dxp[m] = dx[k];
+        dxm[m] = (i > 0) ? dx[k-1] : -dx[k];
+        dyp[m] = dy[k];
+        dym[m] = (j > 0) ? dy[k-w] : -dy[k];
+      }
+    }
+  }
+  if (dxwts && dywts && !plan->wts_ready) {
+    PackRelaxWeights(plan, dxwts, dywts);
+    plan->wts_ready = 1;
+  }
+}
+
+/* Compute the squared edge weights of the relaxation.  This is  */
+/* done once per solve (until wts_ready is cleared), since the   */
+/* weights of a grid do not change during a solve.  A weight     */
+/* norm of 1.0e-6 or less is stored as 0, for which the          */
+/* unweighted equation is used.                                  */
+void PackRelaxWeights(RelaxPlan *plan, float *dxwts, float *dywts)
+{
+  int    i, j, k, c, m, w = plan->w, h = plan->h;
+  float  w1, w2, w3, w4, norm;
+  for (j=0; j<h; j++) {
+    for (i=0; i<w; i++) {
+      k = j*w + i;
+      c = (i + j) & 1;
+      m = (j + 1)*plan->stride + i/2 + 1;
+      w1 = (i < w - 1) ? dxwts[k+1] : dxwts[k-1];
+      if (w1 > dxwts[k]) w1 = dxwts[k];
+      w1 = w1*w1;
+      w2 = (i > 0) ? dxwts[k-1] : dxwts[k+1];  
+      if (w2 > dxwts[k]) w2 = dxwts[k];
+      w2 = w2*w2;
+      w3 = (j < h - 1) ? dywts[k+w] : dywts[k-w];
+      if (w3 > dywts[k]) w3 = dywts[k];
+      w3 = w3*w3;
+      w4 = (j > 0) ? dywts[k-w] : dywts[k+w];
+      if (w4 > dywts[k]) w4 = dywts[k];
+      w4 = w4*w4;
+      norm = w1 + w2 + w3 + w4;
+      plan->w1[c][m] = w1;
+      plan->w2[c][m] = w2;
+      plan->w3[c][m] = w3;
+      plan->w4[c][m] = w4;
+      plan->norm[c][m] = (norm > 1.0e-6) ? norm : 0.0;
+    }
+  }
+}
+
+/* Copy the solution back from the color-split arrays */
+void UnpackRelaxPlan(RelaxPlan *plan, float *soln)
+{
+  int    i, j, k, c, m, w = plan->w, h = plan->h;
+  float  *s;
+  for (j=0; j<h; j++) {
+    for (c=0; c<2; c++) {
+      i = (c + j) & 1;
+      s = plan->soln[c] + (j + 1)*plan->stride + 1;
+      for (k=j*w + i, m=0; i<w; i+=2, k+=2, m++) soln[k] = s[m];
+    }
+  }
+}
+
+/* Set the ghost points of one color to the values of the  */
+/* reflecting boundary: f(-1,j) = f(1,j), f(w,j) = f(w-2,j), */
+/* and likewise for the rows.                              */
+void RelaxGhosts(RelaxPlan *plan, int color)
+{
+  int    j, r, w = plan->w, h = plan->h, stride = plan->stride;
+  float  *s = plan->soln[color];
+  for (j=0; j<h; j++) {
+    r = (j + 1)*stride;
+    if (((j + 1) & 1)==color) s[r] = s[r + 1];
+    if (((w + j) & 1)==color) s[r + w/2 + 1] = s[r + (w - 2)/2 + 1];
+  }
+  for (r=0; r<stride; r++) {
+    s[r] = s[2*stride + r];
+    s[(h + 1)*stride + r] = s[(h - 1)*stride + r];
+  }
+}
+
+/* Do sweeps first_pass, ..., first_pass + num_passes - 1 on a   */
+/* band of rows, in a wavefront: at step k, sweep first_pass + t */
+/* is done on row k - t (t = 0, 1, ...), so a row is relaxed     */
+/* num_passes times while it and its neighbors are in cache.     */
+/* The order of the updates is that of whole sweeps, so the      */
+/* results are the same.  Sweep t leaves the t top and bottom    */
+/* rows of the band next to other bands undone; they are done by */
+/* RelaxSeamTask afterwards.                                     */
+void RelaxWavefrontTask(void *arg, int band, int worker)
+{
+  RelaxTask  *task = (RelaxTask *) arg;
+  RelaxPlan  *plan = task->plan;
+  int        j, k, t, lo, hi, h = plan->h;
+  int        j1 = band*h/task->num_bands;
+  int        j2 = (band + 1)*h/task->num_bands;
+  for (k=j1; k<j2 + task->num_passes - 1; k++) {
+    for (t=0; t<task->num_passes; t++) {
+      j = k - t;
+      lo = (band > 0) ? j1 + t : 0;
+      hi = (band < task->num_bands - 1) ? j2 - t : h;
+      if (j >= lo && j < hi)
+        RelaxPlanRow(plan, j, task->first_pass + t, task, worker);
+    }
+  }
+}
+
+/* Finish the sweeps of RelaxWavefrontTask on the rows next to  */
+/* the boundary between bands seam and seam + 1.  Sweep t is    */
+/* done on the 2t rows around the boundary, after sweep t - 1.  */
+void RelaxSeamTask(void *arg, int seam, int worker)
+{
+  RelaxTask  *task = (RelaxTask *) arg;
+  RelaxPlan  *plan = task->plan;
+  int        j, t, jb = (seam + 1)*plan->h/task->num_bands;
+  for (t=1; t<task->num_passes; t++) {
+    for (j=jb - t; j<jb + t; j++) 
+      RelaxPlanRow(plan, j, task->first_pass + t, task, worker);
+  }
+}
+
+/* Relax the points of row j of the color of the given sweep    */
+/* (red for even sweeps), and update its ghost points.  In the  */
+/* last sweep, the sum of the squared changes is saved in       */
+/* plan->sums[j].                                               */
+void RelaxPlanRow(RelaxPlan *plan, int j, int pass, RelaxTask *task,
+                  int worker)
+{
+  int    m, c = pass & 1, off = (c + j) & 1;
+  int    n = (plan->w - off + 1)/2, stride = plan->stride;
+  int    r = (j + 1)*stride, base = r + 1, h = plan->h;
+  float  *s, *prev;
+  double diff, sum=0.0;
+  s = plan->soln[c] + base;
+  prev = plan->prev + worker*stride;
+  if (pass==task->sum_pass) {
+    for (m=0; m<n; m++) prev[m] = s[m];
+  }
+  if (task->weighted)
+    RelaxRow(s, plan->soln[1 - c] + base, stride, off, n,
+             plan->dxp[c] + base, plan->dxm[c] + base,
+             plan->dyp[c] + base, plan->dym[c] + base,
+             plan->w1[c] + base, plan->w2[c] + base,
+             plan->w3[c] + base, plan->w4[c] + base,
+             plan->norm[c] + base);
+  else
+    UnweightedRelaxRow(s, plan->soln[1 - c] + base, stride, off, n,
+             plan->dxp[c] + base, plan->dxm[c] + base,
+             plan->dyp[c] + base, plan->dym[c] + base);
+  if (pass==task->sum_pass) {
+    for (m=0; m<n; m++) {
+      diff = s[m] - prev[m];
+      sum += diff*diff;
+    }
+    plan->sums[j] = sum;
+  }
+  /* ghost points: see RelaxGhosts */
+  s = plan->soln[c];
+  if (off) s[r] = s[r + 1];
+  if (((plan->w + j) & 1)==c) 
+    s[r + plan->w/2 + 1] = s[r + (plan->w - 2)/2 + 1];
+  if (j==1) 
+    for (m=0; m<stride; m++) s[m] = s[r + m];
+  if (j==h - 2) 
+    for (m=0; m<stride; m++) s[(h + 1)*stride + m] = s[r + m];
+}
+
+/* Weighted relaxation of the n points s[0..n-1] of one row of */
+/* one color.  o points to the other color's array at the same */
+/* position, and off is 1 if the row starts with a point of    */
+/* the other color, so the neighbors of s[m] are o[m+off],     */
+/* o[m+off-1], o[m+stride] and o[m-stride].                    */
+SIMD_LOOPS
+void RelaxRow(float *SIMD_RESTRICT s, float *o, int stride, int off, int n,
+              float *dxp, float *dxm, float *dyp, float *dym,
+              float *w1, float *w2, float *w3, float *w4, float *norm)
+{
+  int    m;
+  float  x1, x2, x3, x4, r, u, q;
+  for (m=0; m<n; m++) {
+    x1 = o[m + off];
+    x2 = o[m + off - 1];
+    x3 = o[m + stride];
+    x4 = o[m - stride];
+    r = w1[m]*(x1 - dxp[m]) + w2[m]*(x2 + dxm[m]) 
+                + w3[m]*(x3 - dyp[m]) + w4[m]*(x4 + dym[m]);
+    u = x1 - dxp[m] + x2 + dxm[m] + x3 - dyp[m] + x4 + dym[m];
+    q = (norm[m] > 0.0f) ? norm[m] : 1.0f;
+    r = r/q;
+    s[m] = (norm[m] > 0.0f) ? r : 0.25f*u;
+  }
+}
+
+/* Unweighted relaxation of one row of one color (see RelaxRow) */
+SIMD_LOOPS
+void UnweightedRelaxRow(float *SIMD_RESTRICT s, float *o, int stride, int off,
+                        int n, float *dxp, float *dxm, float *dyp,
+                        float *dym)
+{
+  int    m;
+  float  x1, x2, x3, x4;
+  for (m=0; m<n; m++) {
+    x1 = o[m + off];
+    x2 = o[m + off - 1];
+    x3 = o[m + stride];
+    x4 = o[m - stride];
+    s[m] = 0.25f*(x1 - dxp[m] + x2 + dxm[m] + x3 - dyp[m] + x4 + dym[m]);
+  }
+}
+
+/*
+ * Norm of the residual of the equation solved by Relax, relative
+ * to the norm of its right-hand side (i.e., the residual of the
+ * zero solution).  The residual at (i,j) is
+ *    w1*(f(i+1,j) - dx(i,j)) + w2*(f(i-1,j) + dx(i-1,j))
+ *      + w3*(f(i,j+1) - dy(i,j)) + w4*(f(i,j-1) + dy(i,j-1))
+ *      - (w1 + w2 + w3 + w4)*f(i,j)
+ * with the weights of Relax, or all weights 1 if dxwts and dywts
+ * are null pointers.  If soln is a null pointer, the norm of the
+ * right-hand side itself is returned.
+ */
+double RelaxResidual(float *soln, float *dx, float *dy, float *dxwts,
+                     float *dywts, int w, int h)
+{
+  int     i, j, k;
+  float   x1, x2, x3, x4, f, y, z;
+  float   w1=1.0, w2=1.0, w3=1.0, w4=1.0;
+  double  r, b, rsum=0.0, bsum=0.0;
+  for (j=0; j<h; j++) {
+    for (i=0; i<w; i++) {
+      k = j*w + i;
+      if (dxwts && dywts) {
+        w1 = (i < w - 1) ? dxwts[k+1] : dxwts[k-1];
+        if (w1 > dxwts[k]) w1 = dxwts[k];
+        w1 = w1*w1;
+        w2 = (i > 0) ? dxwts[k-1] : dxwts[k+1];
+        if (w2 > dxwts[k]) w2 = dxwts[k];
+        w2 = w2*w2;
+        w3 = (j < h - 1) ? dywts[k+w] : dywts[k-w];
+        if (w3 > dywts[k]) w3 = dywts[k];
+        w3 = w3*w3;
+        w4 = (j > 0) ? dywts[k-w] : dywts[k+w];
+        if (w4 > dywts[k]) w4 = dywts[k];
+        w4 = w4*w4;
+      }
+      y = (i > 0) ? dx[k-1] : -dx[k];
+      z = (j > 0) ? dy[k-w] : -dy[k];
+      b = -w1*dx[k] + w2*y - w3*dy[k] + w4*z;
+      bsum += b*b;
+      if (soln) {
+        x1 = (i < w - 1) ? soln[k+1] : soln[k-1];
+        x2 = (i > 0) ? soln[k-1] : soln[k+1];
+        x3 = (j < h - 1) ? soln[k+w] : soln[k-w];
+        x4 = (j > 0) ? soln[k-w] : soln[k+w];
+        f = soln[k];
+        r = b + w1*(x1 - f) + w2*(x2 - f) + w3*(x3 - f) + w4*(x4 - f);
+        rsum += r*r;
+      }
+    }
+  }
+  if (!soln) return sqrt(bsum);
+  return (bsum > 0.0) ? sqrt(rsum/bsum) : sqrt(rsum);
+}
+
+/*
+ * Change of soln since the last cycle, relative to soln itself:
+ * the rms of soln - prev over the rms of soln, with their means
+ * removed (the solution is only defined up to a constant).  It
+ * goes to zero as the cycles converge, whereas RelaxResidual
+ * levels off at a floor that depends on the data.  On return,
+ * prev holds a copy of soln.
+ */
+double RelaxChange(float *soln, float *prev, int n)
+{
+  int     k;
+  double  d, dsum=0.0, d2sum=0.0, ssum=0.0, s2sum=0.0;
+  for (k=0; k<n; k++) {
+    d = soln[k] - prev[k];
+    dsum += d;
+    d2sum += d*d;
+    ssum += soln[k];
+    s2sum += (double)soln[k]*soln[k];
+    prev[k] = soln[k];
+  }
+  d2sum -= dsum*dsum/n;
+  s2sum -= ssum*ssum/n;
+  if (d2sum < 0.0) d2sum = 0.0;
+  if (s2sum <= 0.0) return (d2sum > 0.0) ? 1.0 : 0.0;
+  return sqrt(d2sum/s2sum);
+}
+
+/* Save the relative residual after each multigrid cycle to a */
+/* comma-separated file of (cycle, residual) lines.           */
+void WriteResidualHistory(char *filename, double *history,
+                          int num_cycles)
+{
+  int   n;
+  FILE  *fp;
+  OpenFile(&fp, filename, "w");
+  fprintf(fp, "cycle,residual\n");
+  for (n=0; n<num_cycles; n++) {
+    fprintf(fp, "%d,%g\n", n + 1, history[n]);
+  }
+  fclose(fp);
+}
@@ -1,5 +1,60 @@
 #ifndef __RELAX
 #define __RELAX
+#include "pool.h"
+#include "simd.h"
+/* smallest grid (in pixels) whose sweeps are split among threads */
+#define RELAX_MIN_PARALLEL      (64*64)
+#define RELAX_BANDS_PER_THREAD  4
+/* most sweeps done together in one wavefront (see Relax) */
+#define RELAX_BLOCK_PASSES      8
+/* Work arrays for relaxing a w x h grid.  The points of each   */
+/* color c = (i+j)%2 are stored apart, point (i,j) at           */
+/* [(j+1)*stride + i/2 + 1], so that a sweep of one color reads */
+/* and writes consecutive memory.  The soln arrays have a ring  */
+/* of ghost points holding the reflecting boundary values (see  */
+/* RelaxGhosts).  w1..w4 are the squared edge weights and norm  */
+/* their sum (null if unweighted), and dxp, dxm, dyp and dym    */
+/* are the derivatives of the +x, -x, +y and -y edges.           */
+typedef struct {
+  int         w, h, stride;
+  int         weighted, wts_ready;
+  float       *soln[2];
+  float       *dxp[2], *dxm[2], *dyp[2], *dym[2];
+  float       *w1[2], *w2[2], *w3[2], *w4[2], *norm[2];
+  double      *sums;      /* per row: sum of squared changes */
+  float       *prev;      /* per thread: one row before a sweep */
+  ThreadPool  *pool;
+} RelaxPlan;
+/* arguments of RelaxWavefrontTask and RelaxSeamTask */
+typedef struct {
+  RelaxPlan   *plan;
+  int         weighted, num_bands;
+  int         first_pass, num_passes, sum_pass;
+} RelaxTask;
 void Relax(float *soln, float *dx, float *dy, float *dxwts,
-           float *dywts, int w, int h, int numit);
+           float *dywts, int w, int h, int numit, RelaxPlan *plan);
+RelaxPlan *AllocateRelaxPlan(int w, int h, int weighted,
+                             ThreadPool *pool);
+void FreeRelaxPlan(RelaxPlan *plan);
+void PackRelaxPlan(RelaxPlan *plan, float *soln, float *dx, float *dy,
+                   float *dxwts, float *dywts);
+void PackRelaxWeights(RelaxPlan *plan, float *dxwts, float *dywts);
+void UnpackRelaxPlan(RelaxPlan *plan, float *soln);
+void RelaxGhosts(RelaxPlan *plan, int color);
+void RelaxBlocking(RelaxPlan *plan, int *num_passes, int *num_bands);
+void RelaxWavefrontTask(void *arg, int band, int worker);
+void RelaxSeamTask(void *arg, int seam, int worker);
+void RelaxPlanRow(RelaxPlan *plan, int j, int pass, RelaxTask *task,
+                  int worker);
+void RelaxRow(float *SIMD_RESTRICT s, float *o, int stride, int off, int n,
+              float *dxp, float *dxm, float *dyp, float *dym,
+              float *w1, float *w2, float *w3, float *w4, float *norm);
+void UnweightedRelaxRow(float *SIMD_RESTRICT s, float *o, int stride, int off,
+                        int n, float *dxp, float *dxm, float *dyp,
+                        float *dym);
+double RelaxResidual(float *soln, float *dx, float *dy, float *dxwts,
+                     float *dywts, int w, int h);
+double RelaxChange(float *soln, float *prev, int n);
+void WriteResidualHistory(char *filename, double *history,
+                          int num_cycles);
 #endif
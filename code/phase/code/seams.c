@@ -0,0 +1,197 @@
+/*
+ *  seams.c -- functions for merging independently unwrapped
+ *             tiles by the offsets voted for along their seams
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include "file.h"
+#include "util.h"
+#include "seams.h"
+
+/* Allocate an empty seam graph */
+SeamGraph *AllocateSeamGraph(void)
+{
+  SeamGraph  *graph;
+  graph = (SeamGraph *) malloc(sizeof(SeamGraph));
+  if (!graph)
+    ErrorHandler("Cannot allocate memory", "seam graph",
+                 MEMORY_ALLOCATION_ERROR);
+  graph->edges = NULL;
+  graph->num_edges = graph->capacity = graph->first = 0;
+  graph->num_slots = 64;
+  graph->seam = 1;
+  AllocateInt(&graph->slot_edge, graph->num_slots, "seam graph");
+  AllocateInt(&graph->slot_mark, graph->num_slots, "seam graph");
+  return graph;
+}
+
+/* Free the seam graph */
+void FreeSeamGraph(SeamGraph *graph)
+{
+  if (graph->edges) free(graph->edges);
+  free(graph->slot_edge);
+  free(graph->slot_mark);
+  free(graph);
+}
+
+/* Begin the edges of a new seam (i.e., a new pair of tiles), */
+/* which empties the hash table                               */
+void StartSeam(SeamGraph *graph)
+{
+  graph->first = graph->num_edges;
+  ++graph->seam;
+}
+
+/* Return the slot of the hash table that holds the edge of the */
+/* current seam from a to b with the given offset (any offset   */
+/* if match_offset is 0), or the empty slot where it belongs    */
+int SeamSlot(SeamGraph *graph, int a, int b, int offset,
+             int match_offset)
+{
+  unsigned int  h;
+  int           s;
+  SeamEdge      *e;
+  h = 2654435761U*(unsigned int) a + 40503U*(unsigned int) b;
+  if (match_offset) h = h*31U + (unsigned int) offset;
+  for (s=(h ^ (h >> 16)) & (graph->num_slots - 1); ;
+       s=(s + 1) & (graph->num_slots - 1)) {
+    if (graph->slot_mark[s] != graph->seam) return s;
+    e = &graph->edges[graph->slot_edge[s]];
+    if (e->a==a && e->b==b && (!match_offset || e->offset==offset))
+      return s;
+  }
+}
+
+/* Double the hash table and index the edges of the current */
+/* seam in it again                                         */
+void GrowSeamSlots(SeamGraph *graph)
+{
+  int  k, s;
+  free(graph->slot_edge);
+  free(graph->slot_mark);
+  graph->num_slots *= 2;
+  AllocateInt(&graph->slot_edge, graph->num_slots, "seam graph");
+  AllocateInt(&graph->slot_mark, graph->num_slots, "seam graph");
+  for (k=graph->first; k<graph->num_edges; k++) {
+    s = SeamSlot(graph, graph->edges[k].a, graph->edges[k].b,
+                 graph->edges[k].offset, 1);
+    graph->slot_edge[s] = k;
+    graph->slot_mark[s] = graph->seam;
+  }
+}
+
+/* Add a vote of the given weight for raising node b by "offset" */
+/* cycles relative to node a.  The votes of the current seam are */
+/* tallied in one edge per pair of nodes and offset.             */
+void AddSeamVote(SeamGraph *graph, int a, int b, int offset,
+                 double weight)
+{
+  int       s, k;
+  SeamEdge  *e;
+  s = SeamSlot(graph, a, b, offset, 1);
+  if (graph->slot_mark[s]==graph->seam) {
+    graph->edges[graph->slot_edge[s]].weight += weight;
+    return;
+  }
+  if (graph->num_edges >= graph->capacity) {
+    graph->capacity = (graph->capacity > 0) ? 2*graph->capacity : 64;
+    graph->edges = (SeamEdge *) realloc(graph->edges,
+                               graph->capacity*sizeof(SeamEdge));
+    if (!graph->edges)
+      ErrorHandler("Cannot allocate memory", "seam graph",
+                   MEMORY_ALLOCATION_ERROR);
+  }
+  k = graph->num_edges++;
+  e = &graph->edges[k];
+  e->a = a;
+  e->b = b;
+  e->offset = offset;
+  e->weight = weight;
+  graph->slot_edge[s] = k;
+  graph->slot_mark[s] = graph->seam;
+  /* keep the table at most half full */
+  if (2*(graph->num_edges - graph->first) > graph->num_slots)
+    GrowSeamSlots(graph);
+}
+
+/* Of the edges of the current seam, keep the offset with the     */
+/* most votes for each pair of nodes, weighted by its margin over */
+/* the other offsets.  The pairs are found through the hash table */
+/* (by node pair only).  Returns the number of edges kept.        */
+int BestSeams(SeamGraph *graph)
+{
+  int       i, m, s;
+  double    w;
+  SeamEdge  *edges = graph->edges, *e;
+  ++graph->seam;
+  for (i=graph->first, m=graph->first; i<graph->num_edges; i++) {
+    edges[i].total = edges[i].weight;
+    s = SeamSlot(graph, edges[i].a, edges[i].b, 0, 0);
+    if (graph->slot_mark[s] != graph->seam) {
+      graph->slot_edge[s] = m;
+      graph->slot_mark[s] = graph->seam;
+      edges[m++] = edges[i];
+    }
+    else {
+      e = &edges[graph->slot_edge[s]];
+      w = e->total + edges[i].weight;
+      if (e->weight < edges[i].weight) *e = edges[i];
+      e->total = w;
+    }
+  }
+  for (i=graph->first; i<m; i++)
+    edges[i].weight = 2.0*edges[i].weight - edges[i].total;
+  graph->num_edges = m;
+  return m - graph->first;
+}
+
+/* Merge the nodes of the seam graph along its edges, highest     */
+/* weight first, ignoring edges between nodes already merged.     */
+/* Each node's offset relative to its root is found by FindPiece. */
+void MergeSeams(SeamEdge *edges, int num_edges, int *parent,
+                int *offset, int num_nodes)
+{
+  int  k, a, b, oa, ob;
+  if (num_edges > 0)
+    qsort(edges, num_edges, sizeof(SeamEdge), CompareSeams);
+  for (k=0; k<num_nodes; k++) {
+    parent[k] = k;
+    offset[k] = 0;
+  }
+  for (k=0; k<num_edges; k++) {
+    a = FindPiece(parent, offset, edges[k].a, &oa);
+    b = FindPiece(parent, offset, edges[k].b, &ob);
+    if (a==b) continue;
+    parent[b] = a;
+    offset[b] = oa + edges[k].offset - ob;
+  }
+}
+
+/* Compare seam graph edges (for qsort): highest weight first */
+int CompareSeams(const void *p, const void *q)
+{
+  double  wp = ((SeamEdge *) p)->weight, wq = ((SeamEdge *) q)->weight;
+  return (wp > wq) ? -1 : (wp < wq) ? 1 : 0;
+}
+
+/* Return the root of the merged pieces that "node" belongs to,  */
+/* and in "total" the offset of node relative to the root.  The  */
+/* offset of each node is relative to its parent, and the nodes  */
+/* on the path are pointed at the root.                          */
+int FindPiece(int *parent, int *offset, int node, int *total)
+{
+  int  root, next, sum, off;
+  for (root=node, sum=0; parent[root]!=root; root=parent[root])
+    sum += offset[root];
+  *total = sum;
+  while (node != root) {
+    next = parent[node];
+    off = offset[node];
+    parent[node] = root;
+    offset[node] = sum;
+    sum -= off;
+    node = next;
+  }
+  return root;
+}
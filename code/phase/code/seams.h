@@ -0,0 +1,33 @@
+#ifndef __SEAMS
+#define __SEAMS
+/* Edge of the seam graph: node b must be raised by "offset"  */
+/* cycles relative to node a.  weight is the total quality of */
+/* the seam pixels that agree on the offset, less that of the */
+/* ones that do not (total is the quality of all of them).    */
+typedef struct {
+  int     a, b, offset;
+  double  weight, total;
+} SeamEdge;
+/* Edge list of the seam graph.  The edges of the current seam   */
+/* (from edge "first" on) are indexed by a hash table of         */
+/* num_slots slots, which holds the index of an edge in          */
+/* slot_edge and is valid where slot_mark equals "seam".         */
+typedef struct {
+  SeamEdge  *edges;
+  int       num_edges, capacity, first;
+  int       *slot_edge, *slot_mark, num_slots, seam;
+} SeamGraph;
+SeamGraph *AllocateSeamGraph(void);
+void FreeSeamGraph(SeamGraph *graph);
+void StartSeam(SeamGraph *graph);
+int SeamSlot(SeamGraph *graph, int a, int b, int offset,
+             int match_offset);
+void GrowSeamSlots(SeamGraph *graph);
+void AddSeamVote(SeamGraph *graph, int a, int b, int offset,
+                 double weight);
+int BestSeams(SeamGraph *graph);
+void MergeSeams(SeamEdge *edges, int num_edges, int *parent,
+                int *offset, int num_nodes);
+int CompareSeams(const void *p, const void *q);
+int FindPiece(int *parent, int *offset, int node, int *total);
+#endif
@@ -0,0 +1,28 @@
+#ifndef __SIMD
+#define __SIMD
+/* Kernels marked SIMD_CLONES are compiled for AVX-512, AVX2 and */
+/* the default instruction set, and the best one for the CPU is  */
+/* chosen at run time.  Define NO_SIMD_CLONES to turn it off.    */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(NO_SIMD_CLONES)
+#define SIMD_CLONES  __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define SIMD_CLONES
+#endif
+/* SIMD_LOOPS kernels are also vectorized at -O2, and their      */
+/* products are never fused into multiply-adds, so every clone   */
+/* gives exactly the results of the scalar code.  SIMD_RESTRICT  */
+/* marks the output array of such a kernel, which must not       */
+/* overlap its inputs.                                           */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(NO_SIMD_CLONES)
+#define SIMD_LOOPS  SIMD_CLONES __attribute__((optimize(\
+                      "tree-vectorize", "vect-cost-model=dynamic", \
+                      "fp-contract=off", "no-trapping-math")))
+#else
+#define SIMD_LOOPS
+#endif
+#if defined(__GNUC__)
+#define SIMD_RESTRICT  __restrict__
+#else
+#define SIMD_RESTRICT
+#endif
+#endif
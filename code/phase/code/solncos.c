@@ -10,22 +10,18 @@
 /* Main function for direct solution of Poisson's equation for     */
 /* unweighted least squares phase unwrapping by means of discrete  */
 /* cosine transform (which actually uses FFTs to compute the DCTs) */
+/* The plan (see AllocateCosinePlan) holds the transform tables    */
+/* and the denominators for this array size.                       */
 void DirectSolnByCosineTransform(float *array, int xsize, int ysize,
-                                 double *xcos, double *ycos)
+                                 CosinePlan *plan)
 {
   int   i, j, m, n;
   /*  Transform  */
   printf("Forward transform...\n");
-  FastCosineTransform(array, xsize, ysize, 1);
+  FastCosineTransform(array, xsize, ysize, 1, plan);
 
   /*  Divide  */
   printf("Scaling...\n");
-  for (i=0; i<xsize; i++) {
-    xcos[i] = cos(i*PI/(xsize - 1.0));
-  }
-  for (j=0; j<ysize; j++) {
-    ycos[j] = cos(j*PI/(ysize - 1.0));
-  }
   array[0] = 0.0;
   for (j=0; j<ysize; j++) {
     for (i=0; i<xsize; i++) {
@@ -33,11 +29,11 @@ void DirectSolnByCosineTransform(float *array, int xsize, int ysize,
         array[0] = 0.0;
       }
       else {
-        array[j*xsize + i] /= (4.0 - 2.0*xcos[i] - 2.0*ycos[j]);
+        array[j*xsize + i] /= (plan->xdenom[i] - plan->ydenom[j]);
       }
     }
   }
   /*  Transform  */
   printf("Inverse transform...\n");
-  FastCosineTransform(array, xsize, ysize, -1);
+  FastCosineTransform(array, xsize, ysize, -1, plan);
 }
@@ -1,5 +1,6 @@
 #ifndef __SOLNCOS
 #define __SOLNCOS
+#include "dct.h"
 void DirectSolnByCosineTransform(float *laplace, int xsize, 
-                            int ysize, double *xcos, double *ycos);
+                            int ysize, CosinePlan *plan);
 #endif
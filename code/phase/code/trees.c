@@ -3,50 +3,53 @@
  *             in Flynn's min. discontinuity algorithm
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
+#include "file.h"
+#include "util.h"
 #include "trees.h"
 
 /* Remove the loop and update all of the edges. */  
 void RemoveLoop(int ibase, int jbase, int ilast, int jlast,
-                int *value, unsigned char *bitflags, short *vjump,
-                short *hjump, int xsize, int ysize)
+                FlynnNode *nodes, int *stack, DirtyMap *dirty,
+                int xsize, int ysize)
 {
   int   jtip,itip;
   int   value_shift;
   /* Remove edge from last node to base of loop */
-  if (jbase>jlast)       --vjump[jbase*(xsize+1) + ibase];
-  else if (jbase<jlast)  ++vjump[jlast*(xsize+1) + ilast];
-  else if (ibase>ilast)  ++hjump[jbase*(xsize+1) + ibase];
-  else if (ibase<ilast)  --hjump[jlast*(xsize+1) + ilast];
+  if (jbase>jlast)       --nodes[jbase*(xsize+1) + ibase].vjump;
+  else if (jbase<jlast)  ++nodes[jlast*(xsize+1) + ilast].vjump;
+  else if (ibase>ilast)  ++nodes[jbase*(xsize+1) + ibase].hjump;
+  else if (ibase<ilast)  --nodes[jlast*(xsize+1) + ilast].hjump;
   /* Back up over loop: remove edges and change subtree values */
   jtip = jlast;
   itip = ilast;
   do {
-    value_shift = -value[jtip*(xsize+1) + itip];
-    ChangeOrphan(itip, jtip, value_shift, value, bitflags,
+    value_shift = -nodes[jtip*(xsize+1) + itip].value;
+    ChangeOrphan(itip, jtip, value_shift, nodes, stack, dirty,
                  xsize, ysize);
     if (jtip > 0 
-           && (bitflags[(jtip-1)*(xsize+1) + itip] & RIGHT)) {
-      vjump[jtip*(xsize+1) + itip]--;
-      bitflags[(jtip-1)*(xsize+1) + itip] &= ~RIGHT;
+           && (nodes[(jtip-1)*(xsize+1) + itip].flags & RIGHT)) {
+      nodes[jtip*(xsize+1) + itip].vjump--;
+      nodes[(jtip-1)*(xsize+1) + itip].flags &= ~RIGHT;
       jtip--;
     }
     else if ((jtip<ysize) &&
-        (bitflags[(jtip+1)*(xsize+1) + itip] & LEFT)) {
-      vjump[(jtip+1)*(xsize+1) + itip]++;
-      bitflags[(jtip+1)*(xsize+1) + itip] &= ~LEFT;
+        (nodes[(jtip+1)*(xsize+1) + itip].flags & LEFT)) {
+      nodes[(jtip+1)*(xsize+1) + itip].vjump++;
+      nodes[(jtip+1)*(xsize+1) + itip].flags &= ~LEFT;
       jtip++;
     }
     else if (itip > 0 
-                && (bitflags[jtip*(xsize+1) + itip-1] & DOWN)) {
-      hjump[jtip*(xsize+1) + itip]++;
-      bitflags[jtip*(xsize+1) + itip-1] &= ~DOWN;
+                && (nodes[jtip*(xsize+1) + itip-1].flags & DOWN)) {
+      nodes[jtip*(xsize+1) + itip].hjump++;
+      nodes[jtip*(xsize+1) + itip-1].flags &= ~DOWN;
       itip--;
     }
     else if ((itip<xsize) 
-                && (bitflags[jtip*(xsize+1) + itip+1] & UP)) {
-      hjump[jtip*(xsize+1) + itip+1]--;
-      bitflags[jtip*(xsize+1) + itip+1] &= ~UP;
+                && (nodes[jtip*(xsize+1) + itip+1].flags & UP)) {
+      nodes[jtip*(xsize+1) + itip+1].hjump--;
+      nodes[jtip*(xsize+1) + itip+1].flags &= ~UP;
       itip++;
     }
     else {
@@ -60,56 +63,151 @@ void RemoveLoop(int ibase, int jbase, int ilast, int jlast,
  * Add 'value_change' (which is > 0) to the values of all nodes
  * of the tree rooted at the node (i,j).  Set a flag if the tree
  * includes (ilast,jlast). Make (i,j) child in the next iteration.
+ * The tree is walked with the explicit stack 'stack' (see
+ * TreeStackSize), so that large trees cannot overflow the call
+ * stack.  The runs of the changed nodes are marked dirty.
  */
 void ChangeExten(int i, int j, int ilast, int jlast,
-                 int *loop_found, int value_change, int *value,
-                 unsigned char *bitflags, int xsize, int ysize)
+                 int *loop_found, int value_change, FlynnNode *nodes,
+                 int *stack, DirtyMap *dirty, int xsize)
 {
-  unsigned char kids;
-  *loop_found |= ((j == jlast) && (i == ilast));
-  kids = bitflags[j*(xsize+1) + i];
-  if (kids & LEFT)  
-    ChangeExten(i, j-1, ilast, jlast, loop_found, value_change,
-                value, bitflags, xsize, ysize);
-  if (kids & RIGHT)  
-    ChangeExten(i, j+1, ilast, jlast, loop_found, value_change,
-                value, bitflags, xsize, ysize);
-  if (kids & UP)    
-    ChangeExten(i-1, j, ilast, jlast, loop_found, value_change,
-                value, bitflags, xsize, ysize);
-  if (kids & DOWN) 
-    ChangeExten(i+1, j, ilast, jlast, loop_found, value_change,
-                value, bitflags, xsize, ysize);
-  value[j*(xsize+1) + i] += value_change;
-  bitflags[j*(xsize+1) + i] |= (NEXT_TIME | THIS_TIME);
+  int            k, n, w = xsize + 1, klast = jlast*(xsize + 1) + ilast;
+  unsigned char  kids;
+  n = 0;
+  stack[n++] = j*w + i;
+  while (n > 0) {
+    k = stack[--n];
+    *loop_found |= (k == klast);
+    kids = nodes[k].flags;
+    if (kids & LEFT)  stack[n++] = k - w;
+    if (kids & RIGHT) stack[n++] = k + w;
+    if (kids & UP)    stack[n++] = k - 1;
+    if (kids & DOWN)  stack[n++] = k + 1;
+    nodes[k].value += value_change;
+    nodes[k].flags |= (NEXT_TIME | THIS_TIME);
+    MarkDirty(dirty, k);
+  }
 }
 
 /*
  * Add 'value_shift' (which is < 0) to the values of all nodes
  * of the tree rooted at the node (i,j).  If the change would make
  * 'value' < 0, make 'value' 0 instead  and split the node from
- * its parent.  Make (i,j) child in the next iteration.
+ * its parent.  Make (i,j) child in the next iteration.  The
+ * stack holds the nodes still to be visited and the shifts
+ * to be applied to them.
  */
-void ChangeOrphan(int i, int j, int value_shift, int *value,
-                  unsigned char *bitflags, int xsize, int ysize)
+void ChangeOrphan(int i, int j, int value_shift, FlynnNode *nodes,
+                  int *stack, DirtyMap *dirty, int xsize, int ysize)
 {
-  unsigned char kids;
-  if (value[j*(xsize+1) + i] + (value_shift) < 0) {
-    value_shift = -value[j*(xsize+1) + i];
-    if (j>0)     bitflags[(j-1)*(xsize+1) + i] &=  ~RIGHT;
-    if (j<ysize) bitflags[(j+1)*(xsize+1) + i] &=  ~LEFT;
-    if (i>0)     bitflags[j*(xsize+1) + i-1]   &=  ~DOWN;
-    if (i<xsize) bitflags[j*(xsize+1) + i+1]   &=  ~UP;
+  int            k, n, shift, w = xsize + 1;
+  unsigned char  kids;
+  n = 0;
+  stack[n++] = j*w + i;
+  stack[n++] = value_shift;
+  while (n > 0) {
+    shift = stack[--n];
+    k = stack[--n];
+    if (nodes[k].value + shift < 0) {
+      shift = -nodes[k].value;
+      i = k%w;
+      j = k/w;
+      if (j>0)     nodes[k - w].flags &=  ~RIGHT;
+      if (j<ysize) nodes[k + w].flags &=  ~LEFT;
+      if (i>0)     nodes[k - 1].flags &=  ~DOWN;
+      if (i<xsize) nodes[k + 1].flags &=  ~UP;
+    }
+    kids = nodes[k].flags;
+    if (kids & LEFT) {
+      stack[n++] = k - w;
+      stack[n++] = shift;
+    }
+    if (kids & RIGHT) {
+      stack[n++] = k + w;
+      stack[n++] = shift;
+    }
+    if (kids & UP) {
+      stack[n++] = k - 1;
+      stack[n++] = shift;
+    }
+    if (kids & DOWN) {
+      stack[n++] = k + 1;
+      stack[n++] = shift;
+    }
+    nodes[k].flags |= (NEXT_TIME | THIS_TIME);
+    MarkDirty(dirty, k);
+    nodes[k].value += shift;
   }
-  kids = bitflags[j*(xsize+1) + i];
-  if (kids & LEFT) ChangeOrphan(i, j-1, value_shift, value,
-                                bitflags, xsize, ysize);
-  if (kids & RIGHT) ChangeOrphan(i, j+1, value_shift, value,
-                                 bitflags, xsize, ysize);
-  if (kids & UP) ChangeOrphan(i-1, j, value_shift, value,
-                              bitflags, xsize, ysize);
-  if (kids & DOWN) ChangeOrphan(i+1, j, value_shift, value,
-                                bitflags, xsize, ysize);
-  bitflags[j*(xsize+1) + i] |= (NEXT_TIME | THIS_TIME);
-  value[j*(xsize+1) + i] += value_shift;
+}
+
+/* Length of the stack (ints) for ChangeExten and ChangeOrphan: */
+/* each node of the (xsize+1) x (ysize+1) grid is pushed at     */
+/* most once, with its shift                                    */
+int TreeStackSize(int xsize, int ysize)
+{
+  return 2*(xsize + 1)*(ysize + 1);
+}
+
+/* Allocate the (xsize + 1) x (ysize + 1) nodes of Flynn's */
+/* algorithm for an xsize x ysize image, all zero           */
+FlynnNode *AllocateFlynnNodes(int xsize, int ysize)
+{
+  FlynnNode  *nodes;
+  nodes = (FlynnNode *) calloc((xsize + 1)*(ysize + 1),
+                               sizeof(FlynnNode));
+  if (!nodes)
+    ErrorHandler("Cannot allocate memory", "Flynn nodes",
+                 MEMORY_ALLOCATION_ERROR);
+  return nodes;
+}
+
+/* Allocate a dirty map of num_nodes nodes, with all runs clean */
+DirtyMap *AllocateDirtyMap(int num_nodes)
+{
+  DirtyMap  *dirty;
+  dirty = (DirtyMap *) malloc(sizeof(DirtyMap));
+  if (!dirty)
+    ErrorHandler("Cannot allocate memory", "dirty map",
+                 MEMORY_ALLOCATION_ERROR);
+  dirty->num_nodes = num_nodes;
+  dirty->num_words = ((num_nodes + DIRTY_MASK) >> DIRTY_SHIFT)
+                         /DIRTY_WORD_BITS + 1;
+  dirty->bits = (DirtyWord *) calloc(dirty->num_words,
+                                     sizeof(DirtyWord));
+  if (!dirty->bits)
+    ErrorHandler("Cannot allocate memory", "dirty map",
+                 MEMORY_ALLOCATION_ERROR);
+  return dirty;
+}
+
+/* Free the dirty map */
+void FreeDirtyMap(DirtyMap *dirty)
+{
+  free(dirty->bits);
+  free(dirty);
+}
+
+/* Number of nodes from k up to the end of its run (but not past */
+/* 'last') that can be skipped: neither they nor the nodes       */
+/* 'offset' from them lie in dirty runs.  0 if they cannot.      */
+int CleanAhead(DirtyMap *dirty, int k, int last, int offset)
+{
+  if ((k | DIRTY_MASK) < last) last = k | DIRTY_MASK;
+  if (IsDirty(dirty, k >> DIRTY_SHIFT)
+        || IsDirty(dirty, (k + offset) >> DIRTY_SHIFT)
+        || IsDirty(dirty, (last + offset) >> DIRTY_SHIFT))
+    return 0;
+  return last - k + 1;
+}
+
+/* Number of nodes from k down to the start of its run (but not */
+/* past 'first') that can be skipped, as in CleanAhead           */
+int CleanBehind(DirtyMap *dirty, int k, int first, int offset)
+{
+  if ((k & ~DIRTY_MASK) > first) first = k & ~DIRTY_MASK;
+  if (IsDirty(dirty, k >> DIRTY_SHIFT)
+        || IsDirty(dirty, (k + offset) >> DIRTY_SHIFT)
+        || IsDirty(dirty, (first + offset) >> DIRTY_SHIFT))
+    return 0;
+  return k - first + 1;
 }
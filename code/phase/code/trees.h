@@ -6,12 +6,47 @@
 #define DOWN    (0x01)
 #define THIS_TIME  (0x40)
 #define NEXT_TIME  (0x80)
+/* Node of Flynn's algorithm, packed so that a node is visited in */
+/* one cache line: its value, the jump counts of its edges and    */
+/* its tree and iteration flags (LEFT, ..., NEXT_TIME).  The jump */
+/* counts are shorts, as in the separate jump arrays this struct  */
+/* replaced, so a node takes 12 bytes (9 bytes of data plus       */
+/* padding).                                                      */
+typedef struct {
+  int            value;
+  short          vjump, hjump;
+  unsigned char  flags;
+} FlynnNode;
+/* Bit-packed map of the runs of DIRTY_RUN nodes (in the order of */
+/* the node array) that may hold nodes flagged THIS_TIME or      */
+/* NEXT_TIME.  Run r is bit r%DIRTY_WORD_BITS of bits[r/DIRTY_    */
+/* WORD_BITS].  Clean runs are skipped by Flynn's iteration.      */
+#define DIRTY_SHIFT     6
+#define DIRTY_RUN       (1 << DIRTY_SHIFT)
+#define DIRTY_MASK      (DIRTY_RUN - 1)
+typedef unsigned long DirtyWord;
+#define DIRTY_WORD_BITS ((int)(8*sizeof(DirtyWord)))
+typedef struct {
+  int        num_nodes, num_words;
+  DirtyWord  *bits;
+} DirtyMap;
+#define MarkDirty(map, k) \
+  ((map)->bits[((k) >> DIRTY_SHIFT)/DIRTY_WORD_BITS] \
+        |= ((DirtyWord) 1) << (((k) >> DIRTY_SHIFT)%DIRTY_WORD_BITS))
+#define IsDirty(map, r) \
+  (((map)->bits[(r)/DIRTY_WORD_BITS] >> ((r)%DIRTY_WORD_BITS)) & 1)
 void RemoveLoop(int ibase, int jbase, int ilast, int jlast,
-                int *value, unsigned char *bitflags, short *vjump,
-                short *hjump, int xsize, int ysize);
+                FlynnNode *nodes, int *stack, DirtyMap *dirty,
+                int xsize, int ysize);
 void ChangeExten(int i, int j, int ilast, int jlast,
-                 int *loop_found, int value_change, int *value,
-                 unsigned char *bitflags, int xsize, int ysize);
-void ChangeOrphan(int i, int j, int value_shift, int *value,
-                  unsigned char *bitflags, int xsize, int ysize);
+                 int *loop_found, int value_change, FlynnNode *nodes,
+                 int *stack, DirtyMap *dirty, int xsize);
+void ChangeOrphan(int i, int j, int value_shift, FlynnNode *nodes,
+                  int *stack, DirtyMap *dirty, int xsize, int ysize);
+FlynnNode *AllocateFlynnNodes(int xsize, int ysize);
+int TreeStackSize(int xsize, int ysize);
+DirtyMap *AllocateDirtyMap(int num_nodes);
+void FreeDirtyMap(DirtyMap *dirty);
+int CleanAhead(DirtyMap *dirty, int k, int last, int offset);
+int CleanBehind(DirtyMap *dirty, int k, int first, int offset);
 #endif
@@ -3,18 +3,51 @@
  *             least-squares phase-unwrapping problem
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "unfmg.h"
 #include "ungrid.h"
+#include "relax.h"
 #include "dxdygrad.h"
+#include "util.h"
 /* Unweighted multigrid function.                */
 /* Initialize soln array to zero before calling. */
-void UnweightedMultigridUnwrap(float *soln, float *dx, float *dy,
-                int xsize, int ysize, int num_cycles, int num_iter)
+/* The tol and history arguments and the return  */
+/* value are as in MultigridUnwrap (fmg.c), and  */
+/* so is arena.                                  */
+int UnweightedMultigridUnwrap(float *soln, float *dx, float *dy,
+                int xsize, int ysize, int num_cycles, int num_iter,
+                double tol, double *history, GridArena *arena)
 {
-  int  n, coarsest_dim=3;
-  for (n=0; n<num_cycles; n++) {
+  int        n, coarsest_dim=COARSEST_DIM;
+  double     resid, change;
+  float      *prev=NULL;
+  GridArena  *own_arena=NULL;
+  if (!GridArenaFits(arena, xsize, ysize, coarsest_dim, 0))
+    arena = own_arena = AllocateGridArena(xsize, ysize, coarsest_dim,
+                                          0, 1);
+  else
+    ResetGridArena(arena);
+  if (tol > 0.0) {
+    AllocateFloat(&prev, xsize*ysize, "previous solution");
+    for (n=0; n<xsize*ysize; n++) prev[n] = soln[n];
+  }
+  for (n=0; n<num_cycles; ) {
     printf("\nFMG CYCLE %d\n", n+1);
-    Ufmg(soln, dx, dy, xsize, ysize, num_iter, coarsest_dim);
+    Ufmg(soln, dx, dy, xsize, ysize, num_iter, coarsest_dim, arena, 0);
+    ++n;
+    if (history) {
+      resid = RelaxResidual(soln, dx, dy, NULL, NULL, xsize, ysize);
+      printf("FMG CYCLE %d: residual = %lf\n", n, resid);
+      history[n - 1] = resid;
+    }
+    if (prev) {
+      change = RelaxChange(soln, prev, xsize*ysize);
+      printf("FMG CYCLE %d: change = %lf\n", n, change);
+      if (change <= tol) break;
+    }
   }
+  if (prev) free(prev);
+  FreeGridArena(own_arena);
+  return n;
 }
@@ -1,5 +1,7 @@
 #ifndef __UNFMG
 #define __UNFMG
-void UnweightedMultigridUnwrap(float *soln, float *dx, float *dy,
-               int xsize, int ysize, int num_cycles, int num_iter);
+#include "gridmem.h"
+int UnweightedMultigridUnwrap(float *soln, float *dx, float *dy,
+               int xsize, int ysize, int num_cycles, int num_iter,
+               double tol, double *history, GridArena *arena);
 #endif
@@ -1,7 +1,8 @@
 #ifndef __UNGRID
 #define __UNGRID
+#include "gridmem.h"
 void Ufmg(float *soln, float *dx, float *dy, int w, int h,
-          int numit, int coarsest_dim);
+          int numit, int coarsest_dim, GridArena *arena, int level);
 void Umv(float *soln, float *dx, float *dy, int w, int h,
-         int numit, int coarsest_dim);
+         int numit, int coarsest_dim, GridArena *arena, int level);
 #endif